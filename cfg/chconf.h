@@ -773,7 +773,7 @@
  * @details This hook is continuously invoked by the idle thread loop.
  */
 #define CH_CFG_IDLE_LOOP_HOOK() {                                           \
-  /* Idle loop code here.*/                                                 \
+  powerIdle();                                                              \
 }
 
 /**
@@ -817,6 +817,13 @@
 /* Port-specific settings (override port settings defaulted in chcore.h).    */
 /*===========================================================================*/
 
+/* The idle loop hook sleeps itself, see src/power/power.h.*/
+#define CORTEX_ENABLE_WFI_IDLE              FALSE
+
+#if !defined(_FROM_ASM_)
+void powerIdle(void);
+#endif
+
 #endif  /* CHCONF_H */
 
 /** @} */
@@ -5,17 +5,26 @@
 #include "ch.h"
 #include "hal.h"
 
+#include "boot.h"
+#include "ccm.h"
 #include "cli.h"
 #include "fs.h"
 #include "led.h"
+#include "rpc.h"
+#include "sensors.h"
+#include "task.h"
+#include "tlogger.h"
+#include "tstream.h"
+#include "usbcfg.h"
 #include "util.h"
+#include "wdog.h"
 
 static const SPIConfig spiconfig2 = {
     .circular = false,
     .end_cb = NULL,
     .ssport = PORT_SPI2_NSS_D31,
     .sspad = PAD_SPI2_NSS_D31,
-    .cr1 = 0,            /* 18MHz, Mode 0 */
+    .cr1 = 0,            /* PCLK1/2 = 18MHz (SPI maximum), Mode 0 */
     .cr2 = SPI_CR2_SSOE, /* Single Master */
 };
 
@@ -24,7 +33,11 @@ static const SNORConfig snorconfig1 = {
     .buscfg = &spiconfig2,
 };
 
-static THD_WORKING_AREA(waThreadFs, 2048);
+/* The flash driver and the callers reading from it hand stack buffers to
+   the SPI DMA, the other threads run from CCM. Of those only the tlogger
+   calls into the filesystem, with a static record that lfs copies into its
+   file cache. The flash access functions check for CCM buffers.*/
+static DMA_WORKING_AREA(waThreadFs, 2048);
 static thread_t *threadFs;
 
 static const ledpad_t ledpads[] = {
@@ -32,25 +45,47 @@ static const ledpad_t ledpads[] = {
     {PORT_D3_LED2, PAD_D3_LED2},
 };
 
-static THD_WORKING_AREA(waThreadLeds, 128);
+static CCM_WORKING_AREA(waThreadLeds, 128);
 static leds_t *leds;
 
+static CCM_WORKING_AREA(waThreadCli, 256);
+static CCM_WORKING_AREA(waThreadTstream, 512);
+static DMA_WORKING_AREA(waThreadRpc, 768);
+static CCM_WORKING_AREA(waThreadSensors, 512);
+static CCM_WORKING_AREA(waThreadWdog, 256);
+static CCM_WORKING_AREA(waThreadTlogger, 384);
+
 int main(void)
 {
     halInit();
+    bootStart();
+    wdogInit();
     chSysInit();
+    bootMark("kernel");
 
+    /* The flash mounts in the background, nothing below waits for it.*/
     threadFs =
         fsStart(waThreadFs, sizeof(waThreadFs), NORMALPRIO, &snorconfig1);
     leds = ledStart(waThreadLeds,
                     sizeof(waThreadLeds),
-                    NORMALPRIO,
+                    TASK_PRIO_RATE,
                     ledpads,
                     COUNTOF(ledpads));
-    cliStart(threadFs, leds, 0);
+    cliStart(waThreadCli, sizeof(waThreadCli), NORMALPRIO, threadFs, leds, 0);
+    tstreamStart(
+        waThreadTstream, sizeof(waThreadTstream), TASK_PRIO_RATE, &SDU2);
+    rpcStart(waThreadRpc, sizeof(waThreadRpc), NORMALPRIO, &SDU2, threadFs);
+    sensorsStart(waThreadSensors, sizeof(waThreadSensors), TASK_PRIO_RATE);
+    tloggerStart(
+        waThreadTlogger, sizeof(waThreadTlogger), TASK_PRIO_RATE, threadFs);
+    /* The periodic ones rank above the others by their rates.*/
+    taskStartAll();
+    /* Above all tasks, a task running away is caught as well.*/
+    wdogStart(waThreadWdog, sizeof(waThreadWdog), HIGHPRIO);
+    bootMark("main");
 
+    /* Everything runs in its own thread, the main thread just sleeps.*/
     while (true) {
-        cliCheck();
-        chThdSleepMilliseconds(500);
+        chThdSleep(TIME_INFINITE);
     }
 }
@@ -0,0 +1,665 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "hal.h"
+#include "lfs_util.h"
+
+#include "boot.h"
+#include "fs.h"
+#include "sim.h"
+#include "tscodec.h"
+#include "w25q_model.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Runs filesystem workloads on the W25Q model and reports simulated time,
+   flash traffic and wear. */
+
+static const SPIConfig spiconfig = {
+    .hz = SIM_SPI_HZ,
+};
+
+static const SNORConfig snorconfig = {
+    .busp = &SPID2,
+    .buscfg = &spiconfig,
+};
+
+static THD_WORKING_AREA(waThreadFs, 2048);
+
+static unsigned count = 200;
+static unsigned idle_ms = 100;
+
+typedef struct {
+    const char *name;
+    const char *help;
+    /* Returns the simulated time to report */
+    uint64_t (*run)(thread_t **threadFs);
+} workload_t;
+
+static double ms(uint64_t ns) { return (double)ns / 1e6; }
+
+static thread_t *boot(void)
+{
+    uint8_t byte;
+    thread_t *threadFs;
+
+    bootStart();
+    threadFs =
+        fsStart(waThreadFs, sizeof(waThreadFs), NORMALPRIO, &snorconfig);
+
+    /* Served once the filesystem is mounted.*/
+    fsReadRaw(threadFs, 0, &byte, sizeof(byte));
+    return threadFs;
+}
+
+static void print_phases(void)
+{
+    const boot_phase_t *phases;
+    unsigned n = bootGetPhases(&phases);
+
+    for (unsigned i = 0; i < n; i++) {
+        printf("    %-10s %8.3f ms\n", phases[i].name, phases[i].us / 1e3);
+    }
+}
+
+static uint64_t run_mount(thread_t **threadFs)
+{
+    uint64_t total = 0;
+
+    for (unsigned i = 0; i < 5; i++) {
+        uint64_t start;
+
+        /* Rebooting once the filesystem is idle.*/
+        simIdle(60U * 1000000U);
+        simStop(*threadFs);
+        start = simNow();
+        *threadFs = boot();
+        total += simNow() - start;
+        printf("  mount %u: %.3f ms\n", i, ms(simNow() - start));
+        print_phases();
+    }
+    return total;
+}
+
+static uint64_t run_config(thread_t **threadFs)
+{
+    uint64_t start = simNow();
+
+    for (unsigned i = 0; i < count; i++) {
+        char key[KV_KEY_MAX];
+        float value[4] = {(float)i, 1.0f, 2.0f, 3.0f};
+
+        snprintf(key, sizeof(key), "cfg%u", i % 8U);
+        if (fsKvSet(*threadFs, key, KV_TYPE_FLOAT, value, sizeof(value)) !=
+            sizeof(value)) {
+            printf("  kv set %u failed\n", i);
+        }
+        simIdle(idle_ms * 1000U);
+    }
+    return simNow() - start;
+}
+
+static uint64_t run_files(thread_t **threadFs)
+{
+    uint64_t start = simNow();
+
+    for (unsigned i = 0; i < count; i++) {
+        char name[16];
+        uint32_t value[4] = {i, 1, 2, 3};
+
+        snprintf(name, sizeof(name), "cfg%u", i % 8U);
+        if (fsWrite(*threadFs, "cfg.tmp", value, sizeof(value)) !=
+                sizeof(value) ||
+            fsRename(*threadFs, "cfg.tmp", name) != 0) {
+            printf("  write %u failed\n", i);
+        }
+        simIdle(idle_ms * 1000U);
+    }
+    return simNow() - start;
+}
+
+static uint64_t run_log(thread_t **threadFs)
+{
+    static uint8_t record[1024];
+    uint64_t start = simNow();
+
+    for (unsigned i = 0; i < count; i++) {
+        char name[16];
+
+        memset(record, (int)i, sizeof(record));
+        snprintf(name, sizeof(name), "log%u", i % 64U);
+        if (fsWrite(*threadFs, name, record, sizeof(record)) !=
+            sizeof(record)) {
+            printf("  log %u failed\n", i);
+        }
+        simIdle(idle_ms * 1000U);
+    }
+    return simNow() - start;
+}
+
+/* The idle time sweeps over the housekeeping slices, so writes land while
+   the blocks the allocator picks next are erased ahead. */
+static uint64_t run_preerase(thread_t **threadFs)
+{
+    static uint8_t record[4096];
+    static uint8_t back[4096];
+    uint64_t start = simNow();
+    unsigned failed = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        char name[16];
+
+        memset(record, (int)i, sizeof(record));
+        snprintf(name, sizeof(name), "pre%u", i % 8U);
+        if (fsWrite(*threadFs, name, record, sizeof(record)) !=
+            sizeof(record)) {
+            printf("  write %u failed\n", i);
+        }
+        simIdle((FS_IDLE_SLICE_MS * 2U + (i * 17U) % 250U) * 1000U);
+    }
+
+    /* Each file holds its last record.*/
+    for (unsigned i = count > 8U ? count - 8U : 0U; i < count; i++) {
+        char name[16];
+
+        memset(record, (int)i, sizeof(record));
+        snprintf(name, sizeof(name), "pre%u", i % 8U);
+        if (fsRead(*threadFs, name, back, sizeof(back)) != sizeof(back) ||
+            memcmp(back, record, sizeof(back)) != 0) {
+            failed++;
+        }
+    }
+    printf("  %u of %u files read back wrong\n",
+           failed,
+           count < 8U ? count : 8U);
+    return simNow() - start;
+}
+
+static uint64_t run_ring(thread_t **threadFs)
+{
+    uint8_t record[RINGLOG_DATA_SIZE];
+    uint64_t start = simNow();
+    uint64_t worst = 0;
+    uint32_t first, next;
+
+    for (unsigned i = 0; i < count; i++) {
+        uint64_t t = simNow();
+
+        memset(record, (int)i, sizeof(record));
+        if (fsRingAppend(*threadFs, record, sizeof(record)) < 0) {
+            printf("  append %u failed\n", i);
+        }
+        if (simNow() - t > worst) {
+            worst = simNow() - t;
+        }
+        simIdle(idle_ms * 1000U);
+    }
+    printf("  worst append: %.3f ms\n", ms(worst));
+
+    /* The log is found again after a reboot.*/
+    simStop(*threadFs);
+    *threadFs = boot();
+    fsRingInfo(*threadFs, &first, &next);
+    printf("  records %lu..%lu\n", (unsigned long)first, (unsigned long)next);
+    if (next > first &&
+        (fsRingRead(*threadFs, next - 1U, record, sizeof(record)) !=
+             (int)sizeof(record) ||
+         record[0] != (uint8_t)(count - 1U))) {
+        printf("  last record mismatch\n");
+    }
+    return simNow() - start;
+}
+
+/* Six INA3221 channels, shunt then bus, and four TMP117 */
+#define TELEMETRY_CHANNELS 10U
+#define TELEMETRY_DOD_MASK 0x3c0U
+
+static uint32_t telemetry_random = 1U;
+
+static int32_t noise(unsigned range)
+{
+    telemetry_random = telemetry_random * 1103515245U + 12345U;
+    return (int32_t)((telemetry_random >> 16) % (2U * range + 1U)) -
+           (int32_t)range;
+}
+
+/* Raw register values of a fan controller at work, fan steps every 50
+   samples and temperatures drifting. */
+static void telemetry_sample(unsigned i, int32_t sample[])
+{
+    int32_t load = (int32_t)((i / 50U) % 4U) * 200;
+
+    for (unsigned ch = 0; ch < 3U; ch++) {
+        sample[ch] = 300 + load + (int32_t)ch * 50 + noise(3);
+        sample[3U + ch] = 1500 + noise(1);
+    }
+    for (unsigned ch = 0; ch < 4U; ch++) {
+        sample[6U + ch] =
+            3200 + (int32_t)(ch * 256U) + (int32_t)(i / 8U) + noise(2);
+    }
+}
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+/* Samples encoded into ring log records. */
+static uint64_t run_codec(thread_t **threadFs)
+{
+    uint8_t record[RINGLOG_DATA_SIZE];
+    int32_t sample[TELEMETRY_CHANNELS], decoded[TELEMETRY_CHANNELS];
+    unsigned samples = count * 20U;
+    unsigned records = 0, mismatches = 0;
+    uint64_t bytes = 0, encode_ns = 0, decode_ns = 0;
+    uint64_t start = simNow();
+    tsenc_t enc;
+
+    tsEncStart(&enc,
+               record,
+               sizeof(record),
+               TELEMETRY_CHANNELS,
+               TELEMETRY_DOD_MASK);
+    for (unsigned i = 0; i <= samples; i++) {
+        uint64_t t;
+        bool full = i == samples;
+
+        if (!full) {
+            telemetry_sample(i, sample);
+            t = host_ns();
+            full = !tsEncPut(&enc, sample);
+            encode_ns += host_ns() - t;
+        }
+        if (!full) {
+            continue;
+        }
+
+        /* Checking the record before it is stored.*/
+        {
+            unsigned n = 0;
+            tsdec_t dec;
+
+            t = host_ns();
+            tsDecStart(&dec,
+                       record,
+                       tsEncSize(&enc),
+                       TELEMETRY_CHANNELS,
+                       TELEMETRY_DOD_MASK);
+            while (tsDecGet(&dec, decoded)) {
+                n++;
+            }
+            decode_ns += host_ns() - t;
+            if (n != enc.samples ||
+                memcmp(decoded, enc.prev, sizeof(decoded)) != 0) {
+                mismatches++;
+            }
+        }
+
+        if (fsRingAppend(*threadFs, record, tsEncSize(&enc)) < 0) {
+            printf("  append %u failed\n", records);
+        }
+        bytes += tsEncSize(&enc);
+        records++;
+        simIdle(idle_ms * 1000U);
+
+        tsEncStart(&enc,
+                   record,
+                   sizeof(record),
+                   TELEMETRY_CHANNELS,
+                   TELEMETRY_DOD_MASK);
+        if (i < samples) {
+            tsEncPut(&enc, sample);
+        }
+    }
+
+    printf("  samples %u in %u records, %u raw records\n",
+           samples,
+           records,
+           (unsigned)((samples + RINGLOG_DATA_SIZE / sizeof(sample) - 1U) /
+                      (RINGLOG_DATA_SIZE / sizeof(sample))));
+    printf("  ratio %.2f, %.2f bytes per sample\n",
+           (double)samples * sizeof(sample) / (double)bytes,
+           (double)bytes / samples);
+    printf("  host encode %.1f ns, decode %.1f ns per sample\n",
+           (double)encode_ns / samples,
+           (double)decode_ns / samples);
+    if (mismatches > 0U) {
+        printf("  %u records decoded wrong\n", mismatches);
+    }
+    return simNow() - start;
+}
+
+/* One hour of buckets out of the middle of the log */
+static uint64_t tlog_hour(thread_t *threadFs, uint32_t end, const char *what)
+{
+    static tlog_query_t query;
+    static tlog_row_t rows[8];
+    uint32_t from = end / 2U;
+    uint64_t start = simNow();
+    unsigned n = 0;
+    int got;
+
+    tlogQueryInit(&query, from, from + 3599U, 0x3c0U, 60U);
+    while ((got = fsTlogQuery(threadFs, &query, rows, 8)) > 0) {
+        n += (unsigned)got;
+    }
+    if (got < 0) {
+        printf("  query failed\n");
+    }
+    printf("  %s: %u rows in %.3f ms\n", what, n, ms(simNow() - start));
+    return simNow() - start;
+}
+
+/* Samples every 10 s into the time indexed log, then queries. */
+static uint64_t run_tlog(thread_t **threadFs)
+{
+    int32_t sample[TELEMETRY_CHANNELS];
+    unsigned records = count * 10U;
+    uint64_t start = simNow();
+
+    for (unsigned i = 0; i < records; i++) {
+        telemetry_sample(i, sample);
+        if (fsTlogAppend(*threadFs, i * 10U, sample) != 0) {
+            printf("  append %u failed\n", i);
+        }
+        if (i % 10U == 9U) {
+            simIdle(idle_ms * 1000U);
+        }
+    }
+    printf("  %u records in %.3f ms\n", records, ms(simNow() - start));
+
+    tlog_hour(*threadFs, records * 10U, "indexed query");
+
+    /* As if the index was lost, it is rebuilt by the next query.*/
+    fsRename(*threadFs, "tlog.idx", "tlog.old");
+    simStop(*threadFs);
+    *threadFs = boot();
+    tlog_hour(*threadFs, records * 10U, "query with rebuild");
+    tlog_hour(*threadFs, records * 10U, "indexed query");
+    return simNow() - start;
+}
+
+static uint8_t image_byte(uint32_t i)
+{
+    return (uint8_t)((i * 2654435761U) >> 24);
+}
+
+/* A 200 KiB firmware image streamed in USB sized chunks, verified and
+   activated, then found again after a reboot. */
+static uint64_t run_fw(thread_t **threadFs)
+{
+    const uint32_t size = 200U * 1024U;
+    uint8_t chunk[200];
+    uint32_t crc = 0xffffffffU;
+    fwstage_info_t info;
+    uint64_t start = simNow();
+    uint64_t t;
+
+    if (fsFwBegin(*threadFs, size) != 0) {
+        printf("  begin failed\n");
+        return simNow() - start;
+    }
+    printf("  erase: %.3f ms\n", ms(simNow() - start));
+
+    t = simNow();
+    for (uint32_t done = 0; done < size;) {
+        uint32_t n = size - done < sizeof(chunk) ? size - done : sizeof(chunk);
+        for (uint32_t i = 0; i < n; i++) {
+            chunk[i] = image_byte(done + i);
+        }
+        crc = lfs_crc(crc, chunk, n);
+        if (fsFwWrite(*threadFs, chunk, n) != (int)n) {
+            printf("  write failed at %u\n", done);
+            return simNow() - start;
+        }
+        done += n;
+    }
+    printf("  write: %.3f ms, %.0f KiB/s\n",
+           ms(simNow() - t),
+           size / 1024.0 / (ms(simNow() - t) / 1000.0));
+
+    if (fsFwVerify(*threadFs, crc) == 0) {
+        printf("  wrong crc accepted\n");
+    }
+    if (fsFwVerify(*threadFs, ~crc) != 0 || fsFwActivate(*threadFs) != 0) {
+        printf("  verify or activate failed\n");
+    }
+
+    simStop(*threadFs);
+    *threadFs = boot();
+    fsFwInfo(*threadFs, &info);
+    if (info.state != FWSTAGE_ACTIVE || info.size != size ||
+        info.crc != ~crc) {
+        printf("  image lost after reboot\n");
+    }
+    return simNow() - start;
+}
+
+/* The on-target flash benchmark, with the scratch sector free and then
+   taken by an image that fills the firmware partition. */
+static uint64_t run_flash(thread_t **threadFs)
+{
+    fwstage_info_t info;
+    fs_bench_t b;
+    uint64_t start = simNow();
+
+    for (unsigned i = 0; i < 4U; i++) {
+        if (fsBenchFlash(*threadFs, &b) != 0) {
+            printf("  bench failed\n");
+            return simNow() - start;
+        }
+    }
+    printf("  %u bytes: erase %u us, program %u us, read %u us\n",
+           b.bytes,
+           b.erase_us,
+           b.prog_us,
+           b.read_us);
+
+    fsFwInfo(*threadFs, &info);
+    if (fsFwBegin(*threadFs, info.capacity) != 0) {
+        printf("  begin failed\n");
+    } else if (fsBenchFlash(*threadFs, &b) == 0) {
+        printf("  bench overwrote the staged image\n");
+    }
+    return simNow() - start;
+}
+
+static const workload_t workloads[] = {
+    {"mount", "five boots, time until the first request is served",
+     run_mount},
+    {"config", "key/value updates of 8 settings", run_config},
+    {"files", "settings as files written via tmp file and rename",
+     run_files},
+    {"log", "1 KiB records rotating over 64 files", run_log},
+    {"preerase", "4 KiB files written while blocks are erased ahead",
+     run_preerase},
+    {"ring", "244 byte records appended to the raw ring log", run_ring},
+    {"codec", "sensor samples delta encoded into ring log records",
+     run_codec},
+    {"tlog", "time indexed telemetry log, hour queries by the minute",
+     run_tlog},
+    {"fw", "firmware image staged, verified and activated", run_fw},
+    {"flash", "erase, program and read back of a scratch sector",
+     run_flash},
+};
+
+static void report_wear(void)
+{
+    const uint32_t *counts = w25qModelEraseCounts();
+    uint32_t sectors = snor_descriptor.sectors_size / W25Q_MODEL_SECTOR_SIZE;
+    uint32_t min = UINT32_MAX, max = 0, used = 0;
+    uint64_t total = 0;
+
+    /* Wear per filesystem block, the most erased sector within it.*/
+    for (uint32_t b = 0; b < snor_descriptor.sectors_count; b++) {
+        uint32_t n = 0;
+        for (uint32_t s = 0; s < sectors; s++) {
+            if (counts[b * sectors + s] > n) {
+                n = counts[b * sectors + s];
+            }
+        }
+        min = n < min ? n : min;
+        max = n > max ? n : max;
+        used += n > 0U ? 1U : 0U;
+        total += n;
+    }
+    printf("  erases per block:  min %u, max %u, mean %.2f, %u of %u "
+           "blocks erased\n",
+           min,
+           max,
+           (double)total / snor_descriptor.sectors_count,
+           used,
+           snor_descriptor.sectors_count);
+}
+
+static void report(const char *name, uint64_t elapsed)
+{
+    static const char *ops[W25Q_OP_COUNT] = {"page", "4k", "64k", "chip"};
+    const w25q_model_stats_t *st = w25qModelStats();
+    w25q_power_t power;
+    pcache_stats_t cache;
+
+    w25qGetPower(&power);
+    fsGetCacheStats(&cache);
+
+    printf("%s\n", name);
+    printf("  simulated time:    %.3f ms\n", ms(elapsed));
+    printf("  flash busy:        %.3f ms\n", ms(st->busy_ns));
+    printf("  bytes programmed:  %llu in %llu page programs\n",
+           (unsigned long long)st->bytes_programmed,
+           (unsigned long long)st->page_programs);
+    printf("  bytes read:        %llu\n", (unsigned long long)st->bytes_read);
+    printf("  erases:            %llu sector, %llu block, %llu chip, "
+           "%llu suspends\n",
+           (unsigned long long)st->sector_erases,
+           (unsigned long long)st->block_erases,
+           (unsigned long long)st->chip_erases,
+           (unsigned long long)st->suspends);
+    printf("  status reads:      %llu\n",
+           (unsigned long long)st->status_reads);
+    printf("  deep power-down:   %u times, %.1f%% of the time, wake-up %u us\n",
+           power.powerdowns,
+           power.total_us > 0U ? 100.0 * (double)power.powerdown_us /
+                                     (double)power.total_us
+                               : 0.0,
+           power.wakeup_us);
+    printf("  page cache:        %u hits, %u misses, %u read ahead, "
+           "%u bypass, %u invalidated\n",
+           cache.hits,
+           cache.misses,
+           cache.readahead,
+           cache.bypass,
+           cache.invalidations);
+    report_wear();
+    for (unsigned i = 0; i < W25Q_OP_COUNT; i++) {
+        w25q_timing_t t;
+        w25qGetTiming((w25q_op_t)i, &t);
+        if (t.count > 0U) {
+            printf("  %-5s count %u, model %u us, avg %u us, polls %u, "
+                   "overruns %u\n",
+                   ops[i],
+                   t.count,
+                   t.expected_us,
+                   (uint32_t)(t.total_us / t.count),
+                   t.polls,
+                   t.overruns);
+        }
+    }
+    if (st->violations > 0U) {
+        printf("  protocol violations: %llu\n",
+               (unsigned long long)st->violations);
+    }
+    if (st->unerased_programs > 0U) {
+        printf("  programs over data: %llu\n",
+               (unsigned long long)st->unerased_programs);
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [-c capacity] [-j jitter] [-i image] [-n count] "
+            "[-t idle_ms] [workload...]\n",
+            argv0);
+    fprintf(stderr, "workloads:\n");
+    for (unsigned i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        fprintf(stderr, "  %-8s %s\n", workloads[i].name, workloads[i].help);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    w25q_model_config_t config = {
+        .capacity = 24,
+        .jitter = 10,
+        .image = NULL,
+    };
+    thread_t *threadFs;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:j:i:n:t:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            config.capacity = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            config.jitter = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            config.image = optarg;
+            break;
+        case 'n':
+            count = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            idle_ms = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.capacity < 16 || config.capacity > 26) {
+        fprintf(stderr, "capacity must be 16..26\n");
+        return 1;
+    }
+
+    simInit();
+    w25qModelInit(&config);
+
+    /* Formats a blank device.*/
+    {
+        uint64_t start = simNow();
+        threadFs = boot();
+        report("boot", simNow() - start);
+    }
+
+    for (unsigned i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        bool selected = optind >= argc;
+        uint64_t elapsed;
+
+        for (int a = optind; a < argc; a++) {
+            selected |= strcmp(argv[a], workloads[i].name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+
+        w25qModelResetStats();
+        w25qResetTiming();
+        w25qResetPower();
+        fsResetCacheStats();
+        elapsed = workloads[i].run(&threadFs);
+        report(workloads[i].name, elapsed);
+    }
+
+    return w25qModelSave() == 0 ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+/* Host replacement for the parts of the ChibiOS RT API used by the flash
+   and filesystem code. Threads run one at a time on simulated time, see
+   sim.c. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(FALSE)
+#define FALSE 0
+#endif
+#if !defined(TRUE)
+#define TRUE 1
+#endif
+
+/* Messages carry pointers, as on the target */
+typedef intptr_t msg_t;
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+typedef uint32_t rtcnt_t;
+typedef uint64_t systimestamp_t;
+typedef uint32_t tprio_t;
+
+typedef struct ch_thread thread_t;
+typedef void (*tfunc_t)(void *p);
+
+typedef struct {
+    thread_t *owner;
+} mutex_t;
+
+/* Nothing listens on the host, broadcasts only count */
+typedef uint32_t eventflags_t;
+typedef struct {
+    unsigned broadcasts;
+    eventflags_t flags;
+} event_source_t;
+
+#define CH_CFG_ST_FREQUENCY 10000
+#define STM32_HCLK 72000000U
+
+#define NORMALPRIO 128U
+#define TIME_INFINITE ((sysinterval_t)-1)
+#define TIME_IMMEDIATE ((sysinterval_t)0)
+
+#define TIME_MS2I(ms)                                                          \
+    ((sysinterval_t)(((uint64_t)(ms) * CH_CFG_ST_FREQUENCY + 999U) / 1000U))
+#define TIME_US2I(us)                                                          \
+    ((sysinterval_t)(((uint64_t)(us) * CH_CFG_ST_FREQUENCY + 999999U) /        \
+                     1000000U))
+#define TIME_I2MS(i)                                                           \
+    ((uint32_t)(((uint64_t)(i) * 1000U + CH_CFG_ST_FREQUENCY - 1U) /           \
+                CH_CFG_ST_FREQUENCY))
+#define TIME_I2US(i)                                                           \
+    ((uint32_t)(((uint64_t)(i) * 1000000U + CH_CFG_ST_FREQUENCY - 1U) /        \
+                CH_CFG_ST_FREQUENCY))
+#define RTC2US(freq, n) ((uint32_t)((n) / ((freq) / 1000000U)))
+#define US2RTC(freq, n) ((rtcnt_t)((n) * ((freq) / 1000000U)))
+
+#define THD_WORKING_AREA(s, n) uint8_t s[n]
+#define THD_FUNCTION(tname, arg) void tname(void *arg)
+#define MUTEX_DECL(name) mutex_t name = {NULL}
+#define EVENTSOURCE_DECL(name) event_source_t name = {0, 0}
+
+thread_t *chThdCreateStatic(
+    void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+void chRegSetThreadName(const char *name);
+thread_t *chThdGetSelfX(void);
+void chThdSleep(sysinterval_t time);
+void chThdSleepMilliseconds(uint32_t msec);
+
+systime_t chVTGetSystemTimeX(void);
+sysinterval_t chTimeDiffX(systime_t start, systime_t end);
+systime_t chTimeAddX(systime_t systime, sysinterval_t interval);
+rtcnt_t chSysGetRealtimeCounterX(void);
+void chSysPolledDelayX(rtcnt_t cycles);
+systimestamp_t chVTGetTimeStampI(void);
+void chSysLock(void);
+void chSysUnlock(void);
+
+msg_t chMsgSend(thread_t *tp, msg_t msg);
+thread_t *chMsgWait(void);
+thread_t *chMsgWaitTimeout(sysinterval_t timeout);
+thread_t *chMsgPoll(void);
+bool chMsgIsPendingI(thread_t *tp);
+msg_t chMsgGet(thread_t *tp);
+void chMsgRelease(thread_t *tp, msg_t msg);
+
+void chMtxObjectInit(mutex_t *mp);
+void chMtxLock(mutex_t *mp);
+void chMtxUnlock(mutex_t *mp);
+
+void chEvtBroadcastFlags(event_source_t *esp, eventflags_t flags);
+
+void *chCoreAlloc(size_t size);
+void *chCoreAllocAligned(size_t size, unsigned align);
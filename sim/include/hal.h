@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+/* Host replacement for the SPI and flash parts of the ChibiOS HAL, the
+   SPI bus is wired to the W25Q model. */
+
+#pragma once
+
+#include "osal.h"
+
+#define SNOR_BUS_DRIVER_SPI 0U
+#define SNOR_BUS_DRIVER_WSPI 1U
+#define SNOR_BUS_DRIVER SNOR_BUS_DRIVER_SPI
+#define SNOR_SHARED_BUS FALSE
+
+typedef struct {
+    uint32_t hz;
+} SPIConfig;
+
+typedef struct {
+    const SPIConfig *config;
+} SPIDriver;
+
+extern SPIDriver SPID2;
+
+void spiStart(SPIDriver *spip, const SPIConfig *config);
+void spiSelect(SPIDriver *spip);
+void spiUnselect(SPIDriver *spip);
+void spiSend(SPIDriver *spip, size_t n, const void *txbuf);
+void spiReceive(SPIDriver *spip, size_t n, void *rxbuf);
+void spiIgnore(SPIDriver *spip, size_t n);
+
+typedef enum {
+    FLASH_NO_ERROR = 0,
+    FLASH_BUSY_ERASING = 1,
+    FLASH_ERROR_READ = 2,
+    FLASH_ERROR_PROGRAM = 3,
+    FLASH_ERROR_ERASE = 4,
+    FLASH_ERROR_VERIFY = 5,
+    FLASH_ERROR_HW_FAILURE = 6,
+    FLASH_ERROR_UNIMPLEMENTED = 7
+} flash_error_t;
+
+typedef enum {
+    FLASH_UNINIT = 0,
+    FLASH_STOP = 1,
+    FLASH_READY = 2,
+    FLASH_READ = 3,
+    FLASH_PGM = 4,
+    FLASH_ERASE = 5
+} flash_state_t;
+
+typedef uint32_t flash_offset_t;
+typedef uint32_t flash_sector_t;
+
+typedef struct {
+    flash_offset_t offset;
+    uint32_t size;
+} flash_sector_descriptor_t;
+
+typedef struct {
+    uint32_t attributes;
+    uint32_t page_size;
+    flash_sector_t sectors_count;
+    const flash_sector_descriptor_t *sectors;
+    uint32_t sectors_size;
+    uint8_t *address;
+    uint32_t size;
+} flash_descriptor_t;
+
+#define FLASH_ATTR_ERASED_IS_ONE 0x00000001U
+#define FLASH_ATTR_MEMORY_MAPPED 0x00000002U
+#define FLASH_ATTR_REWRITABLE 0x00000004U
+#define FLASH_ATTR_ECC_CAPABLE 0x00000008U
+#define FLASH_ATTR_ECC_ZERO_LINE_CAPABLE 0x00000010U
+#define FLASH_ATTR_SUSPEND_ERASE_CAPABLE 0x00000020U
@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+/* Host replacement for the ChibiOS serial NOR class, the flash methods
+   are plain functions instead of a VMT, see snor.c. */
+
+#pragma once
+
+#include "hal.h"
+
+typedef SPIDriver BUSDriver;
+typedef SPIConfig BUSConfig;
+
+typedef struct {
+    BUSDriver *busp;
+    const BUSConfig *buscfg;
+} SNORConfig;
+
+typedef struct {
+    flash_state_t state;
+    const SNORConfig *config;
+    uint8_t device_id[20];
+} SNORDriver;
+
+#include "hal_flash_device.h"
+
+void snorObjectInit(SNORDriver *devp);
+void snorStart(SNORDriver *devp, const SNORConfig *config);
+
+const flash_descriptor_t *flashGetDescriptor(void *instance);
+flash_error_t
+flashRead(void *instance, flash_offset_t offset, size_t n, uint8_t *rp);
+flash_error_t flashProgram(void *instance,
+                           flash_offset_t offset,
+                           size_t n,
+                           const uint8_t *pp);
+flash_error_t flashStartEraseAll(void *instance);
+flash_error_t flashStartEraseSector(void *instance, flash_sector_t sector);
+flash_error_t flashQueryErase(void *instance, uint32_t *msec);
+flash_error_t flashVerifyErase(void *instance, flash_sector_t sector);
+
+void bus_acquire(BUSDriver *busp, const BUSConfig *config);
+void bus_release(BUSDriver *busp);
+void bus_cmd(BUSDriver *busp, uint32_t cmd);
+void bus_cmd_send(BUSDriver *busp, uint32_t cmd, size_t n, const uint8_t *p);
+void bus_cmd_receive(BUSDriver *busp, uint32_t cmd, size_t n, uint8_t *p);
+void bus_cmd_addr(BUSDriver *busp, uint32_t cmd, flash_offset_t offset);
+void bus_cmd_addr_send(BUSDriver *busp,
+                       uint32_t cmd,
+                       flash_offset_t offset,
+                       size_t n,
+                       const uint8_t *p);
+void bus_cmd_addr_receive(BUSDriver *busp,
+                          uint32_t cmd,
+                          flash_offset_t offset,
+                          size_t n,
+                          uint8_t *p);
+void bus_cmd_dummy_receive(BUSDriver *busp,
+                           uint32_t cmd,
+                           uint32_t dummy,
+                           size_t n,
+                           uint8_t *p);
+void bus_cmd_addr_dummy_receive(BUSDriver *busp,
+                                uint32_t cmd,
+                                flash_offset_t offset,
+                                uint32_t dummy,
+                                size_t n,
+                                uint8_t *p);
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include "ch.h"
+
+#include <assert.h>
+
+#define OSAL_ST_FREQUENCY CH_CFG_ST_FREQUENCY
+#define OSAL_I2US(i) TIME_I2US(i)
+#define OSAL_MS2I(ms) TIME_MS2I(ms)
+
+#define osalDbgAssert(c, remark) assert((c) && (remark))
+#define osalDbgCheck(c) assert(c)
+#define osalSysLock() chSysLock()
+#define osalSysUnlock() chSysUnlock()
+#define osalSysPolledDelayX(cycles) chSysPolledDelayX(cycles)
+#define OSAL_US2RTC(freq, usec) US2RTC(freq, usec)
+#define osalThreadSleep(time) chThdSleep(time)
+#define osalThreadSleepMilliseconds(msec) chThdSleepMilliseconds(msec)
+#define osalOsGetSystemTimeX() chVTGetSystemTimeX()
+#define osalTimeDiffX(start, end) chTimeDiffX(start, end)
+#define osalTimeAddX(systime, interval) chTimeAddX(systime, interval)
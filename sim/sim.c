@@ -0,0 +1,310 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "hal.h"
+
+#include "sim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Threads run one at a time, like on a single core: the running thread
+   holds sim_lock and gives it up only while it is blocked. Time does not
+   pass while a thread runs, except for sleeps and bus transfers, so the
+   results do not depend on the host. */
+
+#define SIM_THREADS_MAX 16
+#define SIM_QUEUE_MAX 8
+#define NS_PER_TICK (1000000000U / CH_CFG_ST_FREQUENCY)
+
+typedef enum {
+    SIM_RUNNING,
+    SIM_SENDING,
+    SIM_WAITING,
+    SIM_TIMED,
+    SIM_IDLE,
+    SIM_STOPPED,
+} sim_state_t;
+
+struct ch_thread {
+    pthread_t pthread;
+    pthread_cond_t cond;
+    const char *name;
+    sim_state_t state;
+    tfunc_t pf;
+    void *arg;
+    thread_t *queue[SIM_QUEUE_MAX];
+    unsigned queued;
+    msg_t sentmsg;
+    msg_t reply;
+    bool replied;
+    bool stopped;
+};
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_t sim_threads[SIM_THREADS_MAX];
+static unsigned sim_thread_count;
+static __thread thread_t *sim_self;
+static uint64_t sim_now;
+static uint64_t sim_idle_until;
+
+SPIDriver SPID2;
+
+static void sim_wake_all(void)
+{
+    for (unsigned i = 0; i < sim_thread_count; i++) {
+        pthread_cond_signal(&sim_threads[i].cond);
+    }
+}
+
+static void sim_block(sim_state_t state)
+{
+    sim_state_t prev = sim_self->state;
+    sim_self->state = state;
+    sim_wake_all();
+    pthread_cond_wait(&sim_self->cond, &sim_lock);
+    if (sim_self->stopped) {
+        pthread_mutex_unlock(&sim_lock);
+        pthread_exit(NULL);
+    }
+    sim_self->state = prev;
+}
+
+/* True while no thread other than the caller can run. */
+static bool sim_others_blocked(void)
+{
+    for (unsigned i = 0; i < sim_thread_count; i++) {
+        thread_t *tp = &sim_threads[i];
+        if (tp != sim_self && tp->state == SIM_RUNNING) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* True while the main thread waits for a reply, no request can come. */
+static bool sim_main_sending(void)
+{
+    return sim_threads[0].state == SIM_SENDING;
+}
+
+static void sim_set_now(uint64_t ns)
+{
+    if (ns > sim_now) {
+        sim_now = ns;
+    }
+    if (sim_threads[0].state == SIM_IDLE && sim_now >= sim_idle_until) {
+        pthread_cond_signal(&sim_threads[0].cond);
+    }
+}
+
+static uint64_t sim_deadline(sysinterval_t time)
+{
+    /* Timeouts expire on tick boundaries.*/
+    return (sim_now / NS_PER_TICK + time) * NS_PER_TICK;
+}
+
+static void *sim_thread_start(void *p)
+{
+    thread_t *tp = (thread_t *)p;
+
+    pthread_mutex_lock(&sim_lock);
+    sim_self = tp;
+    tp->pf(tp->arg);
+    fprintf(stderr, "thread %s returned\n", tp->name);
+    abort();
+}
+
+void simInit(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    sim_self = &sim_threads[sim_thread_count++];
+    pthread_cond_init(&sim_self->cond, NULL);
+    sim_self->name = "main";
+    sim_self->state = SIM_RUNNING;
+}
+
+uint64_t simNow(void) { return sim_now; }
+
+void simAdvance(uint64_t ns) { sim_set_now(sim_now + ns); }
+
+void simIdle(uint32_t us)
+{
+    sim_idle_until = sim_now + (uint64_t)us * 1000U;
+    while (sim_now < sim_idle_until) {
+        bool idle = true;
+        for (unsigned i = 1; i < sim_thread_count; i++) {
+            if (sim_threads[i].state != SIM_WAITING &&
+                sim_threads[i].state != SIM_STOPPED) {
+                idle = false;
+            }
+        }
+        if (idle) {
+            /* Nothing to do until the next request.*/
+            sim_now = sim_idle_until;
+            break;
+        }
+        sim_block(SIM_IDLE);
+    }
+}
+
+void simStop(thread_t *tp)
+{
+    tp->stopped = true;
+    tp->state = SIM_STOPPED;
+    pthread_cond_signal(&tp->cond);
+}
+
+thread_t *chThdCreateStatic(
+    void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg)
+{
+    thread_t *tp;
+
+    (void)wsp;
+    (void)size;
+    (void)prio;
+
+    if (sim_thread_count >= SIM_THREADS_MAX) {
+        fprintf(stderr, "too many threads\n");
+        abort();
+    }
+    tp = &sim_threads[sim_thread_count++];
+    pthread_cond_init(&tp->cond, NULL);
+    tp->name = "";
+    tp->state = SIM_RUNNING;
+    tp->pf = pf;
+    tp->arg = arg;
+    pthread_create(&tp->pthread, NULL, sim_thread_start, tp);
+    return tp;
+}
+
+void chRegSetThreadName(const char *name) { sim_self->name = name; }
+
+thread_t *chThdGetSelfX(void) { return sim_self; }
+
+void chThdSleep(sysinterval_t time) { sim_set_now(sim_deadline(time)); }
+
+void chThdSleepMilliseconds(uint32_t msec) { chThdSleep(TIME_MS2I(msec)); }
+
+systime_t chVTGetSystemTimeX(void) { return (systime_t)(sim_now / NS_PER_TICK); }
+
+sysinterval_t chTimeDiffX(systime_t start, systime_t end)
+{
+    return (sysinterval_t)(end - start);
+}
+
+systime_t chTimeAddX(systime_t systime, sysinterval_t interval)
+{
+    return systime + interval;
+}
+
+rtcnt_t chSysGetRealtimeCounterX(void)
+{
+    return (rtcnt_t)(sim_now * (STM32_HCLK / 1000000U) / 1000U);
+}
+
+/* Busy waits take their time, unlike the code around them. */
+void chSysPolledDelayX(rtcnt_t cycles)
+{
+    sim_set_now(sim_now + (uint64_t)cycles * 1000U / (STM32_HCLK / 1000000U));
+}
+
+systimestamp_t chVTGetTimeStampI(void) { return sim_now / NS_PER_TICK; }
+
+void chSysLock(void) {}
+
+void chSysUnlock(void) {}
+
+msg_t chMsgSend(thread_t *tp, msg_t msg)
+{
+    if (tp->queued >= SIM_QUEUE_MAX) {
+        fprintf(stderr, "message queue of %s full\n", tp->name);
+        abort();
+    }
+    sim_self->sentmsg = msg;
+    sim_self->replied = false;
+    tp->queue[tp->queued++] = sim_self;
+    while (!sim_self->replied) {
+        sim_block(SIM_SENDING);
+    }
+    return sim_self->reply;
+}
+
+bool chMsgIsPendingI(thread_t *tp) { return tp->queued != 0U; }
+
+thread_t *chMsgPoll(void)
+{
+    thread_t *tp;
+
+    if (sim_self->queued == 0U) {
+        return NULL;
+    }
+    tp = sim_self->queue[0];
+    sim_self->queued--;
+    for (unsigned i = 0; i < sim_self->queued; i++) {
+        sim_self->queue[i] = sim_self->queue[i + 1U];
+    }
+    return tp;
+}
+
+thread_t *chMsgWait(void)
+{
+    while (sim_self->queued == 0U) {
+        sim_block(SIM_WAITING);
+    }
+    return chMsgPoll();
+}
+
+thread_t *chMsgWaitTimeout(sysinterval_t timeout)
+{
+    uint64_t deadline = sim_deadline(timeout);
+
+    while (sim_self->queued == 0U) {
+        if (sim_now >= deadline) {
+            return NULL;
+        }
+        if (sim_main_sending() && sim_others_blocked()) {
+            /* The only client waits for this thread.*/
+            sim_set_now(deadline);
+        } else if (sim_threads[0].state == SIM_IDLE &&
+                   sim_now < sim_idle_until) {
+            /* Using the idle time of the main thread.*/
+            sim_set_now(deadline < sim_idle_until ? deadline : sim_idle_until);
+        } else {
+            sim_block(SIM_TIMED);
+        }
+    }
+    return chMsgPoll();
+}
+
+msg_t chMsgGet(thread_t *tp) { return tp->sentmsg; }
+
+void chMsgRelease(thread_t *tp, msg_t msg)
+{
+    tp->reply = msg;
+    tp->replied = true;
+    /* Runnable at once, the caller must not take its time as idle.*/
+    tp->state = SIM_RUNNING;
+    pthread_cond_signal(&tp->cond);
+}
+
+void chMtxObjectInit(mutex_t *mp) { mp->owner = NULL; }
+
+void chMtxLock(mutex_t *mp) { mp->owner = sim_self; }
+
+void chMtxUnlock(mutex_t *mp) { mp->owner = NULL; }
+
+void chEvtBroadcastFlags(event_source_t *esp, eventflags_t flags)
+{
+    esp->broadcasts++;
+    esp->flags |= flags;
+}
+
+void *chCoreAlloc(size_t size) { return malloc(size); }
+
+void *chCoreAllocAligned(size_t size, unsigned align)
+{
+    return aligned_alloc(align, (size + align - 1U) / align * align);
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include "ch.h"
+
+/* SPI clock of the flash bus, PCLK1/2 on the board */
+#if !defined(SIM_SPI_HZ)
+#define SIM_SPI_HZ 18000000U
+#endif
+
+/* Makes the calling thread the main thread, call first */
+void simInit(void);
+
+/* Simulated time since simInit() in nanoseconds */
+uint64_t simNow(void);
+
+/* Lets the simulated time pass without requests from the main thread,
+   other threads run their idle work meanwhile */
+void simIdle(uint32_t us);
+
+/* Stops a thread blocked in a message wait, like a reset would */
+void simStop(thread_t *tp);
+
+/* Advances the simulated time, used for bus transfers */
+void simAdvance(uint64_t ns);
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "hal.h"
+#include "hal_serial_nor.h"
+
+/* Serial NOR class and SPI bus helpers, following the ChibiOS
+   implementation closely enough to run hal_flash_device.c unchanged. */
+
+static void bus_cmd_addr_start(BUSDriver *busp,
+                               uint32_t cmd,
+                               flash_offset_t offset)
+{
+    uint8_t buf[4];
+
+    buf[0] = (uint8_t)cmd;
+    buf[1] = (uint8_t)(offset >> 16);
+    buf[2] = (uint8_t)(offset >> 8);
+    buf[3] = (uint8_t)(offset >> 0);
+    spiSelect(busp);
+    spiSend(busp, sizeof buf, buf);
+}
+
+void bus_acquire(BUSDriver *busp, const BUSConfig *config)
+{
+    (void)busp;
+    (void)config;
+}
+
+void bus_release(BUSDriver *busp) { (void)busp; }
+
+void bus_cmd(BUSDriver *busp, uint32_t cmd)
+{
+    uint8_t buf = (uint8_t)cmd;
+
+    spiSelect(busp);
+    spiSend(busp, 1, &buf);
+    spiUnselect(busp);
+}
+
+void bus_cmd_send(BUSDriver *busp, uint32_t cmd, size_t n, const uint8_t *p)
+{
+    uint8_t buf = (uint8_t)cmd;
+
+    spiSelect(busp);
+    spiSend(busp, 1, &buf);
+    spiSend(busp, n, p);
+    spiUnselect(busp);
+}
+
+void bus_cmd_receive(BUSDriver *busp, uint32_t cmd, size_t n, uint8_t *p)
+{
+    uint8_t buf = (uint8_t)cmd;
+
+    spiSelect(busp);
+    spiSend(busp, 1, &buf);
+    spiReceive(busp, n, p);
+    spiUnselect(busp);
+}
+
+void bus_cmd_addr(BUSDriver *busp, uint32_t cmd, flash_offset_t offset)
+{
+    bus_cmd_addr_start(busp, cmd, offset);
+    spiUnselect(busp);
+}
+
+void bus_cmd_addr_send(BUSDriver *busp,
+                       uint32_t cmd,
+                       flash_offset_t offset,
+                       size_t n,
+                       const uint8_t *p)
+{
+    bus_cmd_addr_start(busp, cmd, offset);
+    spiSend(busp, n, p);
+    spiUnselect(busp);
+}
+
+void bus_cmd_addr_receive(BUSDriver *busp,
+                          uint32_t cmd,
+                          flash_offset_t offset,
+                          size_t n,
+                          uint8_t *p)
+{
+    bus_cmd_addr_start(busp, cmd, offset);
+    spiReceive(busp, n, p);
+    spiUnselect(busp);
+}
+
+void bus_cmd_dummy_receive(BUSDriver *busp,
+                           uint32_t cmd,
+                           uint32_t dummy,
+                           size_t n,
+                           uint8_t *p)
+{
+    uint8_t buf = (uint8_t)cmd;
+
+    spiSelect(busp);
+    spiSend(busp, 1, &buf);
+    spiIgnore(busp, dummy / 8U);
+    spiReceive(busp, n, p);
+    spiUnselect(busp);
+}
+
+void bus_cmd_addr_dummy_receive(BUSDriver *busp,
+                                uint32_t cmd,
+                                flash_offset_t offset,
+                                uint32_t dummy,
+                                size_t n,
+                                uint8_t *p)
+{
+    bus_cmd_addr_start(busp, cmd, offset);
+    spiIgnore(busp, dummy / 8U);
+    spiReceive(busp, n, p);
+    spiUnselect(busp);
+}
+
+void snorObjectInit(SNORDriver *devp)
+{
+    devp->state = FLASH_STOP;
+    devp->config = NULL;
+}
+
+void snorStart(SNORDriver *devp, const SNORConfig *config)
+{
+    osalDbgCheck((devp != NULL) && (config != NULL));
+
+    devp->config = config;
+    if (devp->state == FLASH_STOP) {
+        spiStart(config->busp, config->buscfg);
+        snor_device_init(devp);
+        devp->state = FLASH_READY;
+    }
+}
+
+const flash_descriptor_t *flashGetDescriptor(void *instance)
+{
+    SNORDriver *devp = (SNORDriver *)instance;
+
+    osalDbgAssert(devp->state != FLASH_STOP, "invalid state");
+    return &snor_descriptor;
+}
+
+flash_error_t
+flashRead(void *instance, flash_offset_t offset, size_t n, uint8_t *rp)
+{
+    SNORDriver *devp = (SNORDriver *)instance;
+    flash_error_t err;
+
+    osalDbgCheck((rp != NULL) && (n > 0U));
+    osalDbgCheck((size_t)offset + n <= (size_t)snor_descriptor.size);
+
+    if (devp->state == FLASH_ERASE) {
+        return FLASH_BUSY_ERASING;
+    }
+
+    devp->state = FLASH_READ;
+    err = snor_device_read(devp, offset, n, rp);
+    devp->state = FLASH_READY;
+    return err;
+}
+
+flash_error_t flashProgram(void *instance,
+                           flash_offset_t offset,
+                           size_t n,
+                           const uint8_t *pp)
+{
+    SNORDriver *devp = (SNORDriver *)instance;
+    flash_error_t err;
+
+    osalDbgCheck((pp != NULL) && (n > 0U));
+    osalDbgCheck((size_t)offset + n <= (size_t)snor_descriptor.size);
+
+    if (devp->state == FLASH_ERASE) {
+        return FLASH_BUSY_ERASING;
+    }
+
+    devp->state = FLASH_PGM;
+    err = snor_device_program(devp, offset, n, pp);
+    devp->state = FLASH_READY;
+    return err;
+}
+
+flash_error_t flashStartEraseAll(void *instance)
+{
+    SNORDriver *devp = (SNORDriver *)instance;
+
+    if (devp->state == FLASH_ERASE) {
+        return FLASH_BUSY_ERASING;
+    }
+
+    devp->state = FLASH_ERASE;
+    return snor_device_start_erase_all(devp);
+}
+
+flash_error_t flashStartEraseSector(void *instance, flash_sector_t sector)
+{
+    SNORDriver *devp = (SNORDriver *)instance;
+
+    osalDbgCheck(sector < snor_descriptor.sectors_count);
+
+    if (devp->state == FLASH_ERASE) {
+        return FLASH_BUSY_ERASING;
+    }
+
+    devp->state = FLASH_ERASE;
+    return snor_device_start_erase_sector(devp, sector);
+}
+
+flash_error_t flashQueryErase(void *instance, uint32_t *msec)
+{
+    SNORDriver *devp = (SNORDriver *)instance;
+    flash_error_t err = FLASH_NO_ERROR;
+
+    if (devp->state == FLASH_ERASE) {
+        err = snor_device_query_erase(devp, msec);
+        if (err == FLASH_NO_ERROR) {
+            devp->state = FLASH_READY;
+        }
+    }
+    return err;
+}
+
+flash_error_t flashVerifyErase(void *instance, flash_sector_t sector)
+{
+    SNORDriver *devp = (SNORDriver *)instance;
+    flash_error_t err;
+
+    osalDbgCheck(sector < snor_descriptor.sectors_count);
+
+    if (devp->state == FLASH_ERASE) {
+        return FLASH_BUSY_ERASING;
+    }
+
+    devp->state = FLASH_READ;
+    err = snor_device_verify_erase(devp, sector);
+    devp->state = FLASH_READY;
+    return err;
+}
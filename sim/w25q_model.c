@@ -0,0 +1,534 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "hal.h"
+
+#include "sim.h"
+#include "w25q_model.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Behaviour of a W25Q..JV in single SPI mode, as far as the driver uses
+   it. Commands are decoded byte by byte while the device is selected,
+   program and erase start when it is unselected. Erased bits are ones
+   and programming can only clear bits. */
+
+#define MANUFACTURER_ID 0xefU
+#define MEMORY_TYPE_ID 0x70U
+
+#define PAGE_SIZE 256U
+
+#define CMD_WRITE_ENABLE 0x06U
+#define CMD_WRITE_DISABLE 0x04U
+#define CMD_READ_DATA 0x03U
+#define CMD_FAST_READ 0x0bU
+#define CMD_PAGE_PROGRAM 0x02U
+#define CMD_SECTOR_ERASE 0x20U
+#define CMD_BLOCK_ERASE_32K 0x52U
+#define CMD_BLOCK_ERASE_64K 0xd8U
+#define CMD_CHIP_ERASE 0xc7U
+#define CMD_CHIP_ERASE_ALT 0x60U
+#define CMD_READ_STATUS1 0x05U
+#define CMD_READ_STATUS2 0x35U
+#define CMD_READ_STATUS3 0x15U
+#define CMD_READ_SFDP 0x5aU
+#define CMD_READ_ID 0x9fU
+#define CMD_SUSPEND 0x75U
+#define CMD_RESUME 0x7aU
+#define CMD_POWERDOWN 0xb9U
+#define CMD_RELEASE_POWERDOWN 0xabU
+#define CMD_ENABLE_RESET 0x66U
+#define CMD_RESET_DEVICE 0x99U
+
+#define SR1_BUSY 0x01U
+#define SR1_WEL 0x02U
+#define SR2_SUS 0x80U
+
+/* Datasheet typical timings (ns) */
+#define T_PAGE_PROGRAM 400000U
+#define T_BYTE_PROGRAM 30000U
+#define T_SECTOR_ERASE 45000000U
+#define T_BLOCK_ERASE_32K 120000000U
+#define T_BLOCK_ERASE_64K 150000000U
+#define T_CHIP_ERASE_PER_MB 2500000000ULL
+#define T_SUSPEND 20000U
+#define T_RES1 3000U
+
+typedef enum {
+    OP_NONE,
+    OP_PROGRAM,
+    OP_ERASE,
+} model_op_t;
+
+static w25q_model_config_t model_config;
+static uint8_t *model_mem;
+static uint32_t model_size;
+static uint32_t *model_erase_counts;
+static w25q_model_stats_t model_stats;
+static uint32_t model_random = 1U;
+
+/* Current command frame.*/
+static bool model_selected;
+static uint8_t model_cmd;
+static unsigned model_pos;
+static uint32_t model_addr;
+static bool model_ignored;
+static uint8_t model_page[PAGE_SIZE];
+static bool model_page_written[PAGE_SIZE];
+static unsigned model_page_count;
+static bool model_reset_enabled;
+
+/* Array state.*/
+static bool model_wel;
+static model_op_t model_op;
+static uint64_t model_busy_start;
+static uint64_t model_busy_until;
+static uint32_t model_erase_addr;
+static uint32_t model_erase_size;
+static bool model_suspended;
+static uint64_t model_suspend_until;
+static uint64_t model_remaining;
+static bool model_powerdown;
+static uint64_t model_ready_at;
+
+static uint64_t model_duration(uint64_t typical)
+{
+    int64_t jitter;
+
+    if (model_config.jitter == 0U) {
+        return typical;
+    }
+    model_random = model_random * 1103515245U + 12345U;
+    jitter = (int64_t)((model_random >> 16) % (2U * model_config.jitter + 1U)) -
+             (int64_t)model_config.jitter;
+    return (uint64_t)((int64_t)typical + (int64_t)typical * jitter / 100);
+}
+
+/* Finishes the running operation once its time has passed. */
+static void model_update(void)
+{
+    uint64_t now = simNow();
+
+    if (model_op != OP_NONE && !model_suspended && now >= model_busy_until) {
+        model_stats.busy_ns += model_busy_until - model_busy_start;
+        model_op = OP_NONE;
+        model_wel = false;
+    }
+}
+
+static bool model_busy(void)
+{
+    if (model_op == OP_NONE) {
+        return false;
+    }
+    if (model_suspended) {
+        return simNow() < model_suspend_until;
+    }
+    return true;
+}
+
+static void model_start(model_op_t op, uint64_t duration)
+{
+    model_op = op;
+    model_busy_start = simNow();
+    model_busy_until = model_busy_start + model_duration(duration);
+}
+
+static void model_violation(const char *what)
+{
+    model_stats.violations++;
+    if (model_stats.violations <= 10U) {
+        fprintf(stderr,
+                "w25q: %s (cmd 0x%02x at %.3f ms)\n",
+                what,
+                model_cmd,
+                (double)simNow() / 1e6);
+    }
+}
+
+/* Commands accepted while the array is busy or powered down. */
+static bool model_allowed(uint8_t cmd)
+{
+    if (model_powerdown) {
+        return cmd == CMD_RELEASE_POWERDOWN;
+    }
+    if (simNow() < model_ready_at) {
+        return false;
+    }
+    if (model_busy()) {
+        return cmd == CMD_READ_STATUS1 || cmd == CMD_READ_STATUS2 ||
+               cmd == CMD_READ_STATUS3 ||
+               (cmd == CMD_SUSPEND && model_op == OP_ERASE &&
+                !model_suspended);
+    }
+    if (model_suspended) {
+        /* Page program is allowed outside the suspended erase, checked when
+           it executes.*/
+        return cmd != CMD_SECTOR_ERASE &&
+               cmd != CMD_BLOCK_ERASE_32K && cmd != CMD_BLOCK_ERASE_64K &&
+               cmd != CMD_CHIP_ERASE && cmd != CMD_CHIP_ERASE_ALT;
+    }
+    return true;
+}
+
+static uint8_t model_read(void)
+{
+    uint32_t addr = model_addr++ & (model_size - 1U);
+
+    if (model_suspended && addr >= model_erase_addr &&
+        addr < model_erase_addr + model_erase_size) {
+        model_violation("read from the sector being erased");
+    }
+    model_stats.bytes_read++;
+    return model_mem[addr];
+}
+
+static uint8_t model_status1(void)
+{
+    model_stats.status_reads++;
+    return (model_busy() ? SR1_BUSY : 0U) | (model_wel ? SR1_WEL : 0U);
+}
+
+static uint8_t model_byte(uint8_t in)
+{
+    unsigned pos = model_pos++;
+
+    if (!model_selected) {
+        model_violation("clocked while not selected");
+        return 0xffU;
+    }
+    if (pos == 0U) {
+        model_update();
+        model_cmd = in;
+        model_stats.commands++;
+        model_ignored = !model_allowed(in);
+        if (model_ignored) {
+            model_violation("command not accepted");
+        }
+        return 0xffU;
+    }
+    if (model_ignored) {
+        return 0xffU;
+    }
+
+    switch (model_cmd) {
+    case CMD_READ_STATUS1:
+        model_update();
+        return model_status1();
+    case CMD_READ_STATUS2:
+        model_update();
+        return model_suspended ? SR2_SUS : 0U;
+    case CMD_READ_STATUS3:
+        return 0U;
+    case CMD_READ_ID:
+        switch (pos) {
+        case 1U:
+            return MANUFACTURER_ID;
+        case 2U:
+            return MEMORY_TYPE_ID;
+        case 3U:
+            return (uint8_t)model_config.capacity;
+        default:
+            return 0U;
+        }
+    case CMD_READ_DATA:
+    case CMD_FAST_READ:
+    case CMD_READ_SFDP:
+    case CMD_PAGE_PROGRAM:
+    case CMD_SECTOR_ERASE:
+    case CMD_BLOCK_ERASE_32K:
+    case CMD_BLOCK_ERASE_64K:
+        if (pos <= 3U) {
+            model_addr = (model_addr << 8) | in;
+            return 0xffU;
+        }
+        break;
+    default:
+        return 0xffU;
+    }
+
+    switch (model_cmd) {
+    case CMD_READ_DATA:
+        return model_read();
+    case CMD_FAST_READ:
+        return pos == 4U ? 0xffU : model_read();
+    case CMD_PAGE_PROGRAM: {
+        /* The address wraps within the page, later bytes replace earlier
+           ones.*/
+        unsigned offset = (model_addr + pos - 4U) & (PAGE_SIZE - 1U);
+        if (!model_page_written[offset]) {
+            model_page_written[offset] = true;
+            model_page_count++;
+        }
+        model_page[offset] = in;
+    } break;
+    default:
+        break;
+    }
+    return 0xffU;
+}
+
+static void model_erase(uint32_t addr, uint32_t size, uint64_t duration)
+{
+    addr &= ~(size - 1U) & (model_size - 1U);
+    memset(&model_mem[addr], 0xff, size);
+    for (uint32_t i = 0; i < size / W25Q_MODEL_SECTOR_SIZE; i++) {
+        model_erase_counts[addr / W25Q_MODEL_SECTOR_SIZE + i]++;
+    }
+    model_erase_addr = addr;
+    model_erase_size = size;
+    model_start(OP_ERASE, duration);
+}
+
+/* Commands take effect when the device is unselected. */
+static void model_execute(void)
+{
+    unsigned pos = model_pos;
+    bool enable_reset = false;
+
+    if (pos == 0U || model_ignored) {
+        return;
+    }
+
+    switch (model_cmd) {
+    case CMD_WRITE_ENABLE:
+        model_wel = true;
+        break;
+    case CMD_WRITE_DISABLE:
+        model_wel = false;
+        break;
+    case CMD_PAGE_PROGRAM:
+        if (!model_wel || pos < 5U) {
+            model_violation("page program ignored");
+            break;
+        }
+        if (model_suspended &&
+            (model_addr & (model_size - 1U)) - model_erase_addr <
+                model_erase_size) {
+            model_violation("program into the sector being erased");
+            break;
+        }
+        {
+            bool unerased = false;
+
+            for (unsigned i = 0; i < PAGE_SIZE; i++) {
+                if (model_page_written[i]) {
+                    uint32_t addr = ((model_addr & ~(PAGE_SIZE - 1U)) + i) &
+                                    (model_size - 1U);
+                    unerased |= (model_mem[addr] & model_page[i]) !=
+                                model_page[i];
+                    model_mem[addr] &= model_page[i];
+                }
+            }
+            if (unerased) {
+                model_stats.unerased_programs++;
+            }
+        }
+        model_stats.bytes_programmed += model_page_count;
+        model_stats.page_programs++;
+        if (model_suspended) {
+            /* Runs within the suspend, the erase stays pending.*/
+            uint64_t duration = model_duration(
+                T_BYTE_PROGRAM + (uint64_t)(T_PAGE_PROGRAM - T_BYTE_PROGRAM) *
+                                     model_page_count / PAGE_SIZE);
+            model_suspend_until = simNow() + duration;
+            model_stats.busy_ns += duration;
+            model_wel = false;
+            break;
+        }
+        model_start(OP_PROGRAM,
+                    T_BYTE_PROGRAM + (uint64_t)(T_PAGE_PROGRAM - T_BYTE_PROGRAM) *
+                                         model_page_count / PAGE_SIZE);
+        break;
+    case CMD_SECTOR_ERASE:
+    case CMD_BLOCK_ERASE_32K:
+    case CMD_BLOCK_ERASE_64K:
+        if (!model_wel || pos != 4U) {
+            model_violation("erase ignored");
+            break;
+        }
+        if (model_cmd == CMD_SECTOR_ERASE) {
+            model_stats.sector_erases++;
+            model_erase(model_addr, 0x1000U, T_SECTOR_ERASE);
+        } else if (model_cmd == CMD_BLOCK_ERASE_32K) {
+            model_stats.block_erases++;
+            model_erase(model_addr, 0x8000U, T_BLOCK_ERASE_32K);
+        } else {
+            model_stats.block_erases++;
+            model_erase(model_addr, 0x10000U, T_BLOCK_ERASE_64K);
+        }
+        break;
+    case CMD_CHIP_ERASE:
+    case CMD_CHIP_ERASE_ALT:
+        if (!model_wel) {
+            model_violation("chip erase ignored");
+            break;
+        }
+        model_stats.chip_erases++;
+        model_erase(0U,
+                    model_size,
+                    T_CHIP_ERASE_PER_MB * model_size / 0x100000U);
+        break;
+    case CMD_SUSPEND:
+        model_update();
+        if (model_op == OP_ERASE) {
+            model_remaining = model_busy_until - simNow();
+            model_stats.busy_ns += simNow() - model_busy_start;
+            model_suspend_until = simNow() + T_SUSPEND;
+            model_suspended = true;
+            model_stats.suspends++;
+        }
+        break;
+    case CMD_RESUME:
+        if (model_suspended) {
+            model_suspended = false;
+            model_busy_start = simNow();
+            model_busy_until = model_busy_start + model_remaining;
+        }
+        break;
+    case CMD_POWERDOWN:
+        model_powerdown = true;
+        break;
+    case CMD_RELEASE_POWERDOWN:
+        if (model_powerdown) {
+            model_powerdown = false;
+            model_ready_at = simNow() + T_RES1;
+        }
+        break;
+    case CMD_ENABLE_RESET:
+        enable_reset = true;
+        break;
+    case CMD_RESET_DEVICE:
+        if (model_reset_enabled) {
+            model_wel = false;
+            model_suspended = false;
+            model_op = OP_NONE;
+        }
+        break;
+    default:
+        break;
+    }
+    model_reset_enabled = enable_reset;
+}
+
+void w25qModelInit(const w25q_model_config_t *config)
+{
+    FILE *f;
+
+    model_config = *config;
+    model_size = 1U << config->capacity;
+    model_mem = malloc(model_size);
+    model_erase_counts =
+        calloc(model_size / W25Q_MODEL_SECTOR_SIZE, sizeof(uint32_t));
+    if (model_mem == NULL || model_erase_counts == NULL) {
+        fprintf(stderr, "w25q: out of memory\n");
+        exit(1);
+    }
+    memset(model_mem, 0xff, model_size);
+
+    if (config->image != NULL && (f = fopen(config->image, "rb")) != NULL) {
+        if (fread(model_mem, 1, model_size, f) != model_size) {
+            fprintf(stderr, "w25q: short image %s\n", config->image);
+        }
+        fclose(f);
+    }
+}
+
+int w25qModelSave(void)
+{
+    FILE *f;
+    size_t n;
+
+    if (model_config.image == NULL) {
+        return 0;
+    }
+    f = fopen(model_config.image, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    n = fwrite(model_mem, 1, model_size, f);
+    fclose(f);
+    return n == model_size ? 0 : -1;
+}
+
+uint32_t w25qModelSize(void) { return model_size; }
+
+const w25q_model_stats_t *w25qModelStats(void) { return &model_stats; }
+
+const uint32_t *w25qModelEraseCounts(void) { return model_erase_counts; }
+
+void w25qModelResetStats(void)
+{
+    memset(&model_stats, 0, sizeof(model_stats));
+    memset(model_erase_counts,
+           0,
+           model_size / W25Q_MODEL_SECTOR_SIZE * sizeof(uint32_t));
+}
+
+/* The flash is the only device on the SPI bus. */
+
+static void spi_clock(size_t n)
+{
+    simAdvance((uint64_t)n * 8U * 1000000000U / SIM_SPI_HZ);
+}
+
+void spiStart(SPIDriver *spip, const SPIConfig *config)
+{
+    spip->config = config;
+}
+
+void spiSelect(SPIDriver *spip)
+{
+    (void)spip;
+
+    model_selected = true;
+    model_pos = 0;
+    model_addr = 0;
+    model_page_count = 0;
+    memset(model_page_written, 0, sizeof(model_page_written));
+}
+
+void spiUnselect(SPIDriver *spip)
+{
+    (void)spip;
+
+    model_execute();
+    model_selected = false;
+}
+
+void spiSend(SPIDriver *spip, size_t n, const void *txbuf)
+{
+    const uint8_t *p = txbuf;
+
+    (void)spip;
+
+    spi_clock(n);
+    while (n-- > 0U) {
+        model_byte(*p++);
+    }
+}
+
+void spiReceive(SPIDriver *spip, size_t n, void *rxbuf)
+{
+    uint8_t *p = rxbuf;
+
+    (void)spip;
+
+    spi_clock(n);
+    while (n-- > 0U) {
+        *p++ = model_byte(0xffU);
+    }
+}
+
+void spiIgnore(SPIDriver *spip, size_t n)
+{
+    (void)spip;
+
+    spi_clock(n);
+    while (n-- > 0U) {
+        model_byte(0xffU);
+    }
+}
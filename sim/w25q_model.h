@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sector size the erase counts are kept for */
+#define W25Q_MODEL_SECTOR_SIZE 4096U
+
+typedef struct {
+    /* log2 of the size in bytes, the third JEDEC ID byte */
+    unsigned capacity;
+    /* Operation durations vary by +- this percentage of the typical value */
+    unsigned jitter;
+    /* Image loaded at init and written by w25qModelSave(), NULL keeps the
+       contents in RAM only */
+    const char *image;
+} w25q_model_config_t;
+
+typedef struct {
+    uint64_t commands;
+    uint64_t bytes_read;
+    uint64_t bytes_programmed;
+    uint64_t page_programs;
+    uint64_t sector_erases;
+    uint64_t block_erases;
+    uint64_t chip_erases;
+    uint64_t status_reads;
+    uint64_t suspends;
+    /* Time the array was busy programming or erasing */
+    uint64_t busy_ns;
+    /* Commands the device would ignore or answer with undefined data */
+    uint64_t violations;
+    /* Pages programmed over bits that were not erased, the data is lost */
+    uint64_t unerased_programs;
+} w25q_model_stats_t;
+
+void w25qModelInit(const w25q_model_config_t *config);
+int w25qModelSave(void);
+uint32_t w25qModelSize(void);
+
+const w25q_model_stats_t *w25qModelStats(void);
+const uint32_t *w25qModelEraseCounts(void);
+void w25qModelResetStats(void);
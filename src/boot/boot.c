@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "boot.h"
+
+static rtcnt_t boot_start;
+static boot_phase_t boot_phases[BOOT_PHASES_MAX];
+static unsigned boot_count;
+
+void bootStart(void)
+{
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    /* Before chSysInit(), which enables the counter again.*/
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    boot_start = chSysGetRealtimeCounterX();
+    boot_count = 0;
+}
+
+void bootMark(const char *name)
+{
+    uint32_t us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - boot_start);
+
+    /* Marked from several threads.*/
+    chSysLock();
+    if (boot_count < BOOT_PHASES_MAX) {
+        boot_phases[boot_count].name = name;
+        boot_phases[boot_count].us = us;
+        boot_count++;
+    }
+    chSysUnlock();
+}
+
+unsigned bootGetPhases(const boot_phase_t **phases)
+{
+    *phases = boot_phases;
+    return boot_count;
+}
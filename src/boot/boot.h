@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/* Most phases recorded, later marks are dropped */
+#if !defined(BOOT_PHASES_MAX)
+#define BOOT_PHASES_MAX 16
+#endif
+
+typedef struct {
+    const char *name;
+    uint32_t us;
+} boot_phase_t;
+
+/* Times are relative to bootStart() and measured with the cycle counter,
+   which limits them to about a minute after it. bootStart() enables the
+   counter, it may run before chSysInit(). */
+void bootStart(void);
+/* Records the end of a phase, name must be a static string */
+void bootMark(const char *name);
+unsigned bootGetPhases(const boot_phase_t **phases);
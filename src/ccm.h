@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+/* Placement in the 8 KiB core coupled memory, zero wait states and not
+   shared with DMA. DMA cannot reach it either, so buffers handed to the
+   SPI driver, and stacks of threads that pass their locals to the flash,
+   are declared with the DMA_ variants. Both on one object do not compile,
+   the linker script checks that the DMA_ section stays in SRAM. The heap
+   is in SRAM as well. */
+
+/* Zeroed at startup */
+#define CCM_BSS __attribute__((section(".ram4_clear.ccm")))
+/* Initialized at startup */
+#define CCM_DATA __attribute__((section(".ram4_init.ccm")))
+/* Not initialized, for stacks */
+#define CCM_NOINIT __attribute__((section(".ram4.ccm")))
+
+/* SRAM, zeroed at startup */
+#define DMA_BSS __attribute__((section(".ram0_clear.dma")))
+
+#define CCM_WORKING_AREA(s, n) THD_WORKING_AREA(s, n) CCM_NOINIT
+#define DMA_WORKING_AREA(s, n) THD_WORKING_AREA(s, n) DMA_BSS
+
+/* True if DMA cannot reach the object, the simulator has no CCM */
+#if defined(CCMDATARAM_BASE)
+#define CCM_CONTAINS(p) ((uintptr_t)(p) - CCMDATARAM_BASE < 8192U)
+#else
+#define CCM_CONTAINS(p) false
+#endif
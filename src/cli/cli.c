@@ -5,6 +5,7 @@
 #include "ch.h"
 #include "hal.h"
 
+#include "ccm.h"
 #include "cli.h"
 #include "led.h"
 #include "shell.h"
@@ -15,6 +16,18 @@ void cmd_reset(BaseSequentialStream *, int, char *[]);
 void cmd_ina3221(BaseSequentialStream *, int, char *[]);
 void cmd_pca9546a(BaseSequentialStream *, int, char *[]);
 void cmd_tmp117(BaseSequentialStream *, int, char *[]);
+void cmd_flash(BaseSequentialStream *, int, char *[]);
+void cmd_tlog(BaseSequentialStream *, int, char *[]);
+void cmd_boot(BaseSequentialStream *, int, char *[]);
+void cmd_fw(BaseSequentialStream *, int, char *[]);
+void cmd_stream(BaseSequentialStream *, int, char *[]);
+void cmd_rpc(BaseSequentialStream *, int, char *[]);
+void cmd_sensors(BaseSequentialStream *, int, char *[]);
+void cmd_watch(BaseSequentialStream *, int, char *[]);
+void cmd_bench(BaseSequentialStream *, int, char *[]);
+void cmd_perf(BaseSequentialStream *, int, char *[]);
+void cmd_power(BaseSequentialStream *, int, char *[]);
+void cmd_tasks(BaseSequentialStream *, int, char *[]);
 
 static const ShellCommand commands[] = {
     {"identity", cmd_identity},
@@ -22,6 +35,18 @@ static const ShellCommand commands[] = {
     {"ina3221", cmd_ina3221},
     {"pca9546a", cmd_pca9546a},
     {"tmp117", cmd_tmp117},
+    {"flash", cmd_flash},
+    {"tlog", cmd_tlog},
+    {"boot", cmd_boot},
+    {"fw", cmd_fw},
+    {"stream", cmd_stream},
+    {"rpc", cmd_rpc},
+    {"sensors", cmd_sensors},
+    {"watch", cmd_watch},
+    {"bench", cmd_bench},
+    {"perf", cmd_perf},
+    {"power", cmd_power},
+    {"tasks", cmd_tasks},
     {NULL, NULL},
 };
 
@@ -48,49 +73,80 @@ thread_t *_threadFsSettings;
 static leds_t *_leds;
 static int _statusLed;
 
-enum CLI_STATE { DISCONNECTED, CONNECTING, CONNECTED, RUNNING };
+/* VBUS has to hold its level this long before the bus is attached or
+   detached. At power up it also keeps the pull-up off long enough for the
+   host to notice a device that was reset while plugged in.*/
+#if !defined(CLI_VBUS_STABLE_MS)
+#define CLI_VBUS_STABLE_MS 100
+#endif
+
+#define CLI_EVT_VBUS EVENT_MASK(0)
+#define CLI_EVT_USB EVENT_MASK(1)
+
+enum CLI_STATE { DISCONNECTED, CONNECTED, RUNNING };
 static enum CLI_STATE cli_state;
 
-void cliStart(thread_t *threadFsSettings, leds_t *leds, int statusLed)
-{
-    _threadFsSettings = threadFsSettings;
-    _leds = leds;
-    _statusLed = statusLed;
+static thread_t *cliThrd;
+static bool cli_vbus;
+static systime_t cli_vbus_since;
 
-    ledSet(_leds, _statusLed, 1, 19);
+static thread_t *shellThrd = NULL;
+/* Commands pass their buffers to the flash.*/
+static DMA_WORKING_AREA(waThreadShell, 1024);
 
-    sduObjectInit(&SDU1);
+static void cli_vbus_cb(void *arg)
+{
+    (void)arg;
 
-    shellInit();
+    chSysLockFromISR();
+    chEvtSignalI(cliThrd, CLI_EVT_VBUS);
+    chSysUnlockFromISR();
+}
 
+static void cli_detach(void)
+{
+    usbStop(serusbcfg1.usbp);
+    sduStop(&SDU1);
+    sduStop(&SDU2);
+    if (shellThrd != NULL) {
+        chThdTerminate(shellThrd);
+        chThdRelease(shellThrd);
+        shellThrd = NULL;
+    }
+    ledSet(_leds, _statusLed, 1, 19);
     cli_state = DISCONNECTED;
 }
 
-static thread_t *shellThrd = NULL;
-static THD_WORKING_AREA(waThreadShell, 1024);
+/* Advances the state machine, returns how long to wait for the next step
+   when no event arrives.*/
+static sysinterval_t cli_step(void)
+{
+    bool vbus = palReadPad(PORT_USBDET, PAD_USBDET);
+    sysinterval_t stable;
 
-static systime_t start_time;
+    if (vbus != cli_vbus) {
+        cli_vbus = vbus;
+        cli_vbus_since = chVTGetSystemTimeX();
+    }
+    stable = chVTTimeElapsedSinceX(cli_vbus_since);
+    if (stable < TIME_MS2I(CLI_VBUS_STABLE_MS)) {
+        return TIME_MS2I(CLI_VBUS_STABLE_MS) - stable;
+    }
 
-void cliCheck(void)
-{
     switch (cli_state) {
     case DISCONNECTED:
-        if (palReadPad(PORT_USBDET, PAD_USBDET)) {
+        if (vbus) {
             sduStart(&SDU1, &serusbcfg1);
-            usbDisconnectBus(serusbcfg1.usbp);
-            start_time = chVTGetSystemTimeX();
-            cli_state = CONNECTING;
-        };
-        break;
-    case CONNECTING:
-        if ((chVTGetSystemTimeX() - start_time) > TIME_MS2I(1500)) {
+            sduStart(&SDU2, &serusbcfg2);
             usbStart(serusbcfg1.usbp, &usbcfg);
             usbConnectBus(serusbcfg1.usbp);
             cli_state = CONNECTED;
         }
         break;
     case CONNECTED:
-        if (SDU1.config->usbp->state == USB_ACTIVE) {
+        if (!vbus) {
+            cli_detach();
+        } else if (SDU1.config->usbp->state == USB_ACTIVE) {
             shellThrd = chThdCreateStatic(waThreadShell,
                                           sizeof(waThreadShell),
                                           NORMALPRIO,
@@ -101,15 +157,62 @@ void cliCheck(void)
         }
         break;
     case RUNNING:
-        if (!palReadPad(PORT_USBDET, PAD_USBDET)) {
-            usbStop(serusbcfg1.usbp);
-            sduStop(&SDU1);
-            chThdTerminate(shellThrd);
-            chThdRelease(shellThrd);
-            shellThrd = NULL;
-            ledSet(_leds, _statusLed, 1, 19);
-            cli_state = DISCONNECTED;
+        if (!vbus) {
+            cli_detach();
         }
         break;
     }
+    return TIME_INFINITE;
+}
+
+static THD_FUNCTION(ThreadCli, arg)
+{
+    (void)arg;
+    event_listener_t el;
+
+    chRegSetThreadName("cli");
+    cliThrd = chThdGetSelfX();
+
+    /* The serial driver flags the configuration by the host.*/
+    chEvtRegisterMaskWithFlags(chnGetEventSource(&SDU1),
+                               &el,
+                               CLI_EVT_USB,
+                               CHN_CONNECTED);
+    palSetPadCallback(PORT_USBDET, PAD_USBDET, cli_vbus_cb, NULL);
+    palEnablePadEvent(PORT_USBDET, PAD_USBDET, PAL_EVENT_MODE_BOTH_EDGES);
+
+    while (true) {
+        sysinterval_t timeout = cli_step();
+
+        if (chEvtWaitAnyTimeout(ALL_EVENTS, timeout) & CLI_EVT_USB) {
+            chEvtGetAndClearFlags(&el);
+        }
+    }
+}
+
+void cliStart(void *wsp,
+              size_t size,
+              tprio_t prio,
+              thread_t *threadFsSettings,
+              leds_t *leds,
+              int statusLed)
+{
+    _threadFsSettings = threadFsSettings;
+    _leds = leds;
+    _statusLed = statusLed;
+
+    ledSet(_leds, _statusLed, 1, 19);
+
+    sduObjectInit(&SDU1);
+    sduObjectInit(&SDU2);
+
+    shellInit();
+
+    /* Keep the pull-up off until VBUS has settled.*/
+    usbDisconnectBus(serusbcfg1.usbp);
+
+    cli_state = DISCONNECTED;
+    cli_vbus = false;
+    cli_vbus_since = chVTGetSystemTimeX();
+    chThdCreateStatic(wsp, size, prio, ThreadCli, NULL);
 }
@@ -7,5 +7,9 @@
 typedef struct ch_thread thread_t;
 typedef struct _leds_t leds_t;
 
-void cliStart(thread_t *threadFsSettings, leds_t *leds, int statusLed);
-void cliCheck(void);
+void cliStart(void *wsp,
+              size_t size,
+              tprio_t prio,
+              thread_t *threadFsSettings,
+              leds_t *leds,
+              int statusLed);
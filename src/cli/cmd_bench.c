@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "ccm.h"
+#include "fs.h"
+#include "sensors.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+extern thread_t *_threadFsSettings;
+
+#define BENCH_NAME_SIZE 24
+#define BENCH_FS_SIZE 256U
+#define BENCH_FS_SIZE_MAX 1024U
+#define BENCH_USB_LINE 64U
+
+/* Times of the successful runs of one operation */
+typedef struct {
+    char name[BENCH_NAME_SIZE];
+    uint32_t count;
+    uint32_t errors;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint64_t bytes;
+} bench_t;
+
+typedef struct {
+    const char *name;
+    void (*run)(BaseSequentialStream *chp, uint32_t count);
+    uint32_t count;
+} bench_group_t;
+
+static uint8_t bench_data[BENCH_FS_SIZE_MAX] DMA_BSS;
+static uint32_t bench_fs_size = BENCH_FS_SIZE;
+
+static void bench_init(bench_t *b, const char *name)
+{
+    memset(b, 0, sizeof(*b));
+    strncpy(b->name, name, sizeof(b->name) - 1U);
+    b->min_us = UINT32_MAX;
+}
+
+static void bench_add(bench_t *b, bool ok, uint32_t us, uint32_t bytes)
+{
+    b->count++;
+    if (!ok) {
+        b->errors++;
+        return;
+    }
+    if (us < b->min_us) {
+        b->min_us = us;
+    }
+    if (us > b->max_us) {
+        b->max_us = us;
+    }
+    b->total_us += us;
+    b->bytes += bytes;
+}
+
+/* One comma separated row per operation, see the header below */
+static void bench_print(BaseSequentialStream *chp, const bench_t *b)
+{
+    uint32_t ok = b->count - b->errors;
+    uint32_t avg = ok > 0U ? (uint32_t)(b->total_us / ok) : 0U;
+    uint32_t ops =
+        b->total_us > 0U ? (uint32_t)(ok * 1000000ULL / b->total_us) : 0U;
+    uint32_t kib = b->total_us > 0U
+                       ? (uint32_t)(b->bytes * 1000000U / 1024U / b->total_us)
+                       : 0U;
+
+    chprintf(chp,
+             "%s,%u,%u,%u,%u,%u,%u,%u" SHELL_NEWLINE_STR,
+             b->name,
+             b->count,
+             b->errors,
+             ok > 0U ? b->min_us : 0U,
+             avg,
+             b->max_us,
+             ops,
+             kib);
+}
+
+static void bench_header(BaseSequentialStream *chp)
+{
+    chprintf(chp,
+             "bench,count,errors,min_us,avg_us,max_us,ops_s,kib_s"
+             SHELL_NEWLINE_STR);
+}
+
+static void bench_sensor(BaseSequentialStream *chp,
+                         sensor_id_t id,
+                         const char *bus,
+                         sensors_bench_op_t op,
+                         const char *opname,
+                         uint32_t count)
+{
+    sensor_t s;
+    bench_t b;
+    char name[BENCH_NAME_SIZE];
+
+    if (!sensorsGet(id, &s) || !s.present) {
+        return;
+    }
+    chsnprintf(name, sizeof(name), "%s%s.%s", bus, s.name, opname);
+    bench_init(&b, name);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t us = 0;
+        bench_add(&b, sensorsBench(id, op, &us) == MSG_OK, us, 0);
+    }
+    bench_print(chp, &b);
+}
+
+static void bench_i2c(BaseSequentialStream *chp, uint32_t count)
+{
+    for (unsigned i = 0; i < SENSOR_COUNT; i++) {
+        sensor_id_t id = (sensor_id_t)i;
+        const char *bus = id == SENSOR_INA3221 ? "i2c1." : "i2c2.";
+
+        if (id >= SENSOR_TMP117_0) {
+            bench_sensor(chp, id, bus, SENSORS_BENCH_SELECT, "select", count);
+        }
+        bench_sensor(chp, id, bus, SENSORS_BENCH_READ, "read", count);
+        bench_sensor(chp, id, bus, SENSORS_BENCH_WRITE, "write", count);
+    }
+}
+
+static void bench_sensors(BaseSequentialStream *chp, uint32_t count)
+{
+    for (unsigned i = 0; i < SENSOR_COUNT; i++) {
+        if (i != SENSOR_PCA9546A) {
+            bench_sensor(chp,
+                         (sensor_id_t)i,
+                         "",
+                         SENSORS_BENCH_SAMPLE,
+                         "sample",
+                         count);
+        }
+    }
+}
+
+static void bench_flash(BaseSequentialStream *chp, uint32_t count)
+{
+    bench_t erase;
+    bench_t prog;
+    bench_t read;
+
+    bench_init(&erase, "flash.erase");
+    bench_init(&prog, "flash.program");
+    bench_init(&read, "flash.read");
+    for (uint32_t i = 0; i < count; i++) {
+        fs_bench_t r;
+        bool ok = fsBenchFlash(_threadFsSettings, &r) == 0;
+
+        bench_add(&erase, ok, r.erase_us, r.bytes);
+        bench_add(&prog, ok, r.prog_us, r.bytes);
+        bench_add(&read, ok, r.read_us, r.bytes);
+    }
+    bench_print(chp, &erase);
+    bench_print(chp, &prog);
+    bench_print(chp, &read);
+}
+
+/* Each pass writes a file, opens it, reads it, renames it and removes it,
+   the times include the message round trip to the fs thread */
+static void bench_fs(BaseSequentialStream *chp, uint32_t count)
+{
+    uint32_t size = bench_fs_size;
+    static const char *ops[] = {"write", "open", "read", "rename", "remove"};
+    bench_t b[5];
+
+    for (unsigned i = 0; i < 5U; i++) {
+        char name[BENCH_NAME_SIZE];
+
+        chsnprintf(name, sizeof(name), "fs.%s", ops[i]);
+        bench_init(&b[i], name);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        int result[5];
+        uint32_t us[5];
+
+        memset(bench_data, (int)i, size);
+        for (unsigned op = 0; op < 5U; op++) {
+            rtcnt_t start = chSysGetRealtimeCounterX();
+
+            switch (op) {
+            case 0:
+                result[op] =
+                    fsWrite(_threadFsSettings, "bench.tmp", bench_data, size);
+                break;
+            case 1:
+                result[op] = fsRead(_threadFsSettings, "bench.tmp", NULL, 0);
+                break;
+            case 2:
+                result[op] =
+                    fsRead(_threadFsSettings, "bench.tmp", bench_data, size);
+                break;
+            case 3:
+                result[op] =
+                    fsRename(_threadFsSettings, "bench.tmp", "bench.new");
+                break;
+            default:
+                result[op] = fsRemove(_threadFsSettings, "bench.new");
+                break;
+            }
+            us[op] = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+        }
+        for (unsigned op = 0; op < 5U; op++) {
+            bench_add(&b[op],
+                      result[op] >= 0,
+                      us[op],
+                      op == 0U || op == 2U ? size : 0U);
+        }
+    }
+    for (unsigned i = 0; i < 5U; i++) {
+        bench_print(chp, &b[i]);
+    }
+}
+
+/* Count KiB of comment lines through the shell port */
+static void bench_usb(BaseSequentialStream *chp, uint32_t count)
+{
+    uint8_t line[BENCH_USB_LINE];
+    bench_t b;
+
+    memset(line, '.', sizeof(line));
+    line[0] = '#';
+    line[sizeof(line) - 2U] = '\r';
+    line[sizeof(line) - 1U] = '\n';
+
+    bench_init(&b, "usb.write");
+    for (uint32_t i = 0; i < count * 1024U / sizeof(line); i++) {
+        rtcnt_t start = chSysGetRealtimeCounterX();
+        size_t n = streamWrite(chp, line, sizeof(line));
+
+        bench_add(&b,
+                  n == sizeof(line),
+                  RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start),
+                  sizeof(line));
+    }
+    bench_print(chp, &b);
+}
+
+static const bench_group_t groups[] = {
+    {"i2c", bench_i2c, 100},
+    {"sensors", bench_sensors, 4},
+    {"flash", bench_flash, 4},
+    {"fs", bench_fs, 10},
+    {"usb", bench_usb, 64},
+};
+
+static void cmd_bench_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: bench i2c [count]" SHELL_NEWLINE_STR);
+    chprintf(chp, "       bench sensors [count]" SHELL_NEWLINE_STR);
+    chprintf(chp, "       bench flash [count]" SHELL_NEWLINE_STR);
+    chprintf(chp, "       bench fs [count [size]]" SHELL_NEWLINE_STR);
+    chprintf(chp, "       bench usb [KiB]" SHELL_NEWLINE_STR);
+    chprintf(chp, "       bench all" SHELL_NEWLINE_STR);
+}
+
+void cmd_bench(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    unsigned long count = 0;
+    unsigned long size = BENCH_FS_SIZE;
+    char *endptr;
+
+    if (argc < 1 || argc > 3) {
+        cmd_bench_usage(chp);
+        return;
+    }
+    if (argc > 1) {
+        count = strtoul(argv[1], &endptr, 0);
+        if (*endptr != '\0' || count == 0U) {
+            chprintf(chp, "invalid count" SHELL_NEWLINE_STR);
+            return;
+        }
+    }
+    if (argc > 2) {
+        size = strtoul(argv[2], &endptr, 0);
+        if (strcmp(argv[0], "fs") != 0 || *endptr != '\0' || size == 0U ||
+            size > BENCH_FS_SIZE_MAX) {
+            cmd_bench_usage(chp);
+            return;
+        }
+    }
+
+    if (strcmp(argv[0], "all") == 0 && argc == 1) {
+        bench_header(chp);
+        bench_fs_size = BENCH_FS_SIZE;
+        for (unsigned i = 0; i < COUNTOF(groups); i++) {
+            groups[i].run(chp, groups[i].count);
+        }
+        return;
+    }
+    for (unsigned i = 0; i < COUNTOF(groups); i++) {
+        if (strcmp(argv[0], groups[i].name) == 0) {
+            bench_header(chp);
+            bench_fs_size = size;
+            groups[i].run(chp, count > 0U ? count : groups[i].count);
+            return;
+        }
+    }
+    cmd_bench_usage(chp);
+}
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "boot.h"
+#include "fs.h"
+#include "wdog.h"
+
+static const char *const boot_states[] = {CH_STATE_NAMES};
+
+static void boot_reset(BaseSequentialStream *chp)
+{
+    wdog_stall_t stall;
+
+    if (!wdogWasReset()) {
+        return;
+    }
+    if (!wdogGetStall(&stall)) {
+        chprintf(chp, "reset by the watchdog" SHELL_NEWLINE_STR);
+        return;
+    }
+    chprintf(chp,
+             "reset by the watchdog after %u ms: %s stalled %u ms, %s"
+             SHELL_NEWLINE_STR,
+             stall.uptime_ms,
+             stall.name,
+             stall.late_ms,
+             stall.state < sizeof(boot_states) / sizeof(boot_states[0])
+                 ? boot_states[stall.state]
+                 : "?");
+    chprintf(chp, "pc 0x%08x, stack", stall.pc);
+    for (unsigned i = 0; i < WDOG_TRACE_DEPTH && stall.trace[i] != 0U; i++) {
+        chprintf(chp, " 0x%08x", stall.trace[i]);
+    }
+    chprintf(chp, SHELL_NEWLINE_STR);
+}
+
+void cmd_boot(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    const boot_phase_t *phases;
+    unsigned count = bootGetPhases(&phases);
+    uint32_t last = 0;
+
+    (void)argv;
+    if (argc != 0) {
+        chprintf(chp, "Usage: boot" SHELL_NEWLINE_STR);
+        return;
+    }
+
+    chprintf(chp,
+             "%-12s %10s %10s" SHELL_NEWLINE_STR,
+             "phase",
+             "at us",
+             "delta us");
+    for (unsigned i = 0; i < count; i++) {
+        chprintf(chp,
+                 "%-12s %10u %10u" SHELL_NEWLINE_STR,
+                 phases[i].name,
+                 phases[i].us,
+                 phases[i].us - last);
+        last = phases[i].us;
+    }
+    boot_reset(chp);
+    if (!fsIsReady()) {
+        chprintf(chp, "filesystem not ready" SHELL_NEWLINE_STR);
+    }
+}
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "fs.h"
+#include "hal_serial_nor.h"
+#include "util.h"
+
+#include <string.h>
+
+extern thread_t *_threadFsSettings;
+
+static const char *partitions[] = {
+    "littlefs",
+    "firmware",
+    "ringlog",
+};
+
+static const char *ops[] = {
+    "page program",
+    "erase 4K",
+    "erase 64K",
+    "erase chip",
+};
+
+static void cmd_flash_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: flash stats" SHELL_NEWLINE_STR);
+    chprintf(chp, "       flash reset" SHELL_NEWLINE_STR);
+    chprintf(chp, "       flash layout" SHELL_NEWLINE_STR);
+    chprintf(chp, "       flash migrate" SHELL_NEWLINE_STR);
+}
+
+void cmd_flash(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    if (argc != 1) {
+        cmd_flash_usage(chp);
+        return;
+    }
+
+    if (strcmp(argv[0], "stats") == 0) {
+        w25q_power_t p;
+        pcache_stats_t c;
+
+        chprintf(chp,
+                 "%-12s %8s %9s %9s %9s %9s %9s %6s %6s" SHELL_NEWLINE_STR,
+                 "op",
+                 "count",
+                 "model us",
+                 "avg us",
+                 "min us",
+                 "max us",
+                 "polls",
+                 "over",
+                 "susp");
+        for (unsigned i = 0; i < COUNTOF(ops); i++) {
+            w25q_timing_t t;
+            w25qGetTiming((w25q_op_t)i, &t);
+            chprintf(chp,
+                     "%-12s %8u %9u %9u %9u %9u %9u %6u %6u" SHELL_NEWLINE_STR,
+                     ops[i],
+                     t.count,
+                     t.expected_us,
+                     t.count > 0 ? (uint32_t)(t.total_us / t.count) : 0U,
+                     t.min_us,
+                     t.max_us,
+                     t.polls,
+                     t.overruns,
+                     t.suspends);
+        }
+        w25qGetPower(&p);
+        chprintf(chp,
+                 "power-down   %8u, %u%% of %u s, wake-up %u us%s"
+                 SHELL_NEWLINE_STR,
+                 p.powerdowns,
+                 p.total_us > 0U
+                     ? (uint32_t)(p.powerdown_us * 100U / p.total_us)
+                     : 0U,
+                 (uint32_t)(p.total_us / 1000000U),
+                 p.wakeup_us,
+                 w25qIsPoweredDown() ? ", now down" : "");
+        fsGetCacheStats(&c);
+        chprintf(chp,
+                 "page cache   %8u hits, %u misses, %u read ahead, %u bypass, "
+                 "%u invalidated" SHELL_NEWLINE_STR,
+                 c.hits,
+                 c.misses,
+                 c.readahead,
+                 c.bypass,
+                 c.invalidations);
+    } else if (strcmp(argv[0], "reset") == 0) {
+        w25qResetTiming();
+        w25qResetPower();
+        fsResetCacheStats();
+    } else if (strcmp(argv[0], "layout") == 0) {
+        chprintf(chp,
+                 "%-10s %8s %8s" SHELL_NEWLINE_STR,
+                 "partition",
+                 "first",
+                 "sectors");
+        for (unsigned i = 0; i < COUNTOF(partitions); i++) {
+            const fs_partition_t *part = fsGetPartition((fs_partition_id_t)i);
+
+            chprintf(chp,
+                     "%-10s %8u %8u" SHELL_NEWLINE_STR,
+                     partitions[i],
+                     part->first,
+                     part->count);
+        }
+    } else if (strcmp(argv[0], "migrate") == 0) {
+        /* Formats, keeping only the settings.*/
+        if (fsMigrate(_threadFsSettings) != 0) {
+            chprintf(chp, "migration failed" SHELL_NEWLINE_STR);
+        }
+    } else {
+        cmd_flash_usage(chp);
+    }
+}
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "fs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+extern thread_t *_threadFsSettings;
+
+/* Time the host may pause while sending the image */
+#define FW_RECEIVE_TIMEOUT_MS 2000
+
+/* One flash page per request, the fs thread copies it so it is filled
+   again while the page is programmed. */
+static uint8_t chunk[256];
+
+static const char *states[] = {
+    [FWSTAGE_EMPTY] = "empty",
+    [FWSTAGE_RECEIVING] = "receiving",
+    [FWSTAGE_RECEIVED] = "received",
+    [FWSTAGE_VERIFIED] = "verified",
+    [FWSTAGE_ACTIVE] = "active",
+    [FWSTAGE_FAILED] = "failed",
+};
+
+static void cmd_fw_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: fw load size" SHELL_NEWLINE_STR);
+    chprintf(chp, "       fw verify crc32" SHELL_NEWLINE_STR);
+    chprintf(chp, "       fw activate" SHELL_NEWLINE_STR);
+    chprintf(chp, "       fw status" SHELL_NEWLINE_STR);
+}
+
+static bool parse(const char *arg, uint32_t *value)
+{
+    char *endptr;
+    *value = strtoul(arg, &endptr, 0);
+    return *arg != '\0' && *endptr == '\0';
+}
+
+/* Discards the rest of an image after a failure until the host is quiet,
+   it would reach the shell as commands otherwise. */
+static void cmd_fw_drain(BaseChannel *chn)
+{
+    while (chnReadTimeout(
+               chn, chunk, sizeof(chunk), TIME_MS2I(FW_RECEIVE_TIMEOUT_MS)) >
+           0U) {
+    }
+}
+
+/* The image is sent as raw bytes after the "ready" line, anything the
+   host sent before is dropped. */
+static void cmd_fw_load(BaseSequentialStream *chp, uint32_t size)
+{
+    BaseChannel *chn = (BaseChannel *)chp;
+    fwstage_info_t info;
+    uint32_t received = 0;
+    systime_t start;
+    uint32_t ms;
+
+    chprintf(chp, "erasing" SHELL_NEWLINE_STR);
+    if (fsFwBegin(_threadFsSettings, size) != 0) {
+        fsFwInfo(_threadFsSettings, &info);
+        chprintf(chp,
+                 "failed, at most %u bytes" SHELL_NEWLINE_STR,
+                 info.capacity);
+        return;
+    }
+    while (chnReadTimeout(chn, chunk, sizeof(chunk), TIME_IMMEDIATE) > 0U) {
+    }
+    chprintf(chp, "ready" SHELL_NEWLINE_STR);
+
+    start = chVTGetSystemTimeX();
+    while (received < size) {
+        size_t want = size - received < sizeof(chunk) ? size - received
+                                                      : sizeof(chunk);
+        size_t n = chnReadTimeout(
+            chn, chunk, want, TIME_MS2I(FW_RECEIVE_TIMEOUT_MS));
+        if (n > 0U && fsFwWrite(_threadFsSettings, chunk, n) != (int)n) {
+            cmd_fw_drain(chn);
+            chprintf(chp, "write failed at %u" SHELL_NEWLINE_STR, received);
+            return;
+        }
+        if (n < want) {
+            cmd_fw_drain(chn);
+            chprintf(chp,
+                     "timeout after %u bytes" SHELL_NEWLINE_STR,
+                     received + (uint32_t)n);
+            return;
+        }
+        received += (uint32_t)n;
+    }
+    ms = TIME_I2MS(chVTTimeElapsedSinceX(start));
+    chprintf(chp,
+             "received %u bytes in %u ms, %u KiB/s" SHELL_NEWLINE_STR,
+             received,
+             ms,
+             ms > 0U ? received * 1000U / 1024U / ms : 0U);
+}
+
+void cmd_fw(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    uint32_t value;
+
+    if (argc == 2 && strcmp(argv[0], "load") == 0) {
+        if (!parse(argv[1], &value)) {
+            chprintf(chp, "invalid parameter" SHELL_NEWLINE_STR);
+            return;
+        }
+        cmd_fw_load(chp, value);
+    } else if (argc == 2 && strcmp(argv[0], "verify") == 0) {
+        if (!parse(argv[1], &value)) {
+            chprintf(chp, "invalid parameter" SHELL_NEWLINE_STR);
+            return;
+        }
+        chprintf(chp,
+                 "%s" SHELL_NEWLINE_STR,
+                 fsFwVerify(_threadFsSettings, value) == 0 ? "ok"
+                                                           : "failed");
+    } else if (argc == 1 && strcmp(argv[0], "activate") == 0) {
+        chprintf(chp,
+                 "%s" SHELL_NEWLINE_STR,
+                 fsFwActivate(_threadFsSettings) == 0 ? "ok" : "failed");
+    } else if (argc == 1 && strcmp(argv[0], "status") == 0) {
+        fwstage_info_t info;
+
+        if (fsFwInfo(_threadFsSettings, &info) != 0) {
+            chprintf(chp, "failed" SHELL_NEWLINE_STR);
+            return;
+        }
+        chprintf(chp,
+                 "%s, %u of %u bytes, crc32 0x%08x" SHELL_NEWLINE_STR,
+                 states[info.state],
+                 info.received,
+                 info.size,
+                 info.crc);
+    } else {
+        cmd_fw_usage(chp);
+    }
+}
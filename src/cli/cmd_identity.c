@@ -16,8 +16,7 @@
 
 extern thread_t *_threadFsSettings;
 
-static const char filename[] = "identity";
-static const char filename_tmp[] = "identity.tmp";
+static const char key[] = "identity";
 static const char *items[] = {
     "Vendor ID:",
     "Product:  ",
@@ -60,16 +59,15 @@ void cmd_identity(BaseSequentialStream *chp, int argc, char *argv[])
                 return;
             }
         }
-        if (fsWrite(_threadFsSettings, filename_tmp, buffer, sizeof(buffer)) ==
-            sizeof(buffer)) {
-            if (fsRename(_threadFsSettings, filename_tmp, filename) == 0) {
-                chprintf(chp, "set identity to:" SHELL_NEWLINE_STR);
-                for (unsigned i = 0; i < COUNTOF(items); i++) {
-                    chprintf(chp,
-                             "  %s 0x%08X" SHELL_NEWLINE_STR,
-                             items[i],
-                             buffer[i]);
-                }
+        if (fsKvSet(_threadFsSettings,
+                    key,
+                    KV_TYPE_U32,
+                    buffer,
+                    sizeof(buffer)) == sizeof(buffer)) {
+            chprintf(chp, "set identity to:" SHELL_NEWLINE_STR);
+            for (unsigned i = 0; i < COUNTOF(items); i++) {
+                chprintf(
+                    chp, "  %s 0x%08X" SHELL_NEWLINE_STR, items[i], buffer[i]);
             }
         } else {
             chprintf(chp, "failed to set identity" SHELL_NEWLINE_STR);
@@ -77,12 +75,13 @@ void cmd_identity(BaseSequentialStream *chp, int argc, char *argv[])
     } else if (strcmp(argv[0], "show") == 0) {
         uint32_t buffer[COUNTOF(items)];
         chprintf(chp, "Identity:" SHELL_NEWLINE_STR);
-        if (fsRead(_threadFsSettings, filename, buffer, sizeof(buffer)) ==
-            sizeof(buffer)) {
+        if (kvGet(key, KV_TYPE_U32, buffer, sizeof(buffer)) == sizeof(buffer)) {
             for (unsigned i = 0; i < COUNTOF(items); i++) {
                 chprintf(
                     chp, "  %s 0x%08X" SHELL_NEWLINE_STR, items[i], buffer[i]);
             }
+        } else if (!fsIsReady()) {
+            chprintf(chp, "  settings not loaded yet" SHELL_NEWLINE_STR);
         } else {
             for (unsigned i = 0; i < COUNTOF(items); i++) {
                 chprintf(chp, "  %s -" SHELL_NEWLINE_STR, items[i]);
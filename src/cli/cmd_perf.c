@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Threads followed over one window */
+#if !defined(PERF_THREADS_MAX)
+#define PERF_THREADS_MAX 16
+#endif
+
+#define PERF_WINDOW_MS 1000U
+/* The window is measured with the 32 bit cycle counter, which wraps
+   after 59.6 s at 72 MHz */
+#define PERF_WINDOW_MAX_MS 50000U
+
+/* Both stacks are filled by the startup code */
+extern uint8_t __main_stack_base__;
+extern uint8_t __main_stack_end__;
+extern uint8_t __main_thread_stack_base__;
+extern uint8_t __main_thread_stack_end__;
+
+typedef struct {
+    thread_t *tp;
+    rttime_t cumulative;
+} perf_sample_t;
+
+/* Bytes never written from the low end of a stack */
+static uint32_t perf_unused(const uint8_t *base, const uint8_t *end)
+{
+    const uint8_t *p = base;
+
+    while (p < end && *p == CH_DBG_STACK_FILL_VALUE) {
+        p++;
+    }
+    return (uint32_t)(p - base);
+}
+
+#if CH_DBG_STATISTICS == TRUE
+static unsigned perf_sample(perf_sample_t samples[])
+{
+    unsigned n = 0;
+    thread_t *tp = chRegFirstThread();
+
+    while (tp != NULL) {
+        if (n < PERF_THREADS_MAX) {
+            samples[n].tp = tp;
+            chSysLock();
+            samples[n].cumulative = tp->stats.cumulative;
+            chSysUnlock();
+            n++;
+        }
+        tp = chRegNextThread(tp);
+    }
+    return n;
+}
+
+static rttime_t perf_before(const perf_sample_t samples[],
+                            unsigned n,
+                            const thread_t *tp)
+{
+    for (unsigned i = 0; i < n; i++) {
+        if (samples[i].tp == tp) {
+            return samples[i].cumulative;
+        }
+    }
+    /* Started within the window.*/
+    return 0;
+}
+#endif
+
+static void perf_threads(BaseSequentialStream *chp, uint32_t window_ms)
+{
+#if CH_DBG_STATISTICS == TRUE
+    static perf_sample_t before[PERF_THREADS_MAX];
+    unsigned n_before;
+    rtcnt_t start;
+    uint32_t window;
+    ucnt_t ctxswc;
+    ucnt_t irq;
+
+    chSysLock();
+    ctxswc = currcore->kernel_stats.n_ctxswc;
+    irq = currcore->kernel_stats.n_irq;
+    chSysUnlock();
+    n_before = perf_sample(before);
+    start = chSysGetRealtimeCounterX();
+
+    chThdSleepMilliseconds(window_ms);
+
+    window = chSysGetRealtimeCounterX() - start;
+    chSysLock();
+    ctxswc = currcore->kernel_stats.n_ctxswc - ctxswc;
+    irq = currcore->kernel_stats.n_irq - irq;
+    chSysUnlock();
+#else
+    (void)window_ms;
+#endif
+
+    chprintf(chp,
+             "%-12s %4s %6s %7s %6s %6s %8s" SHELL_NEWLINE_STR,
+             "thread",
+             "prio",
+             "cpu %",
+             "max us",
+             "stack",
+             "used",
+             "free");
+    for (thread_t *tp = chRegFirstThread(); tp != NULL;
+         tp = chRegNextThread(tp)) {
+        const char *name = chRegGetThreadNameX(tp);
+        const uint8_t *base = (const uint8_t *)chThdGetWorkingAreaX(tp);
+        /* The thread structure sits at the top of a static working area.*/
+        const uint8_t *end = tp == &currcore->mainthread
+                                 ? &__main_thread_stack_end__
+                                 : (const uint8_t *)tp;
+        uint32_t size = (uint32_t)(end - base);
+        uint32_t unused = perf_unused(base, end);
+
+        chprintf(chp,
+                 "%-12s %4u ",
+                 name != NULL ? name : "-",
+                 (uint32_t)tp->hdr.pqueue.prio);
+#if CH_DBG_STATISTICS == TRUE
+        {
+            time_measurement_t tm;
+            rttime_t busy;
+
+            chSysLock();
+            tm = tp->stats;
+            chSysUnlock();
+            busy = tm.cumulative - perf_before(before, n_before, tp);
+            chprintf(chp,
+                     "%4u.%u %7u ",
+                     (uint32_t)(busy * 100U / window),
+                     (uint32_t)(busy * 1000U / window % 10U),
+                     RTC2US(STM32_HCLK, tm.worst));
+        }
+#else
+        chprintf(chp, "%6s %7s ", "-", "-");
+#endif
+        /* Without the fill only the main stack is known.*/
+        if (CH_DBG_FILL_THREADS == TRUE || tp == &currcore->mainthread) {
+            chprintf(chp,
+                     "%6u %6u %8u" SHELL_NEWLINE_STR,
+                     size,
+                     size - unused,
+                     unused);
+        } else {
+            chprintf(chp, "%6u %6s %8s" SHELL_NEWLINE_STR, size, "-", "-");
+        }
+    }
+    {
+        uint32_t size = (uint32_t)(&__main_stack_end__ - &__main_stack_base__);
+        uint32_t unused =
+            perf_unused(&__main_stack_base__, &__main_stack_end__);
+
+        chprintf(chp,
+                 "%-12s %4s %6s %7s %6u %6u %8u" SHELL_NEWLINE_STR,
+                 "(irq)",
+                 "",
+                 "",
+                 "",
+                 size,
+                 size - unused,
+                 unused);
+    }
+
+#if CH_DBG_STATISTICS == TRUE
+    {
+        kernel_stats_t ks;
+
+        chSysLock();
+        ks = currcore->kernel_stats;
+        chSysUnlock();
+        chprintf(chp,
+                 "%u ms: %u context switches, %u interrupts"
+                 SHELL_NEWLINE_STR,
+                 RTC2US(STM32_HCLK, window) / 1000U,
+                 ctxswc,
+                 irq);
+        chprintf(chp,
+                 "critical sections: thread max %u us, isr max %u us"
+                 SHELL_NEWLINE_STR,
+                 RTC2US(STM32_HCLK, ks.m_crit_thd.worst),
+                 RTC2US(STM32_HCLK, ks.m_crit_isr.worst));
+    }
+#else
+    chprintf(chp,
+             "cpu, switches and critical sections need a build with "
+             "USE_PROFILE=yes" SHELL_NEWLINE_STR);
+#endif
+}
+
+static void cmd_perf_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: perf [window ms]" SHELL_NEWLINE_STR);
+    chprintf(chp, "       perf reset" SHELL_NEWLINE_STR);
+}
+
+void cmd_perf(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    unsigned long window_ms = PERF_WINDOW_MS;
+
+    if (argc > 1) {
+        cmd_perf_usage(chp);
+        return;
+    }
+    if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+#if CH_DBG_STATISTICS == TRUE
+        /* Worst cases since boot include the start up. Only the maxima
+           are cleared, measurements in progress stay valid.*/
+        chSysLock();
+        currcore->kernel_stats.m_crit_thd.worst = 0;
+        currcore->kernel_stats.m_crit_isr.worst = 0;
+        chSysUnlock();
+        for (thread_t *tp = chRegFirstThread(); tp != NULL;
+             tp = chRegNextThread(tp)) {
+            chSysLock();
+            tp->stats.worst = 0;
+            chSysUnlock();
+        }
+#else
+        chprintf(chp, "no statistics in this build" SHELL_NEWLINE_STR);
+#endif
+        return;
+    }
+    if (argc == 1) {
+        char *endptr;
+
+        window_ms = strtoul(argv[0], &endptr, 0);
+        if (*endptr != '\0' || window_ms == 0U ||
+            window_ms > PERF_WINDOW_MAX_MS) {
+            cmd_perf_usage(chp);
+            return;
+        }
+    }
+    perf_threads(chp, (uint32_t)window_ms);
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "power.h"
+
+#include <string.h>
+
+static void cmd_power_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: power stats" SHELL_NEWLINE_STR);
+    chprintf(chp, "       power reset" SHELL_NEWLINE_STR);
+}
+
+void cmd_power(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    if (argc != 1) {
+        cmd_power_usage(chp);
+        return;
+    }
+
+    if (strcmp(argv[0], "stats") == 0) {
+        power_stats_t st;
+        uint64_t total;
+
+        powerGetStats(&st);
+        total = st.awake + st.asleep;
+        chprintf(chp,
+                 "asleep %u.%u%% of %u s, %u sleeps" SHELL_NEWLINE_STR,
+                 total > 0U ? (uint32_t)(st.asleep * 100U / total) : 0U,
+                 total > 0U ? (uint32_t)(st.asleep * 1000U / total % 10U)
+                            : 0U,
+                 (uint32_t)(total / CH_CFG_ST_FREQUENCY),
+                 st.sleeps);
+        chprintf(chp,
+                 "average sleep %u us, longest %u ms" SHELL_NEWLINE_STR,
+                 st.sleeps > 0U
+                     ? (uint32_t)(st.asleep * 1000000U / CH_CFG_ST_FREQUENCY /
+                                  st.sleeps)
+                     : 0U,
+                 (uint32_t)TIME_I2MS(st.longest));
+    } else if (strcmp(argv[0], "reset") == 0) {
+        powerResetStats();
+    } else {
+        cmd_power_usage(chp);
+    }
+}
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "rpc.h"
+
+#include <string.h>
+
+static void cmd_rpc_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: rpc stats" SHELL_NEWLINE_STR);
+    chprintf(chp, "       rpc reset" SHELL_NEWLINE_STR);
+}
+
+void cmd_rpc(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    if (argc != 1) {
+        cmd_rpc_usage(chp);
+        return;
+    }
+
+    if (strcmp(argv[0], "stats") == 0) {
+        rpc_stats_t st;
+
+        rpcGetStats(&st);
+        chprintf(chp,
+                 "%u requests, %u errors, %u responses lost" SHELL_NEWLINE_STR,
+                 st.requests,
+                 st.errors,
+                 st.lost);
+        chprintf(chp,
+                 "service time avg %u us, max %u us" SHELL_NEWLINE_STR,
+                 st.requests > 0U ? (uint32_t)(st.total_us / st.requests)
+                                  : 0U,
+                 st.max_us);
+    } else if (strcmp(argv[0], "reset") == 0) {
+        rpcResetStats();
+    } else {
+        cmd_rpc_usage(chp);
+    }
+}
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "sensors.h"
+
+static void print_sensor(BaseSequentialStream *chp, const sensor_t *s)
+{
+    chprintf(chp, "%-10s", s->name);
+    if (!s->present) {
+        chprintf(chp, " not found" SHELL_NEWLINE_STR);
+        return;
+    }
+    chprintf(chp, " %8u reads %5u errors", s->reads, s->errors);
+    if (s->reads > 0U) {
+        chprintf(chp,
+                 " %6u ms ago",
+                 (uint32_t)TIME_I2MS(chVTTimeElapsedSinceX(s->time)));
+        for (unsigned i = 0; i < s->channels; i++) {
+            chprintf(chp, " %.3f", (double)s->cooked[i]);
+        }
+    }
+    chprintf(chp, SHELL_NEWLINE_STR);
+}
+
+void cmd_sensors(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    sensor_t s;
+
+    if (argc > 1) {
+        chprintf(chp, "Usage: sensors [name]" SHELL_NEWLINE_STR);
+        return;
+    }
+
+    if (argc == 1) {
+        sensor_id_t id = sensorsFind(argv[0]);
+        if (id == SENSOR_COUNT) {
+            chprintf(chp, "unknown sensor" SHELL_NEWLINE_STR);
+            return;
+        }
+        sensorsGet(id, &s);
+        print_sensor(chp, &s);
+        return;
+    }
+
+    for (unsigned i = 0; i < SENSOR_COUNT; i++) {
+        sensorsGet((sensor_id_t)i, &s);
+        print_sensor(chp, &s);
+    }
+}
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "tstream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void cmd_stream_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: stream" SHELL_NEWLINE_STR);
+    chprintf(chp, "       stream rate hz" SHELL_NEWLINE_STR);
+    chprintf(chp, "       stream packed on|off" SHELL_NEWLINE_STR);
+}
+
+void cmd_stream(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    tstream_stats_t st;
+
+    if (argc == 2 && strcmp(argv[0], "rate") == 0) {
+        char *endptr;
+        unsigned long hz = strtoul(argv[1], &endptr, 0);
+        if (*argv[1] == '\0' || *endptr != '\0' || hz > 1000U) {
+            chprintf(chp, "invalid parameter" SHELL_NEWLINE_STR);
+            return;
+        }
+        tstreamSetRate((unsigned)hz);
+    } else if (argc == 2 && strcmp(argv[0], "packed") == 0) {
+        if (strcmp(argv[1], "on") == 0) {
+            tstreamSetPacked(true);
+        } else if (strcmp(argv[1], "off") == 0) {
+            tstreamSetPacked(false);
+        } else {
+            chprintf(chp, "invalid parameter" SHELL_NEWLINE_STR);
+            return;
+        }
+    } else if (argc != 0) {
+        cmd_stream_usage(chp);
+        return;
+    }
+
+    tstreamGetStats(&st);
+    chprintf(chp,
+             "rate %u Hz%s, %u snapshots in %u packed frames, %u events, "
+             "%u events lost, %u frames dropped, %u bytes" SHELL_NEWLINE_STR,
+             tstreamGetRate(),
+             tstreamGetPacked() ? " packed" : "",
+             st.snapshots,
+             st.packed,
+             st.events,
+             st.events_lost,
+             st.dropped,
+             st.bytes);
+}
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "task.h"
+#include "util.h"
+
+#include <string.h>
+
+/* Liu and Layland utilization bound n (2^(1/n) - 1) in per mille, the
+   last entry holds for more tasks */
+static const uint16_t tasks_bound[] = {1000, 828, 779, 756, 743, 734, 728, 724};
+
+static void tasks_show(BaseSequentialStream *chp)
+{
+    unsigned count = taskGetCount();
+    uint32_t load = 0;
+    task_t t;
+
+    chprintf(chp,
+             "%-10s %4s %6s %7s %8s %6s %6s %6s %8s %8s" SHELL_NEWLINE_STR,
+             "task",
+             "prio",
+             "period",
+             "budget",
+             "jobs",
+             "misses",
+             "over",
+             "skip",
+             "exec us",
+             "resp us");
+    for (unsigned i = 0; taskGet(i, &t); i++) {
+        uint32_t period_us = TIME_I2US(t.period);
+
+        chprintf(chp,
+                 "%-10s %4u %4u ms %7u %8u %6u %6u %6u %8u %8u"
+                 SHELL_NEWLINE_STR,
+                 t.name,
+                 (uint32_t)t.assigned,
+                 (uint32_t)TIME_I2MS(t.period),
+                 t.budget_us,
+                 t.stats.jobs,
+                 t.stats.misses,
+                 t.stats.overruns,
+                 t.stats.skipped,
+                 t.stats.exec_max_us,
+                 t.stats.response_max_us);
+        if (period_us > 0U) {
+            load += (uint32_t)((uint64_t)t.budget_us * 1000U / period_us);
+        }
+    }
+    if (count > 0U) {
+        unsigned n =
+            count < COUNTOF(tasks_bound) ? count : COUNTOF(tasks_bound);
+        uint32_t bound = tasks_bound[n - 1U];
+
+        /* Sufficient only, a load above the bound may still fit.*/
+        chprintf(chp,
+                 "budgets use %u.%u%%, rate monotonic bound %u.%u%%: %s"
+                 SHELL_NEWLINE_STR,
+                 load / 10U,
+                 load % 10U,
+                 bound / 10U,
+                 bound % 10U,
+                 load <= bound ? "schedulable" : "not proven");
+    }
+}
+
+static void cmd_tasks_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: tasks" SHELL_NEWLINE_STR);
+    chprintf(chp, "       tasks reset" SHELL_NEWLINE_STR);
+}
+
+void cmd_tasks(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    if (argc == 0) {
+        tasks_show(chp);
+    } else if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+        taskResetStats();
+    } else {
+        cmd_tasks_usage(chp);
+    }
+}
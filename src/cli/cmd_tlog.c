@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "fs.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+extern thread_t *_threadFsSettings;
+
+/* Too large for the shell stack */
+static tlog_query_t query;
+static tlog_row_t rows[4];
+
+static void cmd_tlog_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp,
+             "Usage: tlog query from to [channel_mask [bucket]]"
+             SHELL_NEWLINE_STR);
+}
+
+static bool parse(const char *arg, uint32_t *value)
+{
+    char *endptr;
+    *value = strtoul(arg, &endptr, 0);
+    return *arg != '\0' && *endptr == '\0';
+}
+
+void cmd_tlog(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    uint32_t from, to;
+    uint32_t mask = (1U << TLOG_CHANNELS) - 1U;
+    uint32_t bucket = 0;
+    int n;
+
+    if (argc < 3 || argc > 5 || strcmp(argv[0], "query") != 0) {
+        cmd_tlog_usage(chp);
+        return;
+    }
+    if (!parse(argv[1], &from) || !parse(argv[2], &to) ||
+        (argc > 3 && !parse(argv[3], &mask)) ||
+        (argc > 4 && !parse(argv[4], &bucket))) {
+        chprintf(chp, "invalid parameter" SHELL_NEWLINE_STR);
+        return;
+    }
+
+    /* One line per record or bucket, min/avg/max for buckets.*/
+    tlogQueryInit(&query, from, to, mask, bucket);
+    while ((n = fsTlogQuery(_threadFsSettings, &query, rows, COUNTOF(rows))) >
+           0) {
+        for (int i = 0; i < n; i++) {
+            const tlog_row_t *row = &rows[i];
+
+            chprintf(chp, "%10u", row->time);
+            if (bucket != 0U) {
+                chprintf(chp, " %5u", row->count);
+            }
+            for (unsigned ch = 0; ch < TLOG_CHANNELS; ch++) {
+                if ((mask & (1U << ch)) == 0U) {
+                    continue;
+                }
+                if (bucket != 0U) {
+                    chprintf(chp,
+                             " %d/%d/%d",
+                             row->min[ch],
+                             row->avg[ch],
+                             row->max[ch]);
+                } else {
+                    chprintf(chp, " %d", row->avg[ch]);
+                }
+            }
+            chprintf(chp, SHELL_NEWLINE_STR);
+        }
+    }
+    if (n < 0) {
+        chprintf(chp, "query failed" SHELL_NEWLINE_STR);
+    }
+}
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "chprintf.h"
+#include "shell.h"
+
+#include "outbuf.h"
+#include "sensors.h"
+
+#include <stdlib.h>
+
+#define WATCH_RATE_MAX 100U
+
+static void cmd_watch_usage(BaseSequentialStream *chp)
+{
+    chprintf(chp, "Usage: watch hz sensor..." SHELL_NEWLINE_STR);
+    chprintf(chp, "       any key stops" SHELL_NEWLINE_STR);
+}
+
+void cmd_watch(BaseSequentialStream *chp, int argc, char *argv[])
+{
+    BaseChannel *chn = (BaseChannel *)chp;
+    sensor_id_t ids[SHELL_MAX_ARGUMENTS];
+    unsigned count = 0;
+    outbuf_t ob;
+    unsigned long hz;
+    char *endptr;
+    systime_t prev;
+    systime_t start;
+
+    if (argc < 2) {
+        cmd_watch_usage(chp);
+        return;
+    }
+    hz = strtoul(argv[0], &endptr, 0);
+    if (*argv[0] == '\0' || *endptr != '\0' || hz == 0U ||
+        hz > WATCH_RATE_MAX) {
+        chprintf(chp, "invalid rate" SHELL_NEWLINE_STR);
+        return;
+    }
+    for (int i = 1; i < argc; i++) {
+        ids[count] = sensorsFind(argv[i]);
+        if (ids[count] == SENSOR_COUNT) {
+            chprintf(chp, "unknown sensor %s" SHELL_NEWLINE_STR, argv[i]);
+            return;
+        }
+        count++;
+    }
+
+    /* Lines go out without waiting, a slow host loses some of them. The
+       shell runs on the USB serial port.*/
+    outbufInit(&ob, (SerialUSBDriver *)chp);
+    start = prev = chVTGetSystemTimeX();
+    while (chnGetTimeout(chn, TIME_IMMEDIATE) == MSG_TIMEOUT) {
+        chprintf((BaseSequentialStream *)&ob,
+                 "%8u",
+                 (uint32_t)TIME_I2MS(chVTTimeElapsedSinceX(start)));
+        for (unsigned i = 0; i < count; i++) {
+            sensor_t s;
+
+            if (!sensorsGet(ids[i], &s) || !s.present || s.reads == 0U) {
+                chprintf((BaseSequentialStream *)&ob, " -");
+                continue;
+            }
+            for (unsigned ch = 0; ch < s.channels; ch++) {
+                chprintf((BaseSequentialStream *)&ob,
+                         " %.3f",
+                         (double)s.cooked[ch]);
+            }
+        }
+        chprintf((BaseSequentialStream *)&ob, SHELL_NEWLINE_STR);
+        outbufFlush(&ob);
+
+        prev = chThdSleepUntilWindowed(
+            prev, chTimeAddX(prev, TIME_MS2I(1000U / hz)));
+    }
+
+    if (ob.dropped > 0U) {
+        chprintf(chp, "%u lines dropped" SHELL_NEWLINE_STR, ob.dropped);
+    }
+}
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "outbuf.h"
+
+#include <string.h>
+
+/* Bytes that can be written without waiting. The buffer being filled is
+   left out, it is sent partly filled at the next frame.*/
+static size_t ob_room(SerialUSBDriver *sdup)
+{
+    output_buffers_queue_t *obqp = &sdup->obqueue;
+    size_t empty;
+
+    chSysLock();
+    empty = obqGetEmptyBuffersI(obqp);
+    if (obqp->ptr != NULL && empty > 0U) {
+        empty--;
+    }
+    chSysUnlock();
+    return empty * SERIAL_USB_BUFFERS_SIZE;
+}
+
+void outbufFlush(outbuf_t *ob)
+{
+    if (ob->fill == 0U && !ob->overflow) {
+        return;
+    }
+    /* The only writer, the room does not shrink until the write.*/
+    if (ob->overflow || ob->fill > ob_room(ob->sdup) ||
+        chnWriteTimeout(ob->sdup, ob->buf, ob->fill, TIME_IMMEDIATE) !=
+            ob->fill) {
+        ob->dropped++;
+    }
+    ob->fill = 0;
+    ob->overflow = false;
+}
+
+static size_t ob_write(void *ip, const uint8_t *bp, size_t n)
+{
+    outbuf_t *ob = (outbuf_t *)ip;
+
+    if (n > OUTBUF_SIZE - ob->fill) {
+        ob->overflow = true;
+        return n;
+    }
+    memcpy(&ob->buf[ob->fill], bp, n);
+    ob->fill += n;
+    return n;
+}
+
+static size_t ob_read(void *ip, uint8_t *bp, size_t n)
+{
+    (void)ip;
+    (void)bp;
+    (void)n;
+    return 0;
+}
+
+static msg_t ob_put(void *ip, uint8_t b)
+{
+    ob_write(ip, &b, 1);
+    return MSG_OK;
+}
+
+static msg_t ob_get(void *ip)
+{
+    (void)ip;
+    return MSG_RESET;
+}
+
+static const struct BaseSequentialStreamVMT vmt_outbuf = {
+    0,
+    ob_write,
+    ob_read,
+    ob_put,
+    ob_get,
+};
+
+void outbufInit(outbuf_t *ob, SerialUSBDriver *sdup)
+{
+    ob->vmt = &vmt_outbuf;
+    ob->sdup = sdup;
+    ob->fill = 0;
+    ob->overflow = false;
+    ob->dropped = 0;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Longest line, one buffer of the USB output queue */
+#define OUTBUF_SIZE SERIAL_USB_BUFFERS_SIZE
+
+/* Stream for periodic output that must not hold up the writer. A line
+   is collected and passed on as a whole if the USB output queue has
+   room for it, otherwise it is dropped, so the host never sees part of
+   a line. Lines longer than OUTBUF_SIZE are dropped as well. */
+typedef struct {
+    const struct BaseSequentialStreamVMT *vmt;
+    SerialUSBDriver *sdup;
+    uint8_t buf[OUTBUF_SIZE];
+    size_t fill;
+    bool overflow;
+    uint32_t dropped; /* Lines */
+} outbuf_t;
+
+void outbufInit(outbuf_t *ob, SerialUSBDriver *sdup);
+/* Ends a line */
+void outbufFlush(outbuf_t *ob);
@@ -5,9 +5,22 @@
 #include "ch.h"
 #include "hal.h"
 
+#include "boot.h"
+#include "ccm.h"
 #include "fs.h"
 #include "lfs.h"
 
+#include <string.h>
+
+/* The block count is read from the superblock at mount.*/
+#if LFS_VERSION < 0x00020007
+#error "littlefs 2.7 or later is required"
+#endif
+
+/* Root attribute holding the partition table the filesystem was
+   formatted with.*/
+#define FS_LAYOUT_ATTR 0x4c
+
 struct cmdRead {
     const char *name;
     void *data;
@@ -25,10 +38,90 @@ struct cmdRename {
     const char *newName;
 };
 
+struct cmdRemove {
+    const char *name;
+};
+
+struct cmdReadRaw {
+    flash_offset_t offset;
+    void *data;
+    unsigned size;
+};
+
+struct cmdKvSet {
+    const char *key;
+    kv_type_t type;
+    const void *data;
+    unsigned size;
+};
+
+struct cmdRingAppend {
+    const void *data;
+    unsigned size;
+};
+
+struct cmdRingRead {
+    uint32_t seq;
+    void *data;
+    unsigned size;
+};
+
+struct cmdRingInfo {
+    uint32_t *first;
+    uint32_t *next;
+};
+
+struct cmdTlogAppend {
+    uint32_t time;
+    const int32_t *value;
+};
+
+struct cmdTlogQuery {
+    tlog_query_t *query;
+    tlog_row_t *rows;
+    unsigned count;
+};
+
+struct cmdFwBegin {
+    uint32_t size;
+};
+
+struct cmdFwWrite {
+    const void *data;
+    unsigned size;
+};
+
+struct cmdFwVerify {
+    uint32_t crc;
+};
+
+struct cmdFwInfo {
+    fwstage_info_t *info;
+};
+
+struct cmdBench {
+    fs_bench_t *bench;
+};
+
 enum FSCOMMAND {
     FSREAD,
     FSWRITE,
     FSRENAME,
+    FSREMOVE,
+    FSREADRAW,
+    FSKVSET,
+    FSRINGAPPEND,
+    FSRINGREAD,
+    FSRINGINFO,
+    FSTLOGAPPEND,
+    FSTLOGQUERY,
+    FSFWBEGIN,
+    FSFWWRITE,
+    FSFWVERIFY,
+    FSFWACTIVATE,
+    FSFWINFO,
+    FSBENCH,
+    FSMIGRATE,
 };
 
 struct cmdFs {
@@ -37,20 +130,257 @@ struct cmdFs {
         struct cmdRead read;
         struct cmdWrite write;
         struct cmdRename rename;
+        struct cmdRemove remove;
+        struct cmdReadRaw readraw;
+        struct cmdKvSet kvset;
+        struct cmdRingAppend ringappend;
+        struct cmdRingRead ringread;
+        struct cmdRingInfo ringinfo;
+        struct cmdTlogAppend tlogappend;
+        struct cmdTlogQuery tlogquery;
+        struct cmdFwBegin fwbegin;
+        struct cmdFwWrite fwwrite;
+        struct cmdFwVerify fwverify;
+        struct cmdFwInfo fwinfo;
+        struct cmdBench bench;
     };
 };
 
+typedef struct {
+    SNORDriver snor;
+    lfs_t lfs;
+    struct lfs_config *cfg;
+    uint8_t *file_buffer;
+    bool erasing;
+    bool suspended;
+    bool idle_erase; /* Started between requests, lfs is not in use */
+    flash_sector_t erase_sector;
+    thread_t *deferred[FS_DEFERRED_MAX];
+    unsigned deferred_count;
+    lfs_block_t block_count;
+    uint32_t *erased;
+    uint32_t *used;
+    bool used_valid;
+    bool housekeeping;
+    bool gc_pending;
+    lfs_block_t next_block;
+    ringlog_t ring;
+    bool ring_erase_pending;
+    flash_sector_t ring_erase;
+    fwstage_t fw;
+} fs_t;
+
+/* Sectors reserved at the end of the flash, littlefs gets the rest.*/
+static const flash_sector_t fs_partition_sectors[FS_PARTITION_COUNT] = {
+    [FS_PARTITION_FIRMWARE] = FS_FIRMWARE_SECTORS,
+    [FS_PARTITION_RINGLOG] = FS_RINGLOG_SECTORS,
+};
+
+static fs_partition_t fs_partitions[FS_PARTITION_COUNT];
+
+static pcache_t fs_cache;
+
+static EVENTSOURCE_DECL(fs_event);
+static volatile bool fs_ready;
+
+#define BITMAP_WORDS(n) (((n) + 31U) / 32U)
+#define BITMAP_GET(bm, n) (((bm)[(n) / 32U] & (1U << ((n) % 32U))) != 0U)
+/* No erase running */
+#define FS_SECTOR_NONE ((flash_sector_t)-1)
+
+#define BITMAP_SET(bm, n) ((bm)[(n) / 32U] |= (1U << ((n) % 32U)))
+#define BITMAP_CLEAR(bm, n) ((bm)[(n) / 32U] &= ~(1U << ((n) % 32U)))
+
+static flash_sector_t fs_ring_sector(fs_t *fs, uint32_t seq)
+{
+    return fs_partitions[FS_PARTITION_RINGLOG].first +
+           ringlog_sector(&fs->ring, seq);
+}
+
+/* Requests that can be served while an erase is suspended. While lfs is
+   in the middle of an operation they must not use it, an erase started
+   between requests suspends for any request that leaves its sector
+   alone.*/
+static bool fs_is_urgent(fs_t *fs, const struct cmdFs *cmd)
+{
+    bool ring = fs_partitions[FS_PARTITION_RINGLOG].count != 0U;
+
+    switch (cmd->cmd) {
+    case FSREADRAW: {
+        const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+        flash_offset_t start = fs->erase_sector * desc->sectors_size;
+        flash_offset_t end = start + desc->sectors_size;
+        return cmd->readraw.offset + cmd->readraw.size <= start ||
+               cmd->readraw.offset >= end;
+    }
+    case FSRINGAPPEND: {
+        flash_sector_t sector;
+
+        /* Without the partition it fails once lfs is idle.*/
+        if (!ring) {
+            return false;
+        }
+        sector = fs_ring_sector(fs, fs->ring.next_seq);
+        return sector != fs->erase_sector &&
+               !(fs->ring_erase_pending && sector == fs->ring_erase);
+    }
+    case FSRINGREAD:
+        return ring &&
+               fs_ring_sector(fs, cmd->ringread.seq) != fs->erase_sector;
+    case FSRINGINFO:
+        return true;
+    case FSBENCH:
+    case FSMIGRATE:
+        return false;
+    default:
+        return fs->idle_erase;
+    }
+}
+
+/* Waits for an urgent request, other requests are deferred until the
+   running lfs operation is finished.*/
+static thread_t *fs_wait_urgent(fs_t *fs, sysinterval_t timeout)
+{
+    systime_t start = chVTGetSystemTimeX();
+
+    while (fs->deferred_count < FS_DEFERRED_MAX) {
+        sysinterval_t elapsed = chTimeDiffX(start, chVTGetSystemTimeX());
+        thread_t *caller = elapsed < timeout
+                               ? chMsgWaitTimeout(timeout - elapsed)
+                               : chMsgPoll();
+        if (caller == NULL) {
+            return NULL;
+        }
+        if (fs_is_urgent(fs, (struct cmdFs *)chMsgGet(caller))) {
+            return caller;
+        }
+        fs->deferred[fs->deferred_count++] = caller;
+    }
+
+    chThdSleep(timeout);
+    return NULL;
+}
+
+static void fs_serve(fs_t *fs, thread_t *caller);
+
+static void fs_serve_suspended(fs_t *fs, thread_t *caller)
+{
+    SNORDriver *snor = &fs->snor;
+    bool idle_erase = fs->idle_erase;
+
+    bus_acquire(snor->config->busp, snor->config->buscfg);
+    while (snor_device_suspend_erase(snor) == FLASH_BUSY_ERASING) {
+        bus_release(snor->config->busp);
+        chThdSleep(TIME_US2I(W25Q_TIME_RESUME_MIN_US));
+        bus_acquire(snor->config->busp, snor->config->buscfg);
+    }
+
+    fs->suspended = true;
+    fs->idle_erase = false;
+    fs_serve(fs, caller);
+    fs->idle_erase = idle_erase;
+
+    /* Otherwise finished by an erase of the request.*/
+    if (fs->suspended) {
+        fs->suspended = false;
+        snor_device_resume_erase(snor);
+        bus_release(snor->config->busp);
+    }
+}
+
+/* An lfs request served while an erase is suspended needs an erase of its
+   own, the suspended one is completed first. Leaves the bus released and
+   the driver ready, the request goes on without the suspend.*/
+static int fs_finish_erase(fs_t *fs)
+{
+    SNORDriver *snor = &fs->snor;
+    uint32_t msec;
+    flash_error_t ferr;
+
+    snor_device_resume_erase(snor);
+    while ((ferr = snor_device_query_erase(snor, &msec)) ==
+           FLASH_BUSY_ERASING) {
+        bus_release(snor->config->busp);
+        chThdSleep(TIME_MS2I(msec));
+        bus_acquire(snor->config->busp, snor->config->buscfg);
+    }
+    bus_release(snor->config->busp);
+
+    snor->state = FLASH_READY;
+    fs->suspended = false;
+    if (ferr != FLASH_NO_ERROR) {
+        return LFS_ERR_IO;
+    }
+    /* The request may program the block before the erase it was
+       suspended for returns, that one must not mark it again.*/
+    if (fs->erase_sector < fs->block_count) {
+        BITMAP_SET(fs->erased, fs->erase_sector);
+    }
+    fs->erase_sector = FS_SECTOR_NONE;
+    return 0;
+}
+
+/* Flash access outside lfs, the driver is used directly while an erase
+   is suspended. Callers' buffers may reach the SPI DMA, so they must not
+   be on a CCM stack.*/
+static int fs_flash_read(void *context,
+                         flash_offset_t offset,
+                         void *data,
+                         size_t size)
+{
+    fs_t *fs = (fs_t *)context;
+    flash_error_t ferr;
+
+    osalDbgCheck(!CCM_CONTAINS(data));
+    ferr = fs->suspended ? snor_device_read(&fs->snor, offset, size, data)
+                         : flashRead(&fs->snor, offset, size, data);
+    return ferr == FLASH_NO_ERROR ? 0 : -1;
+}
+
+static int fs_flash_prog(void *context,
+                         flash_offset_t offset,
+                         const void *data,
+                         size_t size)
+{
+    fs_t *fs = (fs_t *)context;
+    flash_error_t ferr;
+
+    osalDbgCheck(!CCM_CONTAINS(data));
+    pcache_invalidate(&fs_cache, offset, size);
+    ferr = fs->suspended ? snor_device_program(&fs->snor, offset, size, data)
+                         : flashProgram(&fs->snor, offset, size, data);
+    return ferr == FLASH_NO_ERROR ? 0 : -1;
+}
+
+static int fs_wait_erase(fs_t *fs)
+{
+    while (true) {
+        uint32_t msec;
+        thread_t *caller;
+
+        flash_error_t ferr = flashQueryErase(&fs->snor, &msec);
+        if (ferr != FLASH_BUSY_ERASING) {
+            return ferr == FLASH_NO_ERROR ? 0 : LFS_ERR_IO;
+        }
+
+        caller = fs_wait_urgent(fs, TIME_MS2I(msec));
+        if (caller != NULL) {
+            fs_serve_suspended(fs, caller);
+        }
+    }
+}
+
 int snor_read(const struct lfs_config *c,
               lfs_block_t block,
               lfs_off_t off,
               void *buffer,
               lfs_size_t size)
 {
-    SNORDriver *snor = (SNORDriver *)c->context;
+    SNORDriver *snor = &((fs_t *)c->context)->snor;
     const flash_descriptor_t *desc = flashGetDescriptor(snor);
-    flash_error_t ferr =
-        flashRead(snor, block * desc->sectors_size + off, size, buffer);
-    return ferr == FLASH_NO_ERROR ? 0 : LFS_ERR_IO;
+    int err =
+        pcache_read(&fs_cache, block * desc->sectors_size + off, buffer, size);
+    return err == 0 ? 0 : LFS_ERR_IO;
 }
 
 int snor_prog(const struct lfs_config *c,
@@ -59,22 +389,79 @@ int snor_prog(const struct lfs_config *c,
               const void *buffer,
               lfs_size_t size)
 {
-    SNORDriver *snor = (SNORDriver *)c->context;
-    const flash_descriptor_t *desc = flashGetDescriptor(snor);
-    flash_error_t ferr =
-        flashProgram(snor, block * desc->sectors_size + off, size, buffer);
+    fs_t *fs = (fs_t *)c->context;
+    const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+    flash_error_t ferr;
+
+    osalDbgCheck(!CCM_CONTAINS(buffer));
+    BITMAP_CLEAR(fs->erased, block);
+    fs->used_valid = false;
+    fs->housekeeping = true;
+
+    pcache_invalidate(&fs_cache, block * desc->sectors_size + off, size);
+    ferr = fs->suspended
+               ? snor_device_program(
+                     &fs->snor, block * desc->sectors_size + off, size, buffer)
+               : flashProgram(
+                     &fs->snor, block * desc->sectors_size + off, size, buffer);
     return ferr == FLASH_NO_ERROR ? 0 : LFS_ERR_IO;
 }
 
-int snor_erase(const struct lfs_config *c, lfs_block_t block)
+static int fs_erase_block(fs_t *fs, lfs_block_t block)
 {
-    SNORDriver *snor = (SNORDriver *)c->context;
-    flash_error_t ferr = flashStartEraseSector(snor, block);
+    const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+    int err;
+    flash_error_t ferr;
+
+    if (fs->suspended) {
+        err = fs_finish_erase(fs);
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    pcache_invalidate(
+        &fs_cache, block * desc->sectors_size, desc->sectors_size);
+    ferr = flashStartEraseSector(&fs->snor, block);
     if (ferr != FLASH_NO_ERROR) {
         return LFS_ERR_IO;
     }
-    ferr = flashWaitErase((BaseFlash *)snor);
-    return ferr == FLASH_NO_ERROR ? 0 : LFS_ERR_IO;
+    fs->erase_sector = block;
+    fs->erasing = true;
+    err = fs_wait_erase(fs);
+    fs->erasing = false;
+    /* Otherwise finished and marked by a request served meanwhile.*/
+    if (err == 0 && fs->erase_sector == block && block < fs->block_count) {
+        BITMAP_SET(fs->erased, block);
+    }
+    fs->erase_sector = FS_SECTOR_NONE;
+    return err;
+}
+
+int snor_erase(const struct lfs_config *c, lfs_block_t block)
+{
+    fs_t *fs = (fs_t *)c->context;
+
+    /* lfs allocates blocks in ascending order.*/
+    fs->next_block = (block + 1U) % fs->block_count;
+    fs->used_valid = false;
+    fs->housekeeping = true;
+
+    /* lfs allocates the blocks erased ahead, the one suspended under
+       the request is finished instead of erased again.*/
+    if (fs->suspended && block == fs->erase_sector) {
+        int err = fs_finish_erase(fs);
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    /* Already erased while idle.*/
+    if (BITMAP_GET(fs->erased, block)) {
+        return 0;
+    }
+
+    return fs_erase_block(fs, block);
 }
 
 int snor_sync(const struct lfs_config *c)
@@ -83,14 +470,588 @@ int snor_sync(const struct lfs_config *c)
     return 0;
 }
 
+/* Ends a traversal, lfs passes it through as it is not an error code */
+#define FS_PREEMPTED 1
+
+static int fs_mark_used(void *data, lfs_block_t block)
+{
+    fs_t *fs = (fs_t *)data;
+    bool pending;
+
+    if (block < fs->block_count) {
+        BITMAP_SET(fs->used, block);
+    }
+
+    /* A request ends the traversal, the next idle slice starts over.*/
+    chSysLock();
+    pending = chMsgIsPendingI(chThdGetSelfX());
+    chSysUnlock();
+    return pending ? FS_PREEMPTED : 0;
+}
+
+/* Does one piece of idle work, returns false when there is nothing left
+   to do. A request waits for the piece under way, except for the
+   traversal which it ends and the erases ahead which it suspends. The
+   rest is bounded by the size of the store: kv_compact() rewrites at
+   most KV_INDEX_SIZE records into one block and commits twice, and
+   lfs_fs_gc() traverses and compacts each metadata pair past its
+   threshold. With the blocks erased ahead a piece takes about the
+   program time of one block, a block lfs has to erase adds that erase,
+   during which only urgent requests are served.*/
+static bool fs_housekeeping(fs_t *fs)
+{
+    unsigned free_blocks = 0;
+
+    /* Finding the blocks in use, needed to know which are free.*/
+    if (!fs->used_valid) {
+        int err;
+
+        memset(fs->used, 0, BITMAP_WORDS(fs->block_count) * sizeof(uint32_t));
+        err = lfs_fs_traverse(&fs->lfs, fs_mark_used, fs);
+        if (err == FS_PREEMPTED) {
+            return true;
+        }
+        if (err != 0) {
+            return false;
+        }
+        fs->used_valid = true;
+        return true;
+    }
+
+#if LFS_VERSION >= 0x00020008
+    /* Compacting metadata and refilling the lookahead buffer.*/
+    if (fs->gc_pending) {
+        fs->gc_pending = false;
+        lfs_fs_gc(&fs->lfs);
+        fs->used_valid = false;
+        return true;
+    }
+#endif
+
+    if (kv_compact_needed()) {
+        kv_compact(&fs->lfs, fs->file_buffer);
+        return true;
+    }
+
+    /* Erasing the next free blocks the allocator will pick.*/
+    for (lfs_block_t i = 0; i < fs->block_count; i++) {
+        lfs_block_t block = (fs->next_block + i) % fs->block_count;
+        if (BITMAP_GET(fs->used, block)) {
+            continue;
+        }
+        if (!BITMAP_GET(fs->erased, block)) {
+            fs->idle_erase = true;
+            fs_erase_block(fs, block);
+            fs->idle_erase = false;
+            return true;
+        }
+        if (++free_blocks >= FS_PREERASE_BLOCKS) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+static thread_t *fs_next(fs_t *fs)
+{
+    /* Keeping the ring log writable.*/
+    if (fs->ring_erase_pending) {
+        fs->ring_erase_pending = false;
+        fs->idle_erase = true;
+        fs_erase_block(fs, fs->ring_erase);
+        fs->idle_erase = false;
+    }
+
+    if (fs->deferred_count > 0U) {
+        thread_t *caller = fs->deferred[0];
+        fs->deferred_count--;
+        memmove(&fs->deferred[0],
+                &fs->deferred[1],
+                fs->deferred_count * sizeof(fs->deferred[0]));
+        return caller;
+    }
+
+    /* Housekeeping in slices while no request is waiting.*/
+    while (fs->housekeeping) {
+        thread_t *caller = chMsgWaitTimeout(TIME_MS2I(FS_IDLE_SLICE_MS));
+        if (caller != NULL) {
+            return caller;
+        }
+        fs->housekeeping = fs_housekeeping(fs);
+        if (fs->deferred_count > 0U) {
+            return fs_next(fs);
+        }
+    }
+
+#if FS_POWERDOWN_MS > 0
+    {
+        thread_t *caller = chMsgWaitTimeout(TIME_MS2I(FS_POWERDOWN_MS));
+        if (caller != NULL) {
+            return caller;
+        }
+
+        /* Only requests access the flash, it wakes up for the next one.*/
+        w25qPowerDown(&fs->snor);
+        caller = chMsgWait();
+        w25qPowerUp(&fs->snor);
+        return caller;
+    }
+#else
+    return chMsgWait();
+#endif
+}
+
+static int fs_bench(fs_t *fs, flash_sector_t sector, fs_bench_t *bench)
+{
+    const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+    flash_offset_t offset = sector * desc->sectors_size;
+    uint8_t *buffer = fs->file_buffer;
+    rtcnt_t start;
+    int err;
+
+    bench->bytes = desc->sectors_size;
+
+    start = chSysGetRealtimeCounterX();
+    err = fs_erase_block(fs, sector);
+    bench->erase_us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+
+    start = chSysGetRealtimeCounterX();
+    for (uint32_t o = 0; err == 0 && o < desc->sectors_size;
+         o += desc->page_size) {
+        memset(buffer, (int)(o / desc->page_size), desc->page_size);
+        if (flashProgram(&fs->snor, offset + o, desc->page_size, buffer) !=
+            FLASH_NO_ERROR) {
+            err = -1;
+        }
+    }
+    bench->prog_us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+
+    /* Straight from the flash, the cache is not involved.*/
+    start = chSysGetRealtimeCounterX();
+    for (uint32_t o = 0; err == 0 && o < desc->sectors_size;
+         o += desc->page_size) {
+        if (flashRead(&fs->snor, offset + o, desc->page_size, buffer) !=
+                FLASH_NO_ERROR ||
+            buffer[0] != (uint8_t)(o / desc->page_size) ||
+            buffer[desc->page_size - 1U] != buffer[0]) {
+            err = -1;
+        }
+    }
+    bench->read_us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+
+    if (fs_erase_block(fs, sector) != 0) {
+        err = -1;
+    }
+    return err == 0 ? 0 : -1;
+}
+
+static int fs_migrate(fs_t *fs);
+
+static void fs_serve(fs_t *fs, thread_t *caller)
+{
+    struct cmdFs *cmd = (struct cmdFs *)chMsgGet(caller);
+    int result = -1;
+
+    switch (cmd->cmd) {
+    case FSREAD: {
+        struct lfs_file_config fcfg = {
+            .buffer = fs->file_buffer,
+        };
+        lfs_file_t file;
+        if (lfs_file_opencfg(
+                &fs->lfs, &file, cmd->read.name, LFS_O_RDONLY, &fcfg) == 0) {
+            result =
+                lfs_file_read(&fs->lfs, &file, cmd->read.data, cmd->read.size);
+            lfs_file_close(&fs->lfs, &file);
+        }
+    } break;
+    case FSWRITE: {
+        struct lfs_file_config fcfg = {
+            .buffer = fs->file_buffer,
+        };
+        lfs_file_t file;
+        if (lfs_file_opencfg(&fs->lfs,
+                             &file,
+                             cmd->write.name,
+                             LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC,
+                             &fcfg) == 0) {
+            result = lfs_file_write(
+                &fs->lfs, &file, cmd->write.data, cmd->write.size);
+            lfs_file_close(&fs->lfs, &file);
+        }
+        fs->gc_pending = true;
+    } break;
+    case FSRENAME: {
+        result =
+            lfs_rename(&fs->lfs, cmd->rename.oldName, cmd->rename.newName);
+        fs->gc_pending = true;
+    } break;
+    case FSREMOVE: {
+        result = lfs_remove(&fs->lfs, cmd->remove.name);
+        fs->gc_pending = true;
+    } break;
+    case FSREADRAW: {
+        if (fs_flash_read(fs,
+                          cmd->readraw.offset,
+                          cmd->readraw.data,
+                          cmd->readraw.size) == 0) {
+            result = (int)cmd->readraw.size;
+        }
+    } break;
+    case FSKVSET: {
+        if (kv_set(&fs->lfs,
+                   fs->file_buffer,
+                   cmd->kvset.key,
+                   cmd->kvset.type,
+                   cmd->kvset.data,
+                   cmd->kvset.size) == 0) {
+            result = (int)cmd->kvset.size;
+        }
+        fs->gc_pending = true;
+    } break;
+    case FSRINGAPPEND: {
+        uint32_t seq = fs->ring.next_seq;
+        uint32_t erase;
+        int err;
+
+        if (fs_partitions[FS_PARTITION_RINGLOG].count == 0U) {
+            break;
+        }
+        /* The erase ahead did not run yet.*/
+        if (fs->ring_erase_pending &&
+            fs->ring_erase == fs_ring_sector(fs, seq)) {
+            fs->ring_erase_pending = false;
+            if (fs_erase_block(fs, fs->ring_erase) != 0) {
+                break;
+            }
+        }
+        err = ringlog_append(&fs->ring,
+                             cmd->ringappend.data,
+                             cmd->ringappend.size,
+                             &erase);
+        if (err >= 0) {
+            result = (int)(seq & 0x7fffffffU);
+        }
+        if (err > 0) {
+            fs->ring_erase = fs_partitions[FS_PARTITION_RINGLOG].first + erase;
+            fs->ring_erase_pending = true;
+        }
+    } break;
+    case FSRINGREAD: {
+        if (fs_partitions[FS_PARTITION_RINGLOG].count != 0U) {
+            result = ringlog_read(&fs->ring,
+                                  cmd->ringread.seq,
+                                  cmd->ringread.data,
+                                  cmd->ringread.size);
+        }
+    } break;
+    case FSRINGINFO: {
+        *cmd->ringinfo.first = fs->ring.next_seq - fs->ring.count;
+        *cmd->ringinfo.next = fs->ring.next_seq;
+        result = 0;
+    } break;
+    case FSTLOGAPPEND: {
+        if (tlog_append(&fs->lfs,
+                        fs->file_buffer,
+                        cmd->tlogappend.time,
+                        cmd->tlogappend.value) == 0) {
+            result = 0;
+        }
+        fs->gc_pending = true;
+    } break;
+    case FSTLOGQUERY: {
+        int n = tlog_query(&fs->lfs,
+                           fs->file_buffer,
+                           cmd->tlogquery.query,
+                           cmd->tlogquery.rows,
+                           cmd->tlogquery.count);
+        result = n >= 0 ? n : -1;
+    } break;
+    case FSFWBEGIN: {
+        const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+        flash_sector_t first = fs_partitions[FS_PARTITION_FIRMWARE].first;
+        uint32_t extent = fwstage_extent(&fs->fw, cmd->fwbegin.size);
+
+        if (cmd->fwbegin.size == 0U ||
+            cmd->fwbegin.size > fs->fw.info.capacity) {
+            break;
+        }
+        result = 0;
+        for (flash_sector_t s = 0; s * desc->sectors_size < extent; s++) {
+            if (fs_erase_block(fs, first + s) != 0) {
+                result = -1;
+                break;
+            }
+        }
+        if (result == 0) {
+            result = fwstage_begin(&fs->fw, cmd->fwbegin.size);
+        } else {
+            fwstage_scan(&fs->fw);
+        }
+    } break;
+    case FSFWWRITE: {
+        const uint8_t *p = cmd->fwwrite.data;
+        unsigned left = cmd->fwwrite.size;
+
+        result = (int)cmd->fwwrite.size;
+        while (left > 0U) {
+            int n = fwstage_put(&fs->fw, p, left);
+            if (n < 0) {
+                result = -1;
+                break;
+            }
+            p += n;
+            left -= (unsigned)n;
+            if (left > 0U && fwstage_flush(&fs->fw) != 0) {
+                result = -1;
+                break;
+            }
+        }
+
+        /* The data is copied, the last page is programmed while the
+           caller receives the next chunk. A failure shows in the next
+           request.*/
+        if (result >= 0 && fwstage_page_full(&fs->fw)) {
+            chMsgRelease(caller, result);
+            fwstage_flush(&fs->fw);
+            return;
+        }
+    } break;
+    case FSFWVERIFY: {
+        result = fwstage_verify(&fs->fw, cmd->fwverify.crc);
+    } break;
+    case FSFWACTIVATE: {
+        result = fwstage_activate(&fs->fw);
+    } break;
+    case FSFWINFO: {
+        *cmd->fwinfo.info = fs->fw.info;
+        result = 0;
+    } break;
+    case FSBENCH: {
+        const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+        const fs_partition_t *part = &fs_partitions[FS_PARTITION_FIRMWARE];
+
+        if (part->count < 2U ||
+            (fs->fw.info.state != FWSTAGE_EMPTY &&
+             fwstage_extent(&fs->fw, fs->fw.info.size) >
+                 (part->count - 1U) * desc->sectors_size)) {
+            break;
+        }
+        result = fs_bench(fs, part->first + part->count - 1U, cmd->bench.bench);
+    } break;
+    case FSMIGRATE: {
+        result = fs_migrate(fs);
+    } break;
+    }
+
+    chMsgRelease(caller, result);
+}
+
+/* Moves a setting kept in its own file into the key/value store, the
+   file name is used as key.*/
+static void fs_import(fs_t *fs, const char *name, kv_type_t type, unsigned size)
+{
+    struct lfs_file_config fcfg = {
+        .buffer = fs->file_buffer,
+    };
+    uint8_t value[KV_VALUE_MAX];
+    lfs_file_t file;
+    lfs_ssize_t n;
+
+    if (size > sizeof(value) || kvGet(name, type, value, sizeof(value)) >= 0 ||
+        lfs_file_opencfg(&fs->lfs, &file, name, LFS_O_RDONLY, &fcfg) != 0) {
+        return;
+    }
+    n = lfs_file_read(&fs->lfs, &file, value, size);
+    lfs_file_close(&fs->lfs, &file);
+
+    if (n == (lfs_ssize_t)size &&
+        kv_set(&fs->lfs, fs->file_buffer, name, type, value, size) == 0) {
+        lfs_remove(&fs->lfs, name);
+    }
+}
+
+/* Partitions are placed from the end of the flash in front of the ones
+   after them, those that do not fit into the sectors left are disabled.*/
+static void fs_layout(flash_sector_t sectors, flash_sector_t lfs_min)
+{
+    flash_sector_t end = sectors;
+
+    for (unsigned i = FS_PARTITION_COUNT; i-- > FS_PARTITION_LFS + 1U;) {
+        flash_sector_t count = fs_partition_sectors[i];
+
+        if (end < lfs_min || count > end - lfs_min) {
+            count = 0;
+        }
+        end -= count;
+        fs_partitions[i].first = end;
+        fs_partitions[i].count = count;
+    }
+    fs_partitions[FS_PARTITION_LFS].first = 0;
+    fs_partitions[FS_PARTITION_LFS].count = end;
+}
+
+static bool fs_layout_valid(const fs_partition_t table[],
+                            flash_sector_t sectors,
+                            lfs_size_t block_count)
+{
+    flash_sector_t end = block_count;
+
+    if (table[FS_PARTITION_LFS].first != 0U ||
+        table[FS_PARTITION_LFS].count != block_count) {
+        return false;
+    }
+    for (unsigned i = FS_PARTITION_LFS + 1U; i < FS_PARTITION_COUNT; i++) {
+        if (table[i].count == 0U) {
+            continue;
+        }
+        if (table[i].first < end || table[i].count > sectors ||
+            table[i].first > sectors - table[i].count) {
+            return false;
+        }
+        end = table[i].first + table[i].count;
+    }
+    return true;
+}
+
+static int fs_format(fs_t *fs, flash_sector_t sectors)
+{
+    int err;
+
+    fs_layout(sectors, FS_LFS_SECTORS_MIN);
+    fs->cfg->block_count = fs_partitions[FS_PARTITION_LFS].count;
+    err = lfs_format(&fs->lfs, fs->cfg);
+    if (err == 0) {
+        err = lfs_mount(&fs->lfs, fs->cfg);
+    }
+    if (err == 0) {
+        err = lfs_setattr(&fs->lfs,
+                          "/",
+                          FS_LAYOUT_ATTR,
+                          fs_partitions,
+                          sizeof(fs_partitions));
+    }
+    return err;
+}
+
+static void fs_ring_init(fs_t *fs)
+{
+    const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+    const fs_partition_t *part = &fs_partitions[FS_PARTITION_RINGLOG];
+    uint32_t erase;
+
+    fs->ring.offset = part->first * desc->sectors_size;
+    fs->ring.sector_size = desc->sectors_size;
+    fs->ring.sectors = part->count;
+    fs->ring.context = fs;
+    fs->ring.read = fs_flash_read;
+    fs->ring.prog = fs_flash_prog;
+    fs->ring.next_seq = 0;
+    fs->ring.count = 0;
+
+    if (part->count != 0U && ringlog_scan(&fs->ring, &erase) >= 0) {
+        fs->ring_erase = part->first + erase;
+        fs->ring_erase_pending = true;
+    }
+}
+
+static void fs_fw_init(fs_t *fs)
+{
+    const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+    const fs_partition_t *part = &fs_partitions[FS_PARTITION_FIRMWARE];
+
+    fs->fw.offset = part->first * desc->sectors_size;
+    fs->fw.capacity = part->count * desc->sectors_size;
+    fs->fw.page_size = desc->page_size;
+    fs->fw.context = fs;
+    fs->fw.read = fs_flash_read;
+    fs->fw.prog = fs_flash_prog;
+    fwstage_scan(&fs->fw);
+}
+
+/* A filesystem formatted before its layout was recorded keeps its size,
+   the partitions that fit behind it are taken over and recorded.*/
+static void fs_mount(fs_t *fs, flash_sector_t sectors)
+{
+    fs_partition_t table[FS_PARTITION_COUNT];
+    struct lfs_fsinfo info;
+
+    /* The size comes from the superblock.*/
+    fs->cfg->block_count = 0;
+    if (lfs_mount(&fs->lfs, fs->cfg) != 0 ||
+        lfs_fs_stat(&fs->lfs, &info) != 0 || info.block_count > sectors) {
+        fs_format(fs, sectors);
+        bootMark("fs format");
+        return;
+    }
+
+    if (lfs_getattr(&fs->lfs, "/", FS_LAYOUT_ATTR, table, sizeof(table)) ==
+            (lfs_ssize_t)sizeof(table) &&
+        fs_layout_valid(table, sectors, info.block_count)) {
+        memcpy(fs_partitions, table, sizeof(table));
+        return;
+    }
+
+    fs_layout(sectors - info.block_count, 0);
+    for (unsigned i = FS_PARTITION_LFS + 1U; i < FS_PARTITION_COUNT; i++) {
+        fs_partitions[i].first += info.block_count;
+    }
+    fs_partitions[FS_PARTITION_LFS].count = info.block_count;
+    lfs_setattr(
+        &fs->lfs, "/", FS_LAYOUT_ATTR, fs_partitions, sizeof(fs_partitions));
+}
+
+static int fs_migrate(fs_t *fs)
+{
+    const flash_descriptor_t *desc = flashGetDescriptor(&fs->snor);
+    const fs_partition_t *ring = &fs_partitions[FS_PARTITION_RINGLOG];
+    int err;
+
+    /* Nothing reaches the old partitions while the flash is rewritten.*/
+    for (unsigned i = FS_PARTITION_LFS + 1U; i < FS_PARTITION_COUNT; i++) {
+        fs_partitions[i].count = 0;
+    }
+    fs->ring_erase_pending = false;
+    lfs_unmount(&fs->lfs);
+    pcache_invalidate(
+        &fs_cache, 0, desc->sectors_count * desc->sectors_size);
+    memset(fs->erased, 0, BITMAP_WORDS(desc->sectors_count) * sizeof(uint32_t));
+
+    err = fs_format(fs, desc->sectors_count);
+    fs->block_count = fs_partitions[FS_PARTITION_LFS].count;
+    fs->next_block = 0;
+    fs->used_valid = false;
+    fs->housekeeping = true;
+    if (err != 0) {
+        return -1;
+    }
+
+    /* The ring log sectors held littlefs blocks before.*/
+    for (flash_sector_t s = 0; s < ring->count; s++) {
+        if (fs_erase_block(fs, ring->first + s) != 0) {
+            err = -1;
+        }
+    }
+    fs_ring_init(fs);
+    fs_fw_init(fs);
+
+    /* The settings are still in the RAM index.*/
+    if (kv_compact(&fs->lfs, fs->file_buffer) != 0) {
+        err = -1;
+    }
+    tlog_load(&fs->lfs, fs->file_buffer);
+    return err == 0 ? 0 : -1;
+}
+
 static THD_FUNCTION(ThreadFs, arg)
 {
     const SNORConfig *snorconfig = (SNORConfig *)arg;
-    SNORDriver snor;
+    fs_t fs;
     const flash_descriptor_t *desc;
 
     struct lfs_config lfscfg = {
-        .context = &snor,
+        .context = &fs,
 
         .read = snor_read,
         .prog = snor_prog,
@@ -105,84 +1066,92 @@ static THD_FUNCTION(ThreadFs, arg)
         .lookahead_size = 0,
         .block_cycles = 500,
     };
-    lfs_t lfs;
 
     uint8_t *read_buffer;
     uint8_t *prog_buffer;
     uint8_t *lookahead_buffer;
-    uint8_t *file_buffer;
 
     chRegSetThreadName("fs");
+    fs_ready = false;
+
+    /* The ring log stays unset without its partition.*/
+    memset(&fs, 0, sizeof(fs));
+    fs.erasing = false;
+    fs.suspended = false;
+    fs.idle_erase = false;
+    fs.erase_sector = FS_SECTOR_NONE;
+    fs.ring_erase_pending = false;
+    fs.deferred_count = 0;
+    fs.used_valid = false;
+    fs.housekeeping = true;
+    fs.gc_pending = true;
+    fs.next_block = 0;
 
     spiStart(snorconfig->busp, snorconfig->buscfg);
-    snorObjectInit(&snor);
-    snorStart(&snor, snorconfig);
+    snorObjectInit(&fs.snor);
+    snorStart(&fs.snor, snorconfig);
+    bootMark("fs flash");
 
-    desc = flashGetDescriptor(&snor);
+    desc = flashGetDescriptor(&fs.snor);
 
     read_buffer = chCoreAlloc(desc->page_size);
     osalDbgAssert(read_buffer, "failed to allocate lfs read_buffer");
     prog_buffer = chCoreAlloc(desc->page_size);
-    osalDbgAssert(read_buffer, "failed to allocate lfs prog_buffer");
+    osalDbgAssert(prog_buffer, "failed to allocate lfs prog_buffer");
     lookahead_buffer = chCoreAllocAligned(desc->page_size, sizeof(uint32_t));
-    osalDbgAssert(read_buffer, "failed to allocate lfs lookahead_buffer");
-    file_buffer = chCoreAlloc(desc->page_size);
-    osalDbgAssert(file_buffer, "failed to allocate lfs file_buffer");
+    osalDbgAssert(lookahead_buffer, "failed to allocate lfs lookahead_buffer");
+    fs.file_buffer = chCoreAlloc(desc->page_size);
+    osalDbgAssert(fs.file_buffer, "failed to allocate lfs file_buffer");
+    fs.fw.page = chCoreAlloc(desc->page_size);
+    osalDbgAssert(fs.fw.page, "failed to allocate firmware page buffer");
+
+    fs_cache.page_size = desc->page_size;
+    fs_cache.pages_per_block = desc->sectors_size / desc->page_size;
+    fs_cache.data = chCoreAlloc(PCACHE_PAGES * desc->page_size);
+    osalDbgAssert(fs_cache.data, "failed to allocate page cache");
+    fs_cache.context = &fs;
+    fs_cache.read = fs_flash_read;
+    pcache_init(&fs_cache);
+
+    osalDbgAssert(desc->sectors_count >= FS_LFS_SECTORS_MIN,
+                  "flash too small for littlefs");
+
+    /* Bitmaps sized for the whole flash, the layout is known after the
+       mount.*/
+    fs.block_count = desc->sectors_count;
+    fs.erased = chCoreAlloc(BITMAP_WORDS(fs.block_count) * sizeof(uint32_t));
+    osalDbgAssert(fs.erased, "failed to allocate erased bitmap");
+    memset(fs.erased, 0, BITMAP_WORDS(fs.block_count) * sizeof(uint32_t));
+    fs.used = chCoreAlloc(BITMAP_WORDS(fs.block_count) * sizeof(uint32_t));
+    osalDbgAssert(fs.used, "failed to allocate used bitmap");
 
     lfscfg.read_size = desc->page_size;
     lfscfg.prog_size = desc->page_size;
     lfscfg.block_size = desc->sectors_size;
-    lfscfg.block_count = desc->sectors_count;
     lfscfg.cache_size = desc->page_size;
     lfscfg.lookahead_size = desc->page_size;
     lfscfg.read_buffer = read_buffer;
     lfscfg.prog_buffer = prog_buffer;
     lfscfg.lookahead_buffer = lookahead_buffer;
 
-    if (lfs_mount(&lfs, &lfscfg)) {
-        lfs_format(&lfs, &lfscfg);
-        lfs_mount(&lfs, &lfscfg);
-    }
+    fs.cfg = &lfscfg;
+    fs_mount(&fs, desc->sectors_count);
+    fs.block_count = fs_partitions[FS_PARTITION_LFS].count;
+    bootMark("fs mount");
 
-    while (true) {
-        thread_t *caller = chMsgWait();
-        struct cmdFs *cmd = (struct cmdFs *)chMsgGet(caller);
-        int result = -1;
-
-        switch (cmd->cmd) {
-        case FSREAD: {
-            struct lfs_file_config fcfg = {
-                .buffer = file_buffer,
-            };
-            lfs_file_t file;
-            if (lfs_file_opencfg(
-                    &lfs, &file, cmd->read.name, LFS_O_RDONLY, &fcfg) == 0) {
-                result =
-                    lfs_file_read(&lfs, &file, cmd->read.data, cmd->read.size);
-                lfs_file_close(&lfs, &file);
-            }
-        } break;
-        case FSWRITE: {
-            struct lfs_file_config fcfg = {
-                .buffer = file_buffer,
-            };
-            lfs_file_t file;
-            if (lfs_file_opencfg(&lfs,
-                                 &file,
-                                 cmd->read.name,
-                                 LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC,
-                                 &fcfg) == 0) {
-                result = lfs_file_write(
-                    &lfs, &file, cmd->write.data, cmd->write.size);
-                lfs_file_close(&lfs, &file);
-            }
-        } break;
-        case FSRENAME: {
-            result = lfs_rename(&lfs, cmd->rename.oldName, cmd->rename.newName);
-        } break;
-        }
+    fs_ring_init(&fs);
+    fs_fw_init(&fs);
+
+    kv_load(&fs.lfs, fs.file_buffer);
+    tlog_load(&fs.lfs, fs.file_buffer);
+    fs_import(&fs, "identity", KV_TYPE_U32, 4 * sizeof(uint32_t));
+    bootMark("fs ready");
 
-        chMsgRelease(caller, result);
+    fs_ready = true;
+    chEvtBroadcastFlags(&fs_event, FS_EVENT_READY);
+
+    while (true) {
+        fs_serve(&fs, fs_next(&fs));
     }
 }
 
@@ -193,6 +1162,24 @@ fsStart(void *wsp, size_t size, tprio_t prio, const SNORConfig *snorconfig)
         wsp, size, prio, ThreadFs, (void *)(const void *)snorconfig);
 }
 
+bool fsIsReady(void) { return fs_ready; }
+
+event_source_t *fsGetEventSource(void) { return &fs_event; }
+
+void fsGetCacheStats(pcache_stats_t *stats)
+{
+    chSysLock();
+    *stats = fs_cache.stats;
+    chSysUnlock();
+}
+
+void fsResetCacheStats(void)
+{
+    chSysLock();
+    memset(&fs_cache.stats, 0, sizeof(fs_cache.stats));
+    chSysUnlock();
+}
+
 int fsRead(thread_t *threadFs, const char *name, void *data, unsigned size)
 {
     struct cmdFs cmd = {
@@ -239,3 +1226,217 @@ int fsRename(thread_t *threadFs, const char *oldName, const char *newName)
 
     return chMsgSend(threadFs, (msg_t)&cmd);
 }
+
+int fsRemove(thread_t *threadFs, const char *name)
+{
+    struct cmdFs cmd = {
+        .cmd = FSREMOVE,
+        .remove =
+            {
+                .name = name,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsReadRaw(thread_t *threadFs, uint32_t offset, void *data, unsigned size)
+{
+    struct cmdFs cmd = {
+        .cmd = FSREADRAW,
+        .readraw =
+            {
+                .offset = offset,
+                .data = data,
+                .size = size,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+const fs_partition_t *fsGetPartition(fs_partition_id_t id)
+{
+    return &fs_partitions[id];
+}
+
+int32_t fsRingAppend(thread_t *threadFs, const void *data, unsigned size)
+{
+    struct cmdFs cmd = {
+        .cmd = FSRINGAPPEND,
+        .ringappend =
+            {
+                .data = data,
+                .size = size,
+            },
+    };
+
+    return (int32_t)chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsRingRead(thread_t *threadFs, uint32_t seq, void *data, unsigned size)
+{
+    struct cmdFs cmd = {
+        .cmd = FSRINGREAD,
+        .ringread =
+            {
+                .seq = seq,
+                .data = data,
+                .size = size,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsRingInfo(thread_t *threadFs, uint32_t *first, uint32_t *next)
+{
+    struct cmdFs cmd = {
+        .cmd = FSRINGINFO,
+        .ringinfo =
+            {
+                .first = first,
+                .next = next,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsTlogAppend(thread_t *threadFs,
+                 uint32_t time,
+                 const int32_t value[TLOG_CHANNELS])
+{
+    struct cmdFs cmd = {
+        .cmd = FSTLOGAPPEND,
+        .tlogappend =
+            {
+                .time = time,
+                .value = value,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsTlogQuery(thread_t *threadFs,
+                tlog_query_t *query,
+                tlog_row_t *rows,
+                unsigned count)
+{
+    struct cmdFs cmd = {
+        .cmd = FSTLOGQUERY,
+        .tlogquery =
+            {
+                .query = query,
+                .rows = rows,
+                .count = count,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsKvSet(thread_t *threadFs,
+            const char *key,
+            kv_type_t type,
+            const void *data,
+            unsigned size)
+{
+    struct cmdFs cmd = {
+        .cmd = FSKVSET,
+        .kvset =
+            {
+                .key = key,
+                .type = type,
+                .data = data,
+                .size = size,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsFwBegin(thread_t *threadFs, uint32_t size)
+{
+    struct cmdFs cmd = {
+        .cmd = FSFWBEGIN,
+        .fwbegin =
+            {
+                .size = size,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsFwWrite(thread_t *threadFs, const void *data, unsigned size)
+{
+    struct cmdFs cmd = {
+        .cmd = FSFWWRITE,
+        .fwwrite =
+            {
+                .data = data,
+                .size = size,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsFwVerify(thread_t *threadFs, uint32_t crc)
+{
+    struct cmdFs cmd = {
+        .cmd = FSFWVERIFY,
+        .fwverify =
+            {
+                .crc = crc,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsFwActivate(thread_t *threadFs)
+{
+    struct cmdFs cmd = {
+        .cmd = FSFWACTIVATE,
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsFwInfo(thread_t *threadFs, fwstage_info_t *info)
+{
+    struct cmdFs cmd = {
+        .cmd = FSFWINFO,
+        .fwinfo =
+            {
+                .info = info,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsMigrate(thread_t *threadFs)
+{
+    struct cmdFs cmd = {
+        .cmd = FSMIGRATE,
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
+
+int fsBenchFlash(thread_t *threadFs, fs_bench_t *bench)
+{
+    struct cmdFs cmd = {
+        .cmd = FSBENCH,
+        .bench =
+            {
+                .bench = bench,
+            },
+    };
+
+    return chMsgSend(threadFs, (msg_t)&cmd);
+}
@@ -4,12 +4,129 @@
 
 #pragma once
 
+#include "fwstage.h"
 #include "hal_serial_nor.h"
+#include "kv.h"
+#include "pcache.h"
+#include "ringlog.h"
+#include "tlog.h"
+
+/* Requests queued while an lfs operation waits for an erase */
+#if !defined(FS_DEFERRED_MAX)
+#define FS_DEFERRED_MAX 4
+#endif
+
+/* Idle time before each housekeeping slice */
+#if !defined(FS_IDLE_SLICE_MS)
+#define FS_IDLE_SLICE_MS 50
+#endif
+
+/* Free blocks kept erased ahead of the lfs allocator */
+#if !defined(FS_PREERASE_BLOCKS)
+#define FS_PREERASE_BLOCKS 4
+#endif
+
+/* Idle time after housekeeping before the flash enters deep power-down,
+   0 keeps it powered */
+#if !defined(FS_POWERDOWN_MS)
+#define FS_POWERDOWN_MS 1000
+#endif
+
+/* Sectors reserved for firmware images in front of the ring log, an
+   image takes one page more than its size, 0 disables staging */
+#if !defined(FS_FIRMWARE_SECTORS)
+#define FS_FIRMWARE_SECTORS 64
+#endif
+
+/* Sectors reserved for the ring log at the end of the flash, a power of
+   two and at least 4, 0 disables the ring log */
+#if !defined(FS_RINGLOG_SECTORS)
+#define FS_RINGLOG_SECTORS 16
+#endif
+
+#if (FS_RINGLOG_SECTORS != 0) && ((FS_RINGLOG_SECTORS < 4) || ((FS_RINGLOG_SECTORS & (FS_RINGLOG_SECTORS - 1)) != 0))
+#error "FS_RINGLOG_SECTORS must be 0 or a power of two of at least 4"
+#endif
+
+/* Sectors littlefs keeps at least, partitions that do not fit beside
+   them are disabled */
+#if !defined(FS_LFS_SECTORS_MIN)
+#define FS_LFS_SECTORS_MIN 16
+#endif
+
+/* Flash partitions, littlefs starts at sector 0 and the others are
+   reserved at the end of the flash in this order. The layout is stored
+   with the filesystem, one formatted with an earlier layout keeps it
+   until it is migrated. */
+typedef enum {
+    FS_PARTITION_LFS,
+    FS_PARTITION_FIRMWARE,
+    FS_PARTITION_RINGLOG,
+    FS_PARTITION_COUNT,
+} fs_partition_id_t;
+
+typedef struct {
+    flash_sector_t first;
+    flash_sector_t count;
+} fs_partition_t;
+
+/* Broadcast once the filesystem is mounted and the settings are loaded */
+#define FS_EVENT_READY ((eventflags_t)1)
 
 typedef struct ch_thread thread_t;
 
+/* Returns at once, the flash is mounted by the fs thread. Requests sent
+   before are queued and served in order once it is ready. */
 thread_t* fsStart(void *wsp, size_t size, tprio_t prio, const SNORConfig* snorconfig);
+bool fsIsReady(void);
+event_source_t* fsGetEventSource(void);
 
 int fsRead(thread_t *threadFs, const char* name, void* data, unsigned size);
 int fsWrite(thread_t *threadFs, const char* name, const void* data, unsigned size);
 int fsRename(thread_t *threadFs, const char* oldName, const char* newName);
+int fsRemove(thread_t *threadFs, const char* name);
+int fsReadRaw(thread_t *threadFs, uint32_t offset, void* data, unsigned size);
+int fsKvSet(thread_t *threadFs, const char* key, kv_type_t type, const void* data, unsigned size);
+
+/* Valid once the fs thread served its first request */
+const fs_partition_t* fsGetPartition(fs_partition_id_t id);
+/* Formats littlefs with the current layout and writes the key/value
+   settings back, other files, the ring log and a staged image are lost */
+int fsMigrate(thread_t *threadFs);
+
+/* Firmware staging: begin erases the space for the image, writes append
+   to it, verify checks the zlib CRC-32 of the whole image read back from
+   the flash and activate marks a verified image as ready to install */
+int fsFwBegin(thread_t *threadFs, uint32_t size);
+int fsFwWrite(thread_t *threadFs, const void* data, unsigned size);
+int fsFwVerify(thread_t *threadFs, uint32_t crc);
+int fsFwActivate(thread_t *threadFs);
+int fsFwInfo(thread_t *threadFs, fwstage_info_t* info);
+
+/* Times of one sector erase, program and read back. The last sector of the
+   firmware partition is used while a staged image leaves it free, it is
+   erased again afterwards. */
+typedef struct {
+    uint32_t erase_us;
+    uint32_t prog_us;
+    uint32_t read_us;
+    uint32_t bytes;
+} fs_bench_t;
+
+/* Returns 0, or -1 without a free sector or on a flash error */
+int fsBenchFlash(thread_t *threadFs, fs_bench_t* bench);
+
+/* Page cache in front of lfs reads, updated by the fs thread */
+void fsGetCacheStats(pcache_stats_t* stats);
+void fsResetCacheStats(void);
+
+/* Appends one record of up to RINGLOG_DATA_SIZE bytes, returns its sequence number or -1 */
+int32_t fsRingAppend(thread_t *threadFs, const void* data, unsigned size);
+int fsRingRead(thread_t *threadFs, uint32_t seq, void* data, unsigned size);
+/* Sequence numbers of the oldest record and the next record */
+int fsRingInfo(thread_t *threadFs, uint32_t* first, uint32_t* next);
+
+/* Times must not decrease */
+int fsTlogAppend(thread_t *threadFs, uint32_t time, const int32_t value[TLOG_CHANNELS]);
+/* Returns the number of rows filled, 0 once the query is complete or -1 */
+int fsTlogQuery(thread_t *threadFs, tlog_query_t* query, tlog_row_t* rows, unsigned count);
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "fwstage.h"
+#include "lfs_util.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static uint32_t fw_header_crc(const fwstage_header_t *hdr)
+{
+    return lfs_crc(0xffffffffU, hdr, offsetof(fwstage_header_t, header_crc));
+}
+
+static flash_offset_t fw_image_offset(const fwstage_t *fw)
+{
+    return fw->offset + fw->page_size;
+}
+
+static void fw_fail(fwstage_t *fw)
+{
+    fw->info.state = FWSTAGE_FAILED;
+}
+
+void fwstage_scan(fwstage_t *fw)
+{
+    fwstage_header_t hdr;
+
+    memset(&fw->info, 0, sizeof(fw->info));
+    fw->info.state = FWSTAGE_EMPTY;
+    fw->fill = 0;
+    if (fw->capacity > fw->page_size) {
+        fw->info.capacity = fw->capacity - fw->page_size;
+    }
+
+    if (fw->info.capacity == 0U ||
+        fw->read(fw->context, fw->offset, &hdr, sizeof(hdr)) != 0) {
+        return;
+    }
+    if (hdr.magic == FWSTAGE_MAGIC && hdr.header_crc == fw_header_crc(&hdr) &&
+        hdr.size <= fw->info.capacity) {
+        fw->info.state = FWSTAGE_ACTIVE;
+        fw->info.size = hdr.size;
+        fw->info.received = hdr.size;
+        fw->info.crc = hdr.crc;
+    }
+}
+
+uint32_t fwstage_extent(const fwstage_t *fw, uint32_t size)
+{
+    return fw->page_size + size;
+}
+
+int fwstage_begin(fwstage_t *fw, uint32_t size)
+{
+    if (size == 0U || size > fw->info.capacity) {
+        return -1;
+    }
+    fw->info.state = FWSTAGE_RECEIVING;
+    fw->info.size = size;
+    fw->info.received = 0;
+    fw->info.crc = 0;
+    fw->crc = 0xffffffffU;
+    fw->fill = 0;
+    return 0;
+}
+
+int fwstage_put(fwstage_t *fw, const void *data, unsigned size)
+{
+    unsigned n = fw->page_size - fw->fill;
+
+    if (fw->info.state != FWSTAGE_RECEIVING ||
+        size > fw->info.size - fw->info.received) {
+        fw_fail(fw);
+        return -1;
+    }
+    if (n > size) {
+        n = size;
+    }
+    memcpy(&fw->page[fw->fill], data, n);
+    fw->fill += n;
+    fw->info.received += n;
+    /* Without the final inversion while data arrives, like lfs_crc.*/
+    fw->crc = lfs_crc(fw->crc, data, n);
+    fw->info.crc = ~fw->crc;
+    if (fw->info.received == fw->info.size) {
+        fw->info.state = FWSTAGE_RECEIVED;
+    }
+    return (int)n;
+}
+
+bool fwstage_page_full(const fwstage_t *fw)
+{
+    return fw->fill == fw->page_size ||
+           (fw->fill > 0U && fw->info.state == FWSTAGE_RECEIVED);
+}
+
+int fwstage_flush(fwstage_t *fw)
+{
+    /* Offset of the buffered page from the bytes received so far.*/
+    flash_offset_t offset = fw_image_offset(fw) + fw->info.received - fw->fill;
+
+    if (fw->fill == 0U) {
+        return 0;
+    }
+    if (fw->prog(fw->context, offset, fw->page, fw->fill) != 0) {
+        fw_fail(fw);
+        return -1;
+    }
+    fw->fill = 0;
+    return 0;
+}
+
+int fwstage_verify(fwstage_t *fw, uint32_t crc)
+{
+    uint32_t check = 0xffffffffU;
+
+    if (fw->info.state != FWSTAGE_RECEIVED &&
+        fw->info.state != FWSTAGE_VERIFIED) {
+        return -1;
+    }
+    if (fwstage_flush(fw) != 0) {
+        return -1;
+    }
+
+    /* Read back, the page buffer is free once flushed.*/
+    for (uint32_t done = 0; done < fw->info.size;) {
+        uint32_t n = fw->info.size - done;
+        if (n > fw->page_size) {
+            n = fw->page_size;
+        }
+        if (fw->read(fw->context, fw_image_offset(fw) + done, fw->page, n) !=
+            0) {
+            fw_fail(fw);
+            return -1;
+        }
+        check = lfs_crc(check, fw->page, n);
+        done += n;
+    }
+    /* A wrong CRC from the host leaves the image to be verified again.*/
+    if (check != fw->crc) {
+        fw_fail(fw);
+        return -1;
+    }
+    if (~check != crc) {
+        return -1;
+    }
+    fw->info.state = FWSTAGE_VERIFIED;
+    return 0;
+}
+
+int fwstage_activate(fwstage_t *fw)
+{
+    fwstage_header_t hdr = {
+        .magic = FWSTAGE_MAGIC,
+        .size = fw->info.size,
+        .crc = fw->info.crc,
+    };
+
+    if (fw->info.state != FWSTAGE_VERIFIED) {
+        return -1;
+    }
+    hdr.header_crc = fw_header_crc(&hdr);
+    if (fw->prog(fw->context, fw->offset, &hdr, sizeof(hdr)) != 0) {
+        fw_fail(fw);
+        return -1;
+    }
+    fw->info.state = FWSTAGE_ACTIVE;
+    return 0;
+}
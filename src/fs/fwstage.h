@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include "hal.h"
+
+#include <stdint.h>
+
+#define FWSTAGE_MAGIC 0x31574d46U /* "FMW1" */
+
+/* First page of the partition, programmed last by activation. The
+   image follows in the next page. */
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t header_crc;
+} fwstage_header_t;
+
+typedef enum {
+    FWSTAGE_EMPTY,
+    FWSTAGE_RECEIVING,
+    FWSTAGE_RECEIVED,
+    FWSTAGE_VERIFIED,
+    FWSTAGE_ACTIVE,
+    FWSTAGE_FAILED,
+} fwstage_state_t;
+
+typedef struct {
+    fwstage_state_t state;
+    uint32_t size;
+    uint32_t received;
+    uint32_t crc;
+    uint32_t capacity; /* Largest image */
+} fwstage_info_t;
+
+/* Image streamed into a range of erased flash, CRC-32 (as zlib) of the
+   data is computed while it arrives and again from the flash when the
+   image is verified. */
+typedef struct {
+    flash_offset_t offset;
+    uint32_t capacity;
+    uint32_t page_size;
+    uint8_t *page;
+    uint32_t fill;
+    uint32_t crc;
+    fwstage_info_t info;
+    void *context;
+    int (*read)(void *context, flash_offset_t offset, void *data, size_t size);
+    int (*prog)(void *context,
+                flash_offset_t offset,
+                const void *data,
+                size_t size);
+} fwstage_t;
+
+/* Operations run by the fs thread */
+void fwstage_scan(fwstage_t *fw);
+int fwstage_begin(fwstage_t *fw, uint32_t size);
+/* Copies up to the end of the current page, returns the number of bytes
+   taken. fwstage_flush programs the page once it is full. */
+int fwstage_put(fwstage_t *fw, const void *data, unsigned size);
+bool fwstage_page_full(const fwstage_t *fw);
+int fwstage_flush(fwstage_t *fw);
+int fwstage_verify(fwstage_t *fw, uint32_t crc);
+int fwstage_activate(fwstage_t *fw);
+/* Bytes of flash to erase for an image */
+uint32_t fwstage_extent(const fwstage_t *fw, uint32_t size);
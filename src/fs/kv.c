@@ -0,0 +1,290 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+
+#include "kv.h"
+
+#include <string.h>
+
+/* The store is a log of records in a single file, each set appends one.
+   The latest record of every key is held in the RAM index, which is
+   written back as a new log when enough records are superseded. */
+
+static const char filename[] = "kv.log";
+static const char filename_tmp[] = "kv.tmp";
+
+struct kvRecord {
+    char key[KV_KEY_MAX];
+    uint8_t type;
+    uint8_t size;
+};
+
+typedef struct {
+    struct kvRecord record;
+    uint8_t value[KV_VALUE_MAX];
+} kv_entry_t;
+
+static kv_entry_t kv_index[KV_INDEX_SIZE];
+static MUTEX_DECL(kv_mutex);
+
+/* Bytes in the log and bytes of the records still in use */
+static uint32_t kv_log_size;
+static uint32_t kv_live_size;
+
+static uint32_t kv_hash(const char *key)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261U;
+    while (*key != '\0') {
+        hash ^= (uint8_t)*key++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* Returns the slot holding the key, or the empty slot for it, or NULL
+   if the index is full. */
+static kv_entry_t *kv_find(const char *key)
+{
+    uint32_t slot = kv_hash(key);
+
+    for (unsigned i = 0; i < KV_INDEX_SIZE; i++) {
+        kv_entry_t *entry = &kv_index[(slot + i) & (KV_INDEX_SIZE - 1U)];
+        if (entry->record.key[0] == '\0' ||
+            strcmp(entry->record.key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static unsigned kv_record_size(unsigned size)
+{
+    return sizeof(struct kvRecord) + size + sizeof(uint32_t);
+}
+
+/* Stores a record in the index, deleted keys keep their slot. */
+static void kv_update(kv_entry_t *entry,
+                      const struct kvRecord *record,
+                      const void *data)
+{
+    if (entry->record.key[0] != '\0' && entry->record.type != KV_TYPE_NONE) {
+        kv_live_size -= kv_record_size(entry->record.size);
+    }
+    if (record->type != KV_TYPE_NONE) {
+        kv_live_size += kv_record_size(record->size);
+    }
+
+    chMtxLock(&kv_mutex);
+    entry->record = *record;
+    memcpy(entry->value, data, record->size);
+    chMtxUnlock(&kv_mutex);
+}
+
+static int kv_write(lfs_t *lfs,
+                    lfs_file_t *file,
+                    const struct kvRecord *record,
+                    const void *data)
+{
+    uint8_t buffer[sizeof(struct kvRecord) + KV_VALUE_MAX + sizeof(uint32_t)];
+    unsigned size = kv_record_size(record->size);
+    uint32_t crc;
+
+    memcpy(buffer, record, sizeof(struct kvRecord));
+    memcpy(&buffer[sizeof(struct kvRecord)], data, record->size);
+    crc = lfs_crc(0xffffffffU, buffer, size - sizeof(uint32_t));
+    memcpy(&buffer[size - sizeof(uint32_t)], &crc, sizeof(uint32_t));
+
+    return lfs_file_write(lfs, file, buffer, size) == (lfs_ssize_t)size
+               ? 0
+               : LFS_ERR_IO;
+}
+
+bool kv_valid(const char *key, kv_type_t type, unsigned size)
+{
+    size_t len = strlen(key);
+    if (len == 0 || len >= KV_KEY_MAX || size > KV_VALUE_MAX) {
+        return false;
+    }
+
+    switch (type) {
+    case KV_TYPE_NONE:
+        return size == 0;
+    case KV_TYPE_U32:
+    case KV_TYPE_I32:
+    case KV_TYPE_FLOAT:
+        return size > 0 && size % sizeof(uint32_t) == 0;
+    case KV_TYPE_BLOB:
+        return true;
+    }
+    return false;
+}
+
+int kv_load(lfs_t *lfs, void *file_buffer)
+{
+    struct lfs_file_config fcfg = {
+        .buffer = file_buffer,
+    };
+    lfs_file_t file;
+    int err;
+
+    chMtxLock(&kv_mutex);
+    memset(kv_index, 0, sizeof(kv_index));
+    chMtxUnlock(&kv_mutex);
+    kv_log_size = 0;
+    kv_live_size = 0;
+
+    err = lfs_file_opencfg(lfs, &file, filename, LFS_O_RDONLY, &fcfg);
+    if (err != 0) {
+        return err == LFS_ERR_NOENT ? 0 : err;
+    }
+
+    while (true) {
+        struct kvRecord record;
+        uint8_t value[KV_VALUE_MAX];
+        uint32_t crc;
+        kv_entry_t *entry;
+
+        if (lfs_file_read(lfs, &file, &record, sizeof(record)) !=
+            (lfs_ssize_t)sizeof(record)) {
+            break;
+        }
+        record.key[KV_KEY_MAX - 1] = '\0';
+        if (!kv_valid(record.key, record.type, record.size) ||
+            lfs_file_read(lfs, &file, value, record.size) != record.size ||
+            lfs_file_read(lfs, &file, &crc, sizeof(crc)) !=
+                (lfs_ssize_t)sizeof(crc)) {
+            break;
+        }
+        if (crc != lfs_crc(lfs_crc(0xffffffffU, &record, sizeof(record)),
+                           value,
+                           record.size)) {
+            break;
+        }
+
+        entry = kv_find(record.key);
+        if (entry == NULL) {
+            break;
+        }
+        kv_update(entry, &record, value);
+        kv_log_size += kv_record_size(record.size);
+    }
+
+    /* A damaged tail is dropped by the next compaction.*/
+    if (kv_log_size != (uint32_t)lfs_file_size(lfs, &file)) {
+        kv_log_size += KV_COMPACT_SLACK;
+    }
+
+    return lfs_file_close(lfs, &file);
+}
+
+int kv_set(lfs_t *lfs,
+           void *file_buffer,
+           const char *key,
+           kv_type_t type,
+           const void *data,
+           unsigned size)
+{
+    struct lfs_file_config fcfg = {
+        .buffer = file_buffer,
+    };
+    struct kvRecord record = {
+        .type = type,
+        .size = size,
+    };
+    lfs_file_t file;
+    kv_entry_t *entry;
+    int err;
+
+    if (!kv_valid(key, type, size)) {
+        return LFS_ERR_INVAL;
+    }
+    entry = kv_find(key);
+    if (entry == NULL) {
+        return LFS_ERR_NOSPC;
+    }
+    strcpy(record.key, key);
+
+    err = lfs_file_opencfg(lfs,
+                           &file,
+                           filename,
+                           LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND,
+                           &fcfg);
+    if (err != 0) {
+        return err;
+    }
+    err = kv_write(lfs, &file, &record, data);
+    if (lfs_file_close(lfs, &file) != 0 && err == 0) {
+        err = LFS_ERR_IO;
+    }
+
+    /* The index follows the flash, a failed append leaves it unchanged.*/
+    if (err == 0) {
+        kv_update(entry, &record, data);
+        kv_log_size += kv_record_size(size);
+    }
+    return err;
+}
+
+bool kv_compact_needed(void)
+{
+    return kv_log_size >= kv_live_size + KV_COMPACT_SLACK;
+}
+
+int kv_compact(lfs_t *lfs, void *file_buffer)
+{
+    struct lfs_file_config fcfg = {
+        .buffer = file_buffer,
+    };
+    lfs_file_t file;
+    int err;
+
+    err = lfs_file_opencfg(lfs,
+                           &file,
+                           filename_tmp,
+                           LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC,
+                           &fcfg);
+    if (err != 0) {
+        return err;
+    }
+
+    /* The index only changes in the fs thread, no lock needed to read.*/
+    for (unsigned i = 0; i < KV_INDEX_SIZE && err == 0; i++) {
+        const kv_entry_t *entry = &kv_index[i];
+        if (entry->record.key[0] != '\0' &&
+            entry->record.type != KV_TYPE_NONE) {
+            err = kv_write(lfs, &file, &entry->record, entry->value);
+        }
+    }
+    if (lfs_file_close(lfs, &file) != 0 && err == 0) {
+        err = LFS_ERR_IO;
+    }
+
+    if (err == 0) {
+        err = lfs_rename(lfs, filename_tmp, filename);
+    }
+
+    /* On failure the next attempt waits for further updates.*/
+    kv_log_size = kv_live_size;
+    return err;
+}
+
+int kvGet(const char *key, kv_type_t type, void *data, unsigned size)
+{
+    int result = -1;
+    const kv_entry_t *entry;
+
+    chMtxLock(&kv_mutex);
+    entry = kv_find(key);
+    if (entry != NULL && entry->record.key[0] != '\0' &&
+        entry->record.type == type && type != KV_TYPE_NONE &&
+        entry->record.size <= size) {
+        memcpy(data, entry->value, entry->record.size);
+        result = entry->record.size;
+    }
+    chMtxUnlock(&kv_mutex);
+
+    return result;
+}
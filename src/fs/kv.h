@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include "lfs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of keys held in the RAM index, a power of two */
+#if !defined(KV_INDEX_SIZE)
+#define KV_INDEX_SIZE 32
+#endif
+
+/* Longest key including the terminating zero */
+#if !defined(KV_KEY_MAX)
+#define KV_KEY_MAX 12
+#endif
+
+/* Largest value in bytes */
+#if !defined(KV_VALUE_MAX)
+#define KV_VALUE_MAX 32
+#endif
+
+/* Superseded bytes in the log before it is compacted */
+#if !defined(KV_COMPACT_SLACK)
+#define KV_COMPACT_SLACK 2048
+#endif
+
+#if (KV_INDEX_SIZE & (KV_INDEX_SIZE - 1)) != 0
+#error "KV_INDEX_SIZE must be a power of two"
+#endif
+
+#if KV_VALUE_MAX > 255
+#error "KV_VALUE_MAX must fit into a record size byte"
+#endif
+
+/* Values of the numeric types are arrays of their element type */
+typedef enum {
+    KV_TYPE_NONE = 0,
+    KV_TYPE_U32,
+    KV_TYPE_I32,
+    KV_TYPE_FLOAT,
+    KV_TYPE_BLOB,
+} kv_type_t;
+
+/* Copies a value from the RAM index, never touches flash. Returns the
+   value size or -1 if the key is not set or has a different type. */
+int kvGet(const char *key, kv_type_t type, void *data, unsigned size);
+
+/* Store operations, run by the fs thread only, see fsKvSet() */
+
+bool kv_valid(const char *key, kv_type_t type, unsigned size);
+int kv_load(lfs_t *lfs, void *file_buffer);
+int kv_set(lfs_t *lfs,
+           void *file_buffer,
+           const char *key,
+           kv_type_t type,
+           const void *data,
+           unsigned size);
+bool kv_compact_needed(void);
+int kv_compact(lfs_t *lfs, void *file_buffer);
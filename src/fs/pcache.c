@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "pcache.h"
+
+#include <string.h>
+
+#define NO_PAGE UINT32_MAX
+
+static int pcache_find(const pcache_t *pc, uint32_t page)
+{
+    for (unsigned i = 0; i < PCACHE_PAGES; i++) {
+        if (pc->tag[i] == page) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* Slots for a read of count pages are adjacent so the flash is read with
+   a single command, the run used least recently is replaced. */
+static unsigned pcache_victim(const pcache_t *pc, unsigned count)
+{
+    unsigned best = 0;
+    uint32_t best_stamp = UINT32_MAX;
+
+    for (unsigned s = 0; s + count <= PCACHE_PAGES; s++) {
+        uint32_t newest = 0;
+        for (unsigned i = s; i < s + count; i++) {
+            if (pc->stamp[i] > newest) {
+                newest = pc->stamp[i];
+            }
+        }
+        if (newest < best_stamp) {
+            best_stamp = newest;
+            best = s;
+        }
+    }
+    return best;
+}
+
+static int pcache_fill(pcache_t *pc, uint32_t page)
+{
+    unsigned count = 1;
+    unsigned slot;
+
+    if (page == pc->last_page + 1U) {
+        unsigned left = pc->pages_per_block - page % pc->pages_per_block;
+
+        count = PCACHE_READAHEAD_PAGES < left ? PCACHE_READAHEAD_PAGES : left;
+        for (unsigned i = 1; i < count; i++) {
+            if (pcache_find(pc, page + i) >= 0) {
+                count = i;
+                break;
+            }
+        }
+    }
+
+    slot = pcache_victim(pc, count);
+    for (unsigned i = slot; i < slot + count; i++) {
+        pc->tag[i] = NO_PAGE;
+        pc->stamp[i] = 0;
+    }
+    if (pc->read(pc->context,
+                 (flash_offset_t)page * pc->page_size,
+                 &pc->data[slot * pc->page_size],
+                 count * pc->page_size) != 0) {
+        return -1;
+    }
+
+    pc->clock++;
+    for (unsigned i = 0; i < count; i++) {
+        pc->tag[slot + i] = page + i;
+        pc->stamp[slot + i] = pc->clock;
+    }
+    pc->stats.misses++;
+    pc->stats.readahead += count - 1U;
+    return (int)slot;
+}
+
+void pcache_init(pcache_t *pc)
+{
+    for (unsigned i = 0; i < PCACHE_PAGES; i++) {
+        pc->tag[i] = NO_PAGE;
+        pc->stamp[i] = 0;
+    }
+    pc->clock = 0;
+    pc->last_page = NO_PAGE;
+    memset(&pc->stats, 0, sizeof(pc->stats));
+}
+
+int pcache_read(pcache_t *pc, flash_offset_t offset, void *data, size_t size)
+{
+    uint8_t *p = data;
+
+    while (size > 0U) {
+        uint32_t page = offset / pc->page_size;
+        uint32_t off = offset % pc->page_size;
+        size_t n = pc->page_size - off < size ? pc->page_size - off : size;
+        int slot;
+
+        /* Large reads gain nothing from the cache.*/
+        if (off == 0U && size >= 2U * pc->page_size) {
+            n = size - size % pc->page_size;
+            if (pc->read(pc->context, offset, p, n) != 0) {
+                return -1;
+            }
+            pc->stats.bypass++;
+            pc->last_page = page + n / pc->page_size - 1U;
+        } else {
+            slot = pcache_find(pc, page);
+            if (slot >= 0) {
+                pc->stats.hits++;
+            } else {
+                slot = pcache_fill(pc, page);
+                if (slot < 0) {
+                    return -1;
+                }
+            }
+            memcpy(p, &pc->data[(unsigned)slot * pc->page_size + off], n);
+            pc->stamp[slot] = ++pc->clock;
+            pc->last_page = page;
+        }
+
+        offset += n;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+void pcache_invalidate(pcache_t *pc, flash_offset_t offset, size_t size)
+{
+    uint32_t first = offset / pc->page_size;
+    uint32_t last = (offset + size - 1U) / pc->page_size;
+
+    if (size == 0U) {
+        return;
+    }
+    for (unsigned i = 0; i < PCACHE_PAGES; i++) {
+        if (pc->tag[i] != NO_PAGE && pc->tag[i] >= first &&
+            pc->tag[i] <= last) {
+            pc->tag[i] = NO_PAGE;
+            pc->stamp[i] = 0;
+            pc->stats.invalidations++;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include "hal.h"
+
+#include <stdint.h>
+
+/* Flash pages held in RAM */
+#if !defined(PCACHE_PAGES)
+#define PCACHE_PAGES 8
+#endif
+
+/* Pages read at once when reads are sequential, 1 disables readahead */
+#if !defined(PCACHE_READAHEAD_PAGES)
+#define PCACHE_READAHEAD_PAGES 4
+#endif
+
+#if (PCACHE_READAHEAD_PAGES < 1) || (PCACHE_READAHEAD_PAGES > PCACHE_PAGES)
+#error "PCACHE_READAHEAD_PAGES must be 1..PCACHE_PAGES"
+#endif
+
+typedef struct {
+    uint32_t hits;          /* Pages copied from the cache */
+    uint32_t misses;        /* Flash reads filling the cache */
+    uint32_t readahead;     /* Pages read ahead of a miss */
+    uint32_t bypass;        /* Flash reads of several pages past the cache */
+    uint32_t invalidations; /* Pages dropped by program or erase */
+} pcache_stats_t;
+
+/* Least recently used pages in front of a flash read function. A miss
+   following the previous page reads up to PCACHE_READAHEAD_PAGES pages
+   of the same block with a single read. */
+typedef struct {
+    uint32_t page_size;
+    uint32_t pages_per_block;
+    uint8_t *data;
+    uint32_t tag[PCACHE_PAGES];
+    uint32_t stamp[PCACHE_PAGES];
+    uint32_t clock;
+    uint32_t last_page;
+    pcache_stats_t stats;
+    void *context;
+    int (*read)(void *context, flash_offset_t offset, void *data, size_t size);
+} pcache_t;
+
+/* Operations run by the fs thread */
+void pcache_init(pcache_t *pc);
+int pcache_read(pcache_t *pc, flash_offset_t offset, void *data, size_t size);
+void pcache_invalidate(pcache_t *pc, flash_offset_t offset, size_t size);
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ringlog.h"
+#include "lfs_util.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/* Record n is stored in page n modulo the number of pages. The sector
+   after the one being written is kept erased, so after a restart the
+   newest record is found by two binary searches, over the first records
+   of the sectors and over the records of the newest sector. A power loss
+   leaves at most one damaged page, which is skipped. */
+
+static uint32_t rl_pages(const ringlog_t *rl)
+{
+    return rl->sectors * rl->pages_per_sector;
+}
+
+static flash_offset_t rl_offset(const ringlog_t *rl, uint32_t seq)
+{
+    return rl->offset + (seq & (rl_pages(rl) - 1U)) * RINGLOG_RECORD_SIZE;
+}
+
+static uint32_t rl_crc(const ringlog_record_t *rec)
+{
+    return lfs_crc(0xffffffffU, rec, offsetof(ringlog_record_t, crc));
+}
+
+/* Reads the record in a page, false if it is not a valid record. */
+static bool rl_get(ringlog_t *rl, uint32_t page, ringlog_record_t *rec)
+{
+    if (rl->read(rl->context,
+                 rl->offset + page * RINGLOG_RECORD_SIZE,
+                 rec,
+                 sizeof(*rec)) != 0) {
+        return false;
+    }
+    return rec->crc == rl_crc(rec) && rec->size <= RINGLOG_DATA_SIZE &&
+           (rec->seq & (rl_pages(rl) - 1U)) == page;
+}
+
+static bool rl_first(ringlog_t *rl,
+                     uint32_t sector,
+                     ringlog_record_t *rec,
+                     uint32_t *seq)
+{
+    if (!rl_get(rl, sector * rl->pages_per_sector, rec)) {
+        return false;
+    }
+    *seq = rec->seq;
+    return true;
+}
+
+static bool rl_erased(const ringlog_record_t *rec)
+{
+    const uint8_t *p = (const uint8_t *)rec;
+    for (size_t i = 0; i < sizeof(*rec); i++) {
+        if (p[i] != 0xffU) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Records readable after the one before seq was written. */
+static uint32_t rl_live(const ringlog_t *rl, uint32_t seq)
+{
+    return (rl->sectors - 2U) * rl->pages_per_sector +
+           ((seq - 1U) & (rl->pages_per_sector - 1U)) + 1U;
+}
+
+int ringlog_scan(ringlog_t *rl, uint32_t *erase)
+{
+    ringlog_record_t rec;
+    uint32_t pps, base, seq, lo, hi;
+
+    rl->pages_per_sector = rl->sector_size / RINGLOG_RECORD_SIZE;
+    pps = rl->pages_per_sector;
+
+    /* Finding the newest sector, the sectors written since the first one
+       follow it with increasing sequence numbers.*/
+    if (rl_first(rl, 0, &rec, &base)) {
+        lo = 0;
+        hi = rl->sectors - 1U;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi + 1U) / 2U;
+            if (rl_first(rl, mid, &rec, &seq) && seq == base + mid * pps) {
+                lo = mid;
+            } else {
+                hi = mid - 1U;
+            }
+        }
+        base += lo * pps;
+    } else if (rl_first(rl, rl->sectors - 1U, &rec, &base)) {
+        /* The first sector is erased ahead of the last one.*/
+        lo = rl->sectors - 1U;
+    } else {
+        rl->next_seq = 0;
+        rl->count = 0;
+        *erase = 0;
+        return 0;
+    }
+
+    /* Finding the newest record in that sector.*/
+    {
+        uint32_t sector = lo;
+        lo = 0;
+        hi = pps - 1U;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi + 1U) / 2U;
+            if (rl_get(rl, sector * pps + mid, &rec) &&
+                rec.seq == base + mid) {
+                lo = mid;
+            } else {
+                hi = mid - 1U;
+            }
+        }
+    }
+    rl->next_seq = base + lo + 1U;
+
+    /* A page damaged by a power loss can not be written again, the log
+       continues in the next sector.*/
+    if ((rl->next_seq & (pps - 1U)) != 0U) {
+        uint32_t page = rl->next_seq & (rl_pages(rl) - 1U);
+        if (rl->read(rl->context,
+                     rl->offset + page * RINGLOG_RECORD_SIZE,
+                     &rec,
+                     sizeof(rec)) != 0) {
+            return -1;
+        }
+        if (!rl_erased(&rec)) {
+            rl->next_seq = (rl->next_seq + pps) & ~(pps - 1U);
+        }
+    }
+
+    /* The erase ahead may have been interrupted, it is repeated.*/
+    if ((rl->next_seq & (pps - 1U)) == 0U) {
+        *erase = ringlog_sector(rl, rl->next_seq);
+    } else {
+        *erase = (ringlog_sector(rl, rl->next_seq) + 1U) & (rl->sectors - 1U);
+    }
+
+    rl->count = rl_live(rl, rl->next_seq);
+    if (rl->count > rl->next_seq) {
+        rl->count = rl->next_seq;
+    }
+    return 1;
+}
+
+int ringlog_append(ringlog_t *rl,
+                   const void *data,
+                   unsigned size,
+                   uint32_t *erase)
+{
+    ringlog_record_t rec;
+    uint32_t seq = rl->next_seq;
+    uint32_t live;
+
+    if (size > RINGLOG_DATA_SIZE) {
+        return -1;
+    }
+
+    rec.seq = seq;
+    rec.size = (uint16_t)size;
+    rec.reserved = 0xffffU;
+    memcpy(rec.data, data, size);
+    memset(&rec.data[size], 0xff, RINGLOG_DATA_SIZE - size);
+    rec.crc = rl_crc(&rec);
+
+    if (rl->prog(rl->context, rl_offset(rl, seq), &rec, sizeof(rec)) != 0) {
+        return -1;
+    }
+
+    rl->next_seq = seq + 1U;
+    live = rl_live(rl, rl->next_seq);
+    rl->count = rl->count < live ? rl->count + 1U : live;
+
+    /* Starting a sector, the next one is erased ahead.*/
+    if ((seq & (rl->pages_per_sector - 1U)) == 0U) {
+        *erase = (ringlog_sector(rl, seq) + 1U) & (rl->sectors - 1U);
+        return 1;
+    }
+    return 0;
+}
+
+int ringlog_read(ringlog_t *rl, uint32_t seq, void *data, unsigned size)
+{
+    ringlog_record_t rec;
+    uint32_t page = seq & (rl_pages(rl) - 1U);
+
+    if (rl->next_seq - seq - 1U >= rl->count) {
+        return -1;
+    }
+    if (!rl_get(rl, page, &rec) || rec.seq != seq) {
+        return -1;
+    }
+
+    memcpy(data, rec.data, size < rec.size ? size : rec.size);
+    return rec.size;
+}
+
+uint32_t ringlog_sector(const ringlog_t *rl, uint32_t seq)
+{
+    return (seq & (rl_pages(rl) - 1U)) / rl->pages_per_sector;
+}
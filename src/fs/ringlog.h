@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include "hal.h"
+
+#include <stdint.h>
+
+/* One record per flash page */
+#define RINGLOG_RECORD_SIZE 256U
+#define RINGLOG_DATA_SIZE (RINGLOG_RECORD_SIZE - 3U * sizeof(uint32_t))
+
+typedef struct {
+    uint32_t seq;
+    uint16_t size;
+    uint16_t reserved;
+    uint8_t data[RINGLOG_DATA_SIZE];
+    uint32_t crc;
+} ringlog_record_t;
+
+/* Log in a range of sectors, records are placed by sequence number so
+   the record of a sequence number can be found without an index. */
+typedef struct {
+    flash_offset_t offset;
+    uint32_t sector_size;
+    uint32_t sectors;
+    uint32_t pages_per_sector;
+    uint32_t next_seq;
+    uint32_t count;
+    void *context;
+    int (*read)(void *context, flash_offset_t offset, void *data, size_t size);
+    int (*prog)(void *context,
+                flash_offset_t offset,
+                const void *data,
+                size_t size);
+} ringlog_t;
+
+/* Operations run by the fs thread, sectors are relative to the log. The
+   sector returned in erase must be erased before the log reaches it. */
+int ringlog_scan(ringlog_t *rl, uint32_t *erase);
+int ringlog_append(ringlog_t *rl,
+                   const void *data,
+                   unsigned size,
+                   uint32_t *erase);
+int ringlog_read(ringlog_t *rl, uint32_t seq, void *data, unsigned size);
+uint32_t ringlog_sector(const ringlog_t *rl, uint32_t seq);
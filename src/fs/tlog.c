@@ -0,0 +1,588 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "tlog.h"
+
+#include <string.h>
+
+/* Records of increasing time are appended to a data file. Every
+   TLOG_INDEX_INTERVAL records the time is also appended to an index file,
+   so entry n holds the time of record n * TLOG_INDEX_INTERVAL. A query
+   finds its first record with a binary search over the index and then
+   over the records of one interval, instead of reading the whole log.
+
+   littlefs commits a file on close, so after a power loss the index can
+   only miss entries or hold entries of records that were not committed.
+   Both show up as a wrong entry count and the index is fixed before it
+   is used next.
+
+   A full data file is renamed together with its index and replaces the
+   previous old pair, queries run over the old records and then the
+   current ones. The old index is removed first, an old data file left
+   without one after a power loss is searched as a whole. */
+
+static const char filename[] = "tlog.dat";
+static const char filename_index[] = "tlog.idx";
+static const char filename_old[] = "tlog.dat.1";
+static const char filename_index_old[] = "tlog.idx.1";
+
+typedef struct {
+    uint32_t time;
+    int32_t value[TLOG_CHANNELS];
+} tlog_record_t;
+
+#define QUERY_START UINT32_MAX
+#define QUERY_DONE (UINT32_MAX - 1U)
+
+/* Entries read and written at a time while rebuilding */
+#define REBUILD_BATCH 16U
+
+static uint32_t tlog_records;
+static uint32_t tlog_entries;
+static uint32_t tlog_old_records;
+static uint32_t tlog_old_entries;
+static uint32_t tlog_last_time;
+static bool tlog_torn;
+
+static uint32_t tlog_entries_for(uint32_t records)
+{
+    return (records + TLOG_INDEX_INTERVAL - 1U) / TLOG_INDEX_INTERVAL;
+}
+
+static int tlog_open(lfs_t *lfs,
+                     lfs_file_t *file,
+                     const char *name,
+                     int flags,
+                     void *file_buffer)
+{
+    struct lfs_file_config fcfg = {
+        .buffer = file_buffer,
+    };
+    return lfs_file_opencfg(lfs, file, name, flags, &fcfg);
+}
+
+static int tlog_read_at(lfs_t *lfs,
+                        lfs_file_t *file,
+                        lfs_off_t offset,
+                        void *data,
+                        lfs_size_t size)
+{
+    if (lfs_file_seek(lfs, file, (lfs_soff_t)offset, LFS_SEEK_SET) < 0 ||
+        lfs_file_read(lfs, file, data, size) != (lfs_ssize_t)size) {
+        return LFS_ERR_IO;
+    }
+    return 0;
+}
+
+static int tlog_time(lfs_t *lfs,
+                     lfs_file_t *file,
+                     uint32_t record,
+                     uint32_t *time)
+{
+    return tlog_read_at(
+        lfs, file, record * sizeof(tlog_record_t), time, sizeof(*time));
+}
+
+int tlog_load(lfs_t *lfs, void *file_buffer)
+{
+    struct lfs_info info;
+    lfs_file_t file;
+    lfs_soff_t size;
+    int err;
+
+    tlog_records = 0;
+    tlog_entries = 0;
+    tlog_old_records = 0;
+    tlog_old_entries = 0;
+    tlog_last_time = 0;
+    tlog_torn = false;
+
+    /* A torn record of the old file is left out.*/
+    if (lfs_stat(lfs, filename_old, &info) == 0) {
+        tlog_old_records = info.size / sizeof(tlog_record_t);
+    }
+    if (lfs_stat(lfs, filename_index_old, &info) == 0) {
+        tlog_old_entries = info.size / sizeof(uint32_t);
+    }
+    if (tlog_old_records > 0U) {
+        err = tlog_open(lfs, &file, filename_old, LFS_O_RDONLY, file_buffer);
+        if (err == 0) {
+            err = tlog_time(
+                lfs, &file, tlog_old_records - 1U, &tlog_last_time);
+            lfs_file_close(lfs, &file);
+        }
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    err = tlog_open(lfs, &file, filename, LFS_O_RDONLY, file_buffer);
+    if (err == 0) {
+        size = lfs_file_size(lfs, &file);
+        if (size > 0) {
+            tlog_records = (uint32_t)size / sizeof(tlog_record_t);
+            tlog_torn = (uint32_t)size % sizeof(tlog_record_t) != 0U;
+        }
+        if (tlog_records > 0U &&
+            tlog_time(lfs, &file, tlog_records - 1U, &tlog_last_time) != 0) {
+            err = LFS_ERR_IO;
+        }
+        lfs_file_close(lfs, &file);
+    } else if (err == LFS_ERR_NOENT) {
+        err = 0;
+    }
+
+    if (lfs_stat(lfs, filename_index, &info) == 0) {
+        tlog_entries = info.size / sizeof(uint32_t);
+    }
+    return err;
+}
+
+bool tlog_rebuild_needed(void)
+{
+    return tlog_entries != tlog_entries_for(tlog_records);
+}
+
+int tlog_rebuild(lfs_t *lfs, void *file_buffer)
+{
+    uint32_t expected = tlog_entries_for(tlog_records);
+    lfs_file_t file;
+    int err;
+
+    if (tlog_entries > expected) {
+        err = tlog_open(lfs,
+                        &file,
+                        filename_index,
+                        LFS_O_WRONLY | LFS_O_CREAT,
+                        file_buffer);
+        if (err != 0) {
+            return err;
+        }
+        err = lfs_file_truncate(lfs, &file, expected * sizeof(uint32_t));
+        if (lfs_file_close(lfs, &file) != 0 && err == 0) {
+            err = LFS_ERR_IO;
+        }
+        if (err != 0) {
+            return err;
+        }
+        tlog_entries = expected;
+    }
+
+    /* Only one file is open at a time, they share the file buffer.*/
+    while (tlog_entries < expected) {
+        uint32_t times[REBUILD_BATCH];
+        unsigned n = 0;
+
+        err = tlog_open(lfs, &file, filename, LFS_O_RDONLY, file_buffer);
+        if (err != 0) {
+            return err;
+        }
+        while (n < REBUILD_BATCH && tlog_entries + n < expected && err == 0) {
+            err = tlog_time(lfs,
+                            &file,
+                            (tlog_entries + n) * TLOG_INDEX_INTERVAL,
+                            &times[n]);
+            n++;
+        }
+        lfs_file_close(lfs, &file);
+        if (err != 0) {
+            return err;
+        }
+
+        err = tlog_open(lfs,
+                        &file,
+                        filename_index,
+                        LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND,
+                        file_buffer);
+        if (err != 0) {
+            return err;
+        }
+        if (lfs_file_write(lfs, &file, times, n * sizeof(uint32_t)) !=
+            (lfs_ssize_t)(n * sizeof(uint32_t))) {
+            err = LFS_ERR_IO;
+        }
+        if (lfs_file_close(lfs, &file) != 0 && err == 0) {
+            err = LFS_ERR_IO;
+        }
+        if (err != 0) {
+            return err;
+        }
+        tlog_entries += n;
+    }
+    return 0;
+}
+
+/* The current file becomes the old one, the previous old file is
+   dropped. The index is complete.*/
+static int tlog_rotate(lfs_t *lfs)
+{
+    int err = lfs_remove(lfs, filename_index_old);
+
+    if (err != 0 && err != LFS_ERR_NOENT) {
+        return err;
+    }
+    tlog_old_entries = 0;
+
+    err = lfs_rename(lfs, filename, filename_old);
+    if (err != 0) {
+        return err;
+    }
+    tlog_old_records = tlog_records;
+    tlog_records = 0;
+    tlog_torn = false;
+
+    /* Otherwise the index left over is truncated by the next rebuild.*/
+    err = lfs_rename(lfs, filename_index, filename_index_old);
+    if (err == 0) {
+        tlog_old_entries = tlog_entries;
+        tlog_entries = 0;
+    }
+    return err == LFS_ERR_NOENT ? 0 : err;
+}
+
+int tlog_append(lfs_t *lfs,
+                void *file_buffer,
+                uint32_t time,
+                const int32_t value[TLOG_CHANNELS])
+{
+    tlog_record_t record;
+    lfs_file_t file;
+    int err;
+
+    if (tlog_records + tlog_old_records > 0U && time < tlog_last_time) {
+        return LFS_ERR_INVAL;
+    }
+    if (tlog_rebuild_needed()) {
+        err = tlog_rebuild(lfs, file_buffer);
+        if (err != 0) {
+            return err;
+        }
+    }
+    if (tlog_records >= TLOG_FILE_RECORDS) {
+        err = tlog_rotate(lfs);
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    record.time = time;
+    memcpy(record.value, value, sizeof(record.value));
+
+    err = tlog_open(lfs,
+                    &file,
+                    filename,
+                    LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND,
+                    file_buffer);
+    if (err != 0) {
+        return err;
+    }
+    if (tlog_torn) {
+        err = lfs_file_truncate(
+            lfs, &file, tlog_records * sizeof(tlog_record_t));
+    }
+    if (err == 0 && lfs_file_write(lfs, &file, &record, sizeof(record)) !=
+                        (lfs_ssize_t)sizeof(record)) {
+        err = LFS_ERR_IO;
+    }
+    if (lfs_file_close(lfs, &file) != 0 && err == 0) {
+        err = LFS_ERR_IO;
+    }
+    if (err != 0) {
+        return err;
+    }
+    tlog_records++;
+    tlog_last_time = time;
+    tlog_torn = false;
+
+    /* A failed index update is repaired by the next rebuild.*/
+    if (tlog_entries + 1U == tlog_entries_for(tlog_records) &&
+        tlog_open(lfs,
+                  &file,
+                  filename_index,
+                  LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND,
+                  file_buffer) == 0) {
+        err = lfs_file_write(lfs, &file, &time, sizeof(time)) ==
+                      (lfs_ssize_t)sizeof(time)
+                  ? 0
+                  : LFS_ERR_IO;
+        if (lfs_file_close(lfs, &file) == 0 && err == 0) {
+            tlog_entries++;
+        }
+    }
+    return 0;
+}
+
+/* Returns the first record of one file with a time of at least from,
+   records if there is none. Without entries the whole file is
+   searched. */
+static int tlog_find_in(lfs_t *lfs,
+                        void *file_buffer,
+                        const char *name,
+                        const char *name_index,
+                        uint32_t records,
+                        uint32_t entries,
+                        uint32_t from,
+                        uint32_t *record)
+{
+    uint32_t lo = 0, hi = records;
+    lfs_file_t file;
+    int err = 0;
+
+    /* The interval holding the record.*/
+    if (entries > 0U) {
+        uint32_t first = 0, last = entries;
+
+        err = tlog_open(lfs, &file, name_index, LFS_O_RDONLY, file_buffer);
+        if (err != 0) {
+            return err;
+        }
+        while (first < last && err == 0) {
+            uint32_t mid = (first + last) / 2U;
+            uint32_t time = 0;
+
+            err = tlog_read_at(
+                lfs, &file, mid * sizeof(uint32_t), &time, sizeof(time));
+            if (time < from) {
+                first = mid + 1U;
+            } else {
+                last = mid;
+            }
+        }
+        lfs_file_close(lfs, &file);
+        if (err != 0) {
+            return err;
+        }
+        lo = first > 0U ? (first - 1U) * TLOG_INDEX_INTERVAL : 0U;
+        if (first * TLOG_INDEX_INTERVAL < hi) {
+            hi = first * TLOG_INDEX_INTERVAL;
+        }
+    }
+
+    err = tlog_open(lfs, &file, name, LFS_O_RDONLY, file_buffer);
+    if (err != 0) {
+        *record = 0;
+        return err == LFS_ERR_NOENT ? 0 : err;
+    }
+    while (lo < hi && err == 0) {
+        uint32_t mid = (lo + hi) / 2U;
+        uint32_t time = 0;
+
+        err = tlog_time(lfs, &file, mid, &time);
+        if (time < from) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+    lfs_file_close(lfs, &file);
+
+    *record = lo;
+    return err;
+}
+
+/* Returns the first record with a time of at least from, counted over
+   the old and the current file. */
+static int tlog_find(lfs_t *lfs,
+                     void *file_buffer,
+                     uint32_t from,
+                     uint32_t *record)
+{
+    uint32_t old_entries =
+        tlog_old_entries == tlog_entries_for(tlog_old_records)
+            ? tlog_old_entries
+            : 0U;
+    int err = 0;
+
+    *record = 0;
+    if (tlog_old_records > 0U) {
+        err = tlog_find_in(lfs,
+                           file_buffer,
+                           filename_old,
+                           filename_index_old,
+                           tlog_old_records,
+                           old_entries,
+                           from,
+                           record);
+        if (err != 0 || *record < tlog_old_records) {
+            return err;
+        }
+    }
+
+    err = tlog_find_in(lfs,
+                       file_buffer,
+                       filename,
+                       filename_index,
+                       tlog_records,
+                       tlog_rebuild_needed() ? 0U : tlog_entries,
+                       from,
+                       record);
+    *record += tlog_old_records;
+    return err;
+}
+
+/* Opens the file holding a record counted over both files, at the
+   record. end is the first record past the file. */
+static int tlog_open_record(lfs_t *lfs,
+                            lfs_file_t *file,
+                            void *file_buffer,
+                            uint32_t record,
+                            uint32_t *end)
+{
+    const char *name = filename;
+    uint32_t first = tlog_old_records;
+    int err;
+
+    *end = tlog_old_records + tlog_records;
+    if (record < tlog_old_records) {
+        name = filename_old;
+        first = 0;
+        *end = tlog_old_records;
+    }
+    err = tlog_open(lfs, file, name, LFS_O_RDONLY, file_buffer);
+    if (err == 0 &&
+        lfs_file_seek(lfs,
+                      file,
+                      (lfs_soff_t)((record - first) * sizeof(tlog_record_t)),
+                      LFS_SEEK_SET) < 0) {
+        lfs_file_close(lfs, file);
+        err = LFS_ERR_IO;
+    }
+    return err;
+}
+
+static void tlog_row_start(tlog_query_t *q, uint32_t time)
+{
+    memset(&q->acc, 0, sizeof(q->acc));
+    memset(q->sum, 0, sizeof(q->sum));
+    q->acc.time = time;
+}
+
+static void tlog_row_add(tlog_query_t *q, const tlog_record_t *record)
+{
+    for (unsigned ch = 0; ch < TLOG_CHANNELS; ch++) {
+        int32_t v = record->value[ch];
+
+        if ((q->mask & (1U << ch)) == 0U) {
+            continue;
+        }
+        if (q->acc.count == 0U || v < q->acc.min[ch]) {
+            q->acc.min[ch] = v;
+        }
+        if (q->acc.count == 0U || v > q->acc.max[ch]) {
+            q->acc.max[ch] = v;
+        }
+        q->sum[ch] += v;
+    }
+    q->acc.count++;
+}
+
+static void tlog_row_finish(tlog_query_t *q, tlog_row_t *row)
+{
+    *row = q->acc;
+    for (unsigned ch = 0; ch < TLOG_CHANNELS; ch++) {
+        if ((q->mask & (1U << ch)) != 0U) {
+            row->avg[ch] = (int32_t)(q->sum[ch] / (int64_t)q->acc.count);
+        }
+    }
+    q->acc.count = 0;
+}
+
+int tlog_query(lfs_t *lfs,
+               void *file_buffer,
+               tlog_query_t *q,
+               tlog_row_t *rows,
+               unsigned count)
+{
+    tlog_record_t record;
+    lfs_file_t file;
+    unsigned n = 0;
+    uint32_t end;
+    int err;
+
+    if (q->record == QUERY_DONE) {
+        return 0;
+    }
+    if (q->record == QUERY_START) {
+        if (tlog_rebuild_needed()) {
+            /* Without the index the whole log is searched.*/
+            tlog_rebuild(lfs, file_buffer);
+        }
+        err = tlog_find(lfs, file_buffer, q->from, &q->record);
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    err = tlog_open_record(lfs, &file, file_buffer, q->record, &end);
+    if (err != 0) {
+        if (err == LFS_ERR_NOENT) {
+            q->record = QUERY_DONE;
+            return 0;
+        }
+        return err;
+    }
+
+    while (n < count) {
+        /* From the old file on to the current one.*/
+        if (q->record == end && end == tlog_old_records &&
+            tlog_records > 0U) {
+            lfs_file_close(lfs, &file);
+            err = tlog_open_record(lfs, &file, file_buffer, q->record, &end);
+            if (err != 0) {
+                return err;
+            }
+        }
+        if (q->record >= tlog_old_records + tlog_records ||
+            lfs_file_read(lfs, &file, &record, sizeof(record)) !=
+                (lfs_ssize_t)sizeof(record) ||
+            record.time > q->to) {
+            if (q->acc.count > 0U) {
+                tlog_row_finish(q, &rows[n++]);
+            }
+            q->record = QUERY_DONE;
+            break;
+        }
+
+        if (q->bucket == 0U) {
+            tlog_row_start(q, record.time);
+            tlog_row_add(q, &record);
+            tlog_row_finish(q, &rows[n++]);
+        } else {
+            uint32_t start =
+                q->from + (record.time - q->from) / q->bucket * q->bucket;
+
+            if (q->acc.count > 0U && q->acc.time != start) {
+                tlog_row_finish(q, &rows[n++]);
+                /* The record starts the next call.*/
+                if (n == count) {
+                    break;
+                }
+            }
+            if (q->acc.count == 0U) {
+                tlog_row_start(q, start);
+            }
+            tlog_row_add(q, &record);
+        }
+        q->record++;
+    }
+    lfs_file_close(lfs, &file);
+
+    return (int)n;
+}
+
+void tlogQueryInit(tlog_query_t *q,
+                   uint32_t from,
+                   uint32_t to,
+                   uint32_t mask,
+                   uint32_t bucket)
+{
+    memset(q, 0, sizeof(*q));
+    q->from = from;
+    q->to = to;
+    q->mask = mask;
+    q->bucket = bucket;
+    q->record = QUERY_START;
+}
+
+uint32_t tlogGetLastTime(void) { return tlog_last_time; }
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include "lfs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Channels in one telemetry record */
+#if !defined(TLOG_CHANNELS)
+#define TLOG_CHANNELS 10
+#endif
+
+/* Records per entry of the sparse index, a power of two */
+#if !defined(TLOG_INDEX_INTERVAL)
+#define TLOG_INDEX_INTERVAL 64
+#endif
+
+/* Records in the current file before it replaces the old one. The log
+   keeps between this and twice as many records of 4 + 4 * TLOG_CHANNELS
+   bytes, plus an index entry of 4 bytes per TLOG_INDEX_INTERVAL. The
+   default takes up to 736 KiB, about 5.7 to 11 days at one record a
+   minute. */
+#if !defined(TLOG_FILE_RECORDS)
+#define TLOG_FILE_RECORDS 8192
+#endif
+
+#if (TLOG_INDEX_INTERVAL & (TLOG_INDEX_INTERVAL - 1)) != 0
+#error "TLOG_INDEX_INTERVAL must be a power of two"
+#endif
+
+#if TLOG_FILE_RECORDS % TLOG_INDEX_INTERVAL != 0
+#error "TLOG_FILE_RECORDS must be a multiple of TLOG_INDEX_INTERVAL"
+#endif
+
+#if TLOG_CHANNELS > 32
+#error "TLOG_CHANNELS must fit into a channel mask"
+#endif
+
+/* A record or a bucket of records, channels outside the query mask are
+   left zero. Without a bucket min, max and avg hold the record value. */
+typedef struct {
+    uint32_t time;
+    uint32_t count;
+    int32_t min[TLOG_CHANNELS];
+    int32_t max[TLOG_CHANNELS];
+    int32_t avg[TLOG_CHANNELS];
+} tlog_row_t;
+
+/* Query state kept by the caller between calls of fsTlogQuery() */
+typedef struct {
+    uint32_t from;
+    uint32_t to;
+    uint32_t mask;
+    uint32_t bucket;
+    uint32_t record;
+    tlog_row_t acc;
+    int64_t sum[TLOG_CHANNELS];
+} tlog_query_t;
+
+/* Rows for records with from <= time <= to, grouped into buckets of
+   bucket time units starting at from if bucket is not zero. */
+void tlogQueryInit(tlog_query_t *q,
+                   uint32_t from,
+                   uint32_t to,
+                   uint32_t mask,
+                   uint32_t bucket);
+
+/* Time of the last record, 0 for an empty log. Valid once the fs is
+   ready. */
+uint32_t tlogGetLastTime(void);
+
+/* Log operations, run by the fs thread only, see fsTlogAppend() */
+
+int tlog_load(lfs_t *lfs, void *file_buffer);
+int tlog_append(lfs_t *lfs,
+                void *file_buffer,
+                uint32_t time,
+                const int32_t value[TLOG_CHANNELS]);
+int tlog_query(lfs_t *lfs,
+               void *file_buffer,
+               tlog_query_t *q,
+               tlog_row_t *rows,
+               unsigned count);
+bool tlog_rebuild_needed(void);
+int tlog_rebuild(lfs_t *lfs, void *file_buffer);
@@ -6,6 +6,7 @@
 #include "hal.h"
 
 #include "led.h"
+#include "task.h"
 
 #include <stdbool.h>
 
@@ -19,38 +20,34 @@ typedef struct {
 } led_t;
 
 struct _leds_t {
+    task_t task;
     size_t count;
     led_t leds[];
 };
 
-static THD_FUNCTION(ThreadLeds, arg)
+static void leds_step(void *arg)
 {
     leds_t *leds = (leds_t *)arg;
-    systime_t sleepuntil = chVTGetSystemTimeX();
-    chRegSetThreadName("leds");
-    while (true) {
-        sleepuntil += TIME_MS2I(100);
-        for (size_t i = 0; i < leds->count; i++) {
-            if (leds->leds[i].count == 0) {
-                if (!leds->leds[i].state) {
-                    if (leds->leds[i].on > 0) {
-                        palSetPad(leds->leds[i].port, leds->leds[i].pad);
-                    }
-                    leds->leds[i].count = leds->leds[i].on;
-                    leds->leds[i].state = true;
-                } else {
-                    if (leds->leds[i].off > 0) {
-                        palClearPad(leds->leds[i].port, leds->leds[i].pad);
-                    }
-                    leds->leds[i].count = leds->leds[i].off;
-                    leds->leds[i].state = false;
+
+    for (size_t i = 0; i < leds->count; i++) {
+        if (leds->leds[i].count == 0) {
+            if (!leds->leds[i].state) {
+                if (leds->leds[i].on > 0) {
+                    palSetPad(leds->leds[i].port, leds->leds[i].pad);
                 }
+                leds->leds[i].count = leds->leds[i].on;
+                leds->leds[i].state = true;
+            } else {
+                if (leds->leds[i].off > 0) {
+                    palClearPad(leds->leds[i].port, leds->leds[i].pad);
+                }
+                leds->leds[i].count = leds->leds[i].off;
+                leds->leds[i].state = false;
             }
-            if (leds->leds[i].count > 0) {
-                leds->leds[i].count--;
-            }
         }
-        chThdSleepUntil(sleepuntil);
+        if (leds->leds[i].count > 0) {
+            leds->leds[i].count--;
+        }
     }
 }
 
@@ -69,7 +66,16 @@ leds_t *ledStart(
         leds->leds[i].state = 0;
     }
 
-    chThdCreateStatic(wsp, size, prio, ThreadLeds, leds);
+    leds->task = (task_t){
+        .name = "leds",
+        .period = TIME_MS2I(100),
+        .offset = TIME_MS2I(3),
+        .budget_us = 1000,
+        .prio = prio,
+        .run = leds_step,
+        .arg = leds,
+    };
+    taskCreate(&leds->task, wsp, size);
 
     return leds;
 }
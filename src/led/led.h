@@ -13,6 +13,7 @@ typedef struct {
 
 typedef struct _leds_t leds_t;
 
+/* Blink pattern in steps of 100 ms, run as a periodic task */
 leds_t *ledStart(
     void *wsp, size_t size, tprio_t prio, const ledpad_t *pads, size_t n_pads);
 void ledSet(leds_t *leds, int n, uint8_t on, uint8_t off);
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "power.h"
+
+#include <string.h>
+
+static power_stats_t power_stats;
+static systime_t power_woken;
+
+/* Sleep mode only stops the core clock, DMA and the I2C, SPI, USB and
+   timer peripherals keep running, so transfers in flight complete and
+   their interrupts end the sleep. STOP mode would also stop the system
+   timer and the USB clock. */
+void powerIdle(void)
+{
+    systime_t slept;
+    systime_t woken;
+    sysinterval_t asleep;
+
+    /* The interrupt that ends the sleep stays pending while masked and is
+       served once the time is accounted.*/
+    __disable_irq();
+    slept = chVTGetSystemTimeX();
+    __DSB();
+    __WFI();
+    woken = chVTGetSystemTimeX();
+    asleep = chTimeDiffX(slept, woken);
+    power_stats.awake += chTimeDiffX(power_woken, slept);
+    power_stats.asleep += asleep;
+    if (asleep > power_stats.longest) {
+        power_stats.longest = asleep;
+    }
+    power_stats.sleeps++;
+    power_woken = woken;
+    __enable_irq();
+}
+
+void powerGetStats(power_stats_t *stats)
+{
+    chSysLock();
+    *stats = power_stats;
+    chSysUnlock();
+}
+
+void powerResetStats(void)
+{
+    chSysLock();
+    memset(&power_stats, 0, sizeof(power_stats));
+    power_woken = chVTGetSystemTimeX();
+    chSysUnlock();
+}
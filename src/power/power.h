@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/* Times in system ticks, counted by the idle thread */
+typedef struct {
+    uint32_t sleeps;
+    uint64_t awake;
+    uint64_t asleep;
+    uint32_t longest;
+} power_stats_t;
+
+/* Called from the idle loop hook, sleeps with WFI until the next
+   interrupt. The system timer wakes the core at the next deadline. */
+void powerIdle(void);
+void powerGetStats(power_stats_t *stats);
+void powerResetStats(void);
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ccm.h"
+#include "frame.h"
+#include "fs.h"
+#include "rpc.h"
+#include "tstream.h"
+
+#include <string.h>
+
+/* Longest file name accepted */
+#define RPC_NAME_MAX 32U
+
+#define RPC_EVT_USB EVENT_MASK(0)
+
+static SerialUSBDriver *rpc_sdu;
+static thread_t *rpc_fs;
+static frame_decoder_t rpc_decoder CCM_BSS;
+static rpc_stats_t rpc_stats;
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/* Copies a string argument and terminates it */
+static bool rpc_string(char *dst, size_t max, const uint8_t *src, size_t len)
+{
+    if (len == 0U || len >= max || memchr(src, '\0', len) != NULL) {
+        return false;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return true;
+}
+
+/* Fills out with the response data, returns its size or a negative
+   status. */
+static int rpc_call(uint8_t command,
+                    const uint8_t *in,
+                    size_t size,
+                    uint8_t *out,
+                    size_t max)
+{
+    char name[RPC_NAME_MAX];
+    int n;
+
+    switch (command) {
+    case RPC_PING:
+        if (size + 4U > max) {
+            return -RPC_ERR_ARGUMENT;
+        }
+        put_u32(out,
+                (uint32_t)(chVTGetTimeStamp() * 1000000U /
+                           CH_CFG_ST_FREQUENCY));
+        memcpy(&out[4], in, size);
+        return (int)(size + 4U);
+    case RPC_KV_GET:
+        if (size < 2U || !rpc_string(name, KV_KEY_MAX, &in[1], size - 1U)) {
+            return -RPC_ERR_ARGUMENT;
+        }
+        n = kvGet(name, (kv_type_t)in[0], out, max);
+        return n >= 0 ? n : -RPC_ERR_FAILED;
+    case RPC_KV_SET:
+        if (size < 2U || size < 2U + in[1] ||
+            !rpc_string(name, KV_KEY_MAX, &in[2], in[1])) {
+            return -RPC_ERR_ARGUMENT;
+        }
+        n = fsKvSet(rpc_fs,
+                    name,
+                    (kv_type_t)in[0],
+                    &in[2U + in[1]],
+                    size - 2U - in[1]);
+        return n >= 0 ? 0 : -RPC_ERR_FAILED;
+    case RPC_TELEMETRY_READ:
+        if (size != 2U || in[0] + in[1] > TSTREAM_CHANNELS ||
+            4U * in[1] > max) {
+            return -RPC_ERR_ARGUMENT;
+        }
+        for (unsigned i = 0; i < in[1]; i++) {
+            put_u32(&out[4U * i], (uint32_t)tstreamGet(in[0] + i));
+        }
+        return 4 * in[1];
+    case RPC_FS_READ:
+        if (!rpc_string(name, sizeof(name), in, size)) {
+            return -RPC_ERR_ARGUMENT;
+        }
+        n = fsRead(rpc_fs, name, out, max);
+        return n >= 0 ? n : -RPC_ERR_FAILED;
+    case RPC_FS_WRITE:
+        if (size < 1U || size < 1U + in[0] ||
+            !rpc_string(name, sizeof(name), &in[1], in[0])) {
+            return -RPC_ERR_ARGUMENT;
+        }
+        n = fsWrite(rpc_fs, name, &in[1U + in[0]], size - 1U - in[0]);
+        return n >= 0 ? 0 : -RPC_ERR_FAILED;
+    default:
+        return -RPC_ERR_COMMAND;
+    }
+}
+
+static void rpc_serve(const frame_decoder_t *dec, size_t size)
+{
+    rtcnt_t start = chSysGetRealtimeCounterX();
+    uint8_t response[FRAME_PAYLOAD_MAX];
+    uint8_t command = dec->buf[0];
+    uint32_t us;
+    int n;
+
+    /* Never answered, the port may be looped back.*/
+    if ((command & RPC_RESPONSE) != 0U) {
+        return;
+    }
+
+    n = rpc_call(
+        command, &dec->buf[2], size, &response[1], sizeof(response) - 1U);
+    response[0] = n >= 0 ? RPC_OK : (uint8_t)-n;
+    if (!tstreamSendFrame(command | RPC_RESPONSE,
+                          dec->buf[1],
+                          response,
+                          n >= 0 ? 1U + (size_t)n : 1U,
+                          TIME_MS2I(RPC_WRITE_TIMEOUT_MS))) {
+        rpc_stats.lost++;
+    }
+
+    us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+    rpc_stats.requests++;
+    if (n < 0) {
+        rpc_stats.errors++;
+    }
+    rpc_stats.total_us += us;
+    if (us > rpc_stats.max_us) {
+        rpc_stats.max_us = us;
+    }
+}
+
+static THD_FUNCTION(ThreadRpc, arg)
+{
+    BaseChannel *chn = (BaseChannel *)rpc_sdu;
+    event_listener_t el;
+
+    (void)arg;
+    chRegSetThreadName("rpc");
+    frameDecoderInit(&rpc_decoder);
+
+    /* The serial driver flags the configuration by the host.*/
+    chEvtRegisterMaskWithFlags(
+        chnGetEventSource(rpc_sdu), &el, RPC_EVT_USB, CHN_CONNECTED);
+
+    while (true) {
+        msg_t c = chnGetTimeout(chn, TIME_INFINITE);
+        int n;
+
+        /* Port stopped or not configured by the host, waiting for the
+           configuration. A flag left from an earlier one costs another
+           read.*/
+        if (c < MSG_OK) {
+            frameDecoderInit(&rpc_decoder);
+            chEvtWaitAny(RPC_EVT_USB);
+            chEvtGetAndClearFlags(&el);
+            continue;
+        }
+        n = frameDecoderPut(&rpc_decoder, (uint8_t)c);
+        if (n >= 0) {
+            rpc_serve(&rpc_decoder, (size_t)n);
+        }
+    }
+}
+
+thread_t *rpcStart(void *wsp,
+                   size_t size,
+                   tprio_t prio,
+                   SerialUSBDriver *sdup,
+                   thread_t *threadFs)
+{
+    rpc_sdu = sdup;
+    rpc_fs = threadFs;
+    return chThdCreateStatic(wsp, size, prio, ThreadRpc, NULL);
+}
+
+void rpcGetStats(rpc_stats_t *stats)
+{
+    chSysLock();
+    *stats = rpc_stats;
+    chSysUnlock();
+}
+
+void rpcResetStats(void)
+{
+    chSysLock();
+    memset(&rpc_stats, 0, sizeof(rpc_stats));
+    chSysUnlock();
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/* Time allowed for a response to get into the USB queue */
+#if !defined(RPC_WRITE_TIMEOUT_MS)
+#define RPC_WRITE_TIMEOUT_MS 100
+#endif
+
+/* Requests are frames on the telemetry port whose type is the command.
+   The response has the type of the request with RPC_RESPONSE set, the
+   same sequence number and the status as first payload byte. Requests
+   are served in order, a host may send several before it reads the
+   responses. Integers are little endian, strings are not terminated. */
+#define RPC_RESPONSE 0x80U
+
+typedef enum {
+    RPC_PING = 0x20,    /* any -> u32 time us mod 2^32, the request payload */
+    RPC_KV_GET,         /* u8 type, key -> value */
+    RPC_KV_SET,         /* u8 type, u8 key length, key, value -> */
+    RPC_TELEMETRY_READ, /* u8 first, u8 count -> i32 value[count] */
+    RPC_FS_READ,        /* name -> data */
+    RPC_FS_WRITE,       /* u8 name length, name, data -> */
+    RPC_COMMAND_END,
+} rpc_command_t;
+
+typedef enum {
+    RPC_OK = 0,
+    RPC_ERR_COMMAND,
+    RPC_ERR_ARGUMENT,
+    RPC_ERR_FAILED,
+} rpc_status_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t errors;
+    uint32_t lost; /* Responses that did not fit into the USB queue */
+    uint32_t max_us;
+    uint64_t total_us;
+} rpc_stats_t;
+
+/* Serves requests arriving on the telemetry port, see tstream.h */
+thread_t *rpcStart(void *wsp,
+                   size_t size,
+                   tprio_t prio,
+                   SerialUSBDriver *sdup,
+                   thread_t *threadFs);
+void rpcGetStats(rpc_stats_t *stats);
+void rpcResetStats(void);
@@ -0,0 +1,422 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ccm.h"
+#include "ina3221.h"
+#include "pca9546a.h"
+#include "sensors.h"
+#include "task.h"
+#include "tbus.h"
+#include "tmp117.h"
+
+#include <string.h>
+
+#define TMP117_COUNT (SENSOR_COUNT - SENSOR_TMP117_0)
+
+static const I2CConfig i2c1cfg = {
+    0x00702681, /* stm32cubemx 400 kHz*/
+    0,
+    0,
+};
+
+static const I2CConfig i2c2cfg = {
+    0x10808dd3, /* stm32cubemx 100 kHz*/
+    0,
+    0,
+};
+
+static const INA3221Config ina3221cfg = {
+    &I2CD1,
+    &i2c1cfg,
+    INA3221_SAD_DEFAULT,
+    INA3221_CT_1100,
+    INA3221_CT_204,
+    INA3221_AVG_4,
+};
+
+static const float shunts[INA3221_NUM_CHANNELS] = {
+    0.1f,
+    0.1f,
+    0.1f,
+};
+
+static const PCA9546AConfig pca9546acfg = {
+    &I2CD2,
+    &i2c2cfg,
+    PCA9546A_SAD_DEFAULT,
+    PORT_DEV_RST_D26,
+    PAD_DEV_RST_D26,
+};
+
+/* One TMP117 behind each multiplexer channel */
+static const TMP117Config tmp117cfg = {
+    &I2CD2,
+    &i2c2cfg,
+    TMP117_SAD_DEFAULT,
+    TMP117_CONV_1000,
+    TMP117_AVG_8,
+};
+
+/* I2C runs without DMA, all state lives in CCM */
+static INA3221Driver drv_current CCM_BSS;
+static PCA9546ADriver drv_multiplexer CCM_BSS;
+static TMP117Driver drv_thermometer[TMP117_COUNT] CCM_BSS;
+
+static sensor_t sensors[SENSOR_COUNT] CCM_DATA = {
+    [SENSOR_INA3221] = {.name = "ina3221", .channels = 6},
+    [SENSOR_PCA9546A] = {.name = "pca9546a", .channels = 0},
+    [SENSOR_TMP117_0] = {.name = "tmp117.0", .channels = 1},
+    [SENSOR_TMP117_1] = {.name = "tmp117.1", .channels = 1},
+    [SENSOR_TMP117_2] = {.name = "tmp117.2", .channels = 1},
+    [SENSOR_TMP117_3] = {.name = "tmp117.3", .channels = 1},
+};
+static bool sensors_probed;
+static systime_t sensors_probed_at;
+/* Held while the buses are in use */
+static MUTEX_DECL(sensors_lock);
+
+static void sensors_set_present(sensor_id_t id, bool present)
+{
+    chSysLock();
+    sensors[id].present = present;
+    chSysUnlock();
+}
+
+/* Copies a reading into the snapshot, a failed read keeps the last
+   values and counts an error. */
+static void sensors_update(sensor_id_t id,
+                           msg_t result,
+                           const int32_t raw[],
+                           const float cooked[])
+{
+    sensor_t *s = &sensors[id];
+
+    chSysLock();
+    if (result == MSG_OK) {
+        memcpy(s->raw, raw, s->channels * sizeof(raw[0]));
+        memcpy(s->cooked, cooked, s->channels * sizeof(cooked[0]));
+        s->time = chVTGetSystemTimeX();
+        s->reads++;
+    } else {
+        s->errors++;
+    }
+    chSysUnlock();
+}
+
+static void sensors_probe_current(void)
+{
+    ina3221ObjectInit(&drv_current);
+    ina3221Start(&drv_current, &ina3221cfg);
+    if (drv_current.state == INA3221_READY) {
+        currentSetShunts(&drv_current, shunts);
+    }
+    sensors_set_present(SENSOR_INA3221, drv_current.state == INA3221_READY);
+}
+
+static bool sensors_probe_multiplexer(void)
+{
+    bool mux;
+
+    pca9546aObjectInit(&drv_multiplexer);
+    pca9546aStart(&drv_multiplexer, &pca9546acfg);
+    mux = drv_multiplexer.state == PCA9546A_READY;
+    if (mux) {
+        multiplexerReset(&drv_multiplexer);
+        mux = multiplexerGetChannel(&drv_multiplexer) == 0U;
+    }
+    sensors_set_present(SENSOR_PCA9546A, mux);
+    return mux;
+}
+
+/* The multiplexer is present */
+static void sensors_probe_thermometer(unsigned i)
+{
+    multiplexerSetChannel(&drv_multiplexer, (size_t)1U << i);
+    tmp117ObjectInit(&drv_thermometer[i]);
+    tmp117Start(&drv_thermometer[i], &tmp117cfg);
+    sensors_set_present((sensor_id_t)(SENSOR_TMP117_0 + i),
+                        drv_thermometer[i].state == TMP117_READY);
+}
+
+static void sensors_probe_i2c2(void)
+{
+    bool mux = sensors_probe_multiplexer();
+
+    for (unsigned i = 0; i < TMP117_COUNT; i++) {
+        if (mux) {
+            sensors_probe_thermometer(i);
+        } else {
+            sensors_set_present((sensor_id_t)(SENSOR_TMP117_0 + i), false);
+        }
+    }
+}
+
+/* Only the missing devices, the multiplexer is not reset and the
+   thermometers found keep their configuration. */
+static void sensors_reprobe(void)
+{
+    if (!sensors[SENSOR_INA3221].present) {
+        sensors_probe_current();
+    }
+    /* Without the multiplexer none of the thermometers was found.*/
+    if (!sensors[SENSOR_PCA9546A].present) {
+        sensors_probe_i2c2();
+        return;
+    }
+    for (unsigned i = 0; i < TMP117_COUNT; i++) {
+        if (!sensors[SENSOR_TMP117_0 + i].present) {
+            sensors_probe_thermometer(i);
+        }
+    }
+}
+
+static void sensors_read_current(void)
+{
+    int32_t raw[2 * INA3221_NUM_CHANNELS];
+    float cooked[2 * INA3221_NUM_CHANNELS];
+    msg_t result = currentReadRaw(&drv_current, raw);
+
+    for (unsigned i = 0; i < INA3221_NUM_CHANNELS; i++) {
+        cooked[i] = raw[i] * EX_INA3221_SHUNT_LSB / shunts[i];
+        cooked[i + INA3221_NUM_CHANNELS] =
+            raw[i + INA3221_NUM_CHANNELS] * EX_INA3221_BUS_LSB;
+    }
+    sensors_update(SENSOR_INA3221, result, raw, cooked);
+    if (result == MSG_OK) {
+        uint16_t all = (1U << INA3221_NUM_CHANNELS) - 1U;
+
+        tbusPublish(TBUS_CURRENT, &raw[0], &cooked[0], all);
+        tbusPublish(TBUS_VOLTAGE,
+                    &raw[INA3221_NUM_CHANNELS],
+                    &cooked[INA3221_NUM_CHANNELS],
+                    all);
+    }
+}
+
+static void sensors_read_temperatures(void)
+{
+    int32_t raw[TMP117_COUNT];
+    float cooked[TMP117_COUNT];
+    uint16_t valid = 0;
+
+    /* The one shot conversions run in parallel.*/
+    for (unsigned i = 0; i < TMP117_COUNT; i++) {
+        if (sensors[SENSOR_TMP117_0 + i].present) {
+            multiplexerSetChannel(&drv_multiplexer, (size_t)1U << i);
+            drv_thermometer[i].vmt->start_acquire(&drv_thermometer[i]);
+        }
+    }
+    for (unsigned i = 0; i < TMP117_COUNT; i++) {
+        msg_t result;
+
+        if (!sensors[SENSOR_TMP117_0 + i].present) {
+            continue;
+        }
+        multiplexerSetChannel(&drv_multiplexer, (size_t)1U << i);
+        result = thermometerReadRaw(&drv_thermometer[i], &raw[i]);
+        cooked[i] = raw[i] * EX_TMP117_TEMP_LSB;
+        sensors_update((sensor_id_t)(SENSOR_TMP117_0 + i),
+                       result,
+                       &raw[i],
+                       &cooked[i]);
+        if (result == MSG_OK) {
+            valid |= 1U << i;
+        }
+    }
+    /* All thermometers in one sample, missing ones are not valid.*/
+    if (valid != 0U) {
+        tbusPublish(TBUS_TEMPERATURE, raw, cooked, valid);
+    }
+}
+
+static msg_t sensors_read_register(I2CDriver *i2cp,
+                                   i2caddr_t addr,
+                                   uint8_t reg,
+                                   uint16_t *value)
+{
+    uint8_t rx[2] = {0, 0};
+    msg_t result =
+        i2cMasterTransmitTimeout(i2cp, addr, &reg, 1, NULL, 0, TIME_INFINITE);
+    if (result == MSG_OK) {
+        result = i2cMasterReceiveTimeout(i2cp, addr, rx, 2, TIME_INFINITE);
+    }
+    *value = (uint16_t)((rx[0] << 8) | rx[1]);
+    return result;
+}
+
+static msg_t sensors_write_register(I2CDriver *i2cp,
+                                    i2caddr_t addr,
+                                    uint8_t reg,
+                                    uint16_t value)
+{
+    uint8_t tx[3] = {reg, (uint8_t)(value >> 8), (uint8_t)value};
+    return i2cMasterTransmitTimeout(i2cp, addr, tx, 3, NULL, 0, TIME_INFINITE);
+}
+
+/* Register value of the last read, a write stores it back */
+static uint16_t sensors_bench_value;
+
+/* Called with the lock held, the device is present */
+static msg_t sensors_bench(sensor_id_t id, sensors_bench_op_t op)
+{
+    /* Reads and writes go to a limit register.*/
+    I2CDriver *i2cp = tmp117cfg.i2cp;
+    i2caddr_t addr = tmp117cfg.slaveaddress;
+    uint8_t reg = EX_TMP117_REG_THIGH_LIMIT;
+    size_t channel = 0;
+
+    if (id == SENSOR_INA3221) {
+        i2cp = ina3221cfg.i2cp;
+        addr = ina3221cfg.slaveaddress;
+        reg = EX_INA3221_REG_CHANNEL1_CRITICAL_LIMIT;
+    } else if (id != SENSOR_PCA9546A) {
+        channel = (size_t)1U << (id - SENSOR_TMP117_0);
+    }
+
+    switch (op) {
+    case SENSORS_BENCH_READ:
+        if (id == SENSOR_PCA9546A) {
+            return multiplexerGetChannel(&drv_multiplexer) != SIZE_MAX
+                       ? MSG_OK
+                       : MSG_RESET;
+        }
+        return sensors_read_register(i2cp, addr, reg, &sensors_bench_value);
+    case SENSORS_BENCH_WRITE:
+        if (id == SENSOR_PCA9546A) {
+            return multiplexerSetChannel(&drv_multiplexer, 0U);
+        }
+        return sensors_write_register(i2cp, addr, reg, sensors_bench_value);
+    case SENSORS_BENCH_SELECT:
+        if (id == SENSOR_PCA9546A || id == SENSOR_INA3221) {
+            break;
+        }
+        return multiplexerSetChannel(&drv_multiplexer, channel);
+    case SENSORS_BENCH_SAMPLE: {
+        int32_t raw[2 * INA3221_NUM_CHANNELS];
+
+        if (id == SENSOR_INA3221) {
+            return currentReadRaw(&drv_current, raw);
+        } else if (id != SENSOR_PCA9546A) {
+            return thermometerReadRaw(
+                &drv_thermometer[id - SENSOR_TMP117_0], raw);
+        }
+    } break;
+    }
+    return MSG_RESET;
+}
+
+static bool sensors_all_present(void)
+{
+    for (unsigned i = 0; i < SENSOR_COUNT; i++) {
+        if (!sensors[i].present) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sensors_init(void *arg)
+{
+    (void)arg;
+
+    chMtxLock(&sensors_lock);
+    sensors_probe_current();
+    sensors_probe_i2c2();
+    sensors_probed = true;
+    chMtxUnlock(&sensors_lock);
+    sensors_probed_at = chVTGetSystemTimeX();
+}
+
+static void sensors_cycle(void *arg)
+{
+    (void)arg;
+
+    chMtxLock(&sensors_lock);
+
+    /* Boards are populated partly, or a sensor was plugged in late.*/
+    if (!sensors_all_present() &&
+        chVTTimeElapsedSinceX(sensors_probed_at) >=
+            TIME_MS2I(SENSORS_REPROBE_MS)) {
+        sensors_reprobe();
+        sensors_probed_at = chVTGetSystemTimeX();
+    }
+
+    if (sensors[SENSOR_INA3221].present) {
+        sensors_read_current();
+    }
+    if (sensors[SENSOR_PCA9546A].present) {
+        sensors_read_temperatures();
+    }
+    chMtxUnlock(&sensors_lock);
+}
+
+/* The TMP117 conversions with 8 averages take 125 ms */
+static task_t sensors_task = {
+    .name = "sensors",
+    .period = TIME_MS2I(SENSORS_PERIOD_MS),
+    .offset = 0,
+    .budget_us = SENSORS_BUDGET_US,
+    .init = sensors_init,
+    .run = sensors_cycle,
+};
+
+thread_t *sensorsStart(void *wsp, size_t size, tprio_t prio)
+{
+    sensors_task.prio = prio;
+    return taskCreate(&sensors_task, wsp, size);
+}
+
+bool sensorsGet(sensor_id_t id, sensor_t *sensor)
+{
+    bool probed;
+
+    chSysLock();
+    *sensor = sensors[id];
+    probed = sensors_probed;
+    chSysUnlock();
+    return probed;
+}
+
+sensor_id_t sensorsFind(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < SENSOR_COUNT; i++) {
+        if (strcmp(sensors[i].name, name) == 0) {
+            break;
+        }
+    }
+    return (sensor_id_t)i;
+}
+
+msg_t sensorsBench(sensor_id_t id, sensors_bench_op_t op, uint32_t *us)
+{
+    rtcnt_t start;
+    msg_t result = MSG_RESET;
+
+    chMtxLock(&sensors_lock);
+    if (sensors[id].present) {
+        /* Untimed preparation, the multiplexer channel of a thermometer
+           and the value written back.*/
+        if (id >= SENSOR_TMP117_0) {
+            multiplexerSetChannel(&drv_multiplexer,
+                                  op == SENSORS_BENCH_SELECT
+                                      ? 0U
+                                      : (size_t)1U << (id - SENSOR_TMP117_0));
+        }
+        if (op == SENSORS_BENCH_WRITE &&
+            sensors_bench(id, SENSORS_BENCH_READ) != MSG_OK) {
+            chMtxUnlock(&sensors_lock);
+            return MSG_RESET;
+        }
+        start = chSysGetRealtimeCounterX();
+        result = sensors_bench(id, op);
+        *us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+    }
+    chMtxUnlock(&sensors_lock);
+    return result;
+}
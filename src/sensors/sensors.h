@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Time between two readings of all sensors */
+#if !defined(SENSORS_PERIOD_MS)
+#define SENSORS_PERIOD_MS 250
+#endif
+
+/* Time of one reading of all sensors, wall time */
+#if !defined(SENSORS_BUDGET_US)
+#define SENSORS_BUDGET_US 160000
+#endif
+
+/* Time between probes for sensors that were not found */
+#if !defined(SENSORS_REPROBE_MS)
+#define SENSORS_REPROBE_MS 10000
+#endif
+
+/* Values of one device */
+#define SENSORS_CHANNELS_MAX 6
+
+typedef enum {
+    SENSOR_INA3221,
+    SENSOR_PCA9546A,
+    SENSOR_TMP117_0,
+    SENSOR_TMP117_1,
+    SENSOR_TMP117_2,
+    SENSOR_TMP117_3,
+    SENSOR_COUNT,
+} sensor_id_t;
+
+/* Latest reading of a device. The INA3221 has shunt currents in A then
+   bus voltages in V, a TMP117 the temperature in degrees Celsius and
+   the PCA9546A no values. */
+typedef struct {
+    const char *name;
+    bool present;
+    uint8_t channels;
+    int32_t raw[SENSORS_CHANNELS_MAX];
+    float cooked[SENSORS_CHANNELS_MAX];
+    systime_t time;
+    uint32_t reads;
+    uint32_t errors;
+} sensor_t;
+
+/* Timed operations for benchmarks */
+typedef enum {
+    SENSORS_BENCH_READ,   /* one register read */
+    SENSORS_BENCH_WRITE,  /* one register write, the value is unchanged */
+    SENSORS_BENCH_SELECT, /* one switch to the multiplexer channel */
+    SENSORS_BENCH_SAMPLE, /* one complete reading, with the conversion */
+} sensors_bench_op_t;
+
+/* The sensor thread owns the I2C buses and all sensor drivers, others
+   read copies of its latest snapshot. Readings are also published on
+   the telemetry bus as current, voltage and temperature, see tbus.h.
+   The readings run as a periodic task. */
+thread_t *sensorsStart(void *wsp, size_t size, tprio_t prio);
+/* Returns false before the first probe */
+bool sensorsGet(sensor_id_t id, sensor_t *sensor);
+/* Returns SENSOR_COUNT if there is no sensor of that name */
+sensor_id_t sensorsFind(const char *name);
+/* Runs one operation on a present device in the calling thread while the
+   sensor thread is held off. Returns MSG_RESET for a missing device or an
+   operation it does not support. */
+msg_t sensorsBench(sensor_id_t id, sensors_bench_op_t op, uint32_t *us);
@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "task.h"
+
+#include <string.h>
+
+static task_t *tasks[TASK_MAX];
+static unsigned task_count;
+static systime_t task_epoch;
+static bool task_started;
+static SEMAPHORE_DECL(task_start, 0);
+static MUTEX_DECL(task_lock);
+
+/* Rate monotonic, equal periods keep the order of creation */
+static void task_assign(void)
+{
+    unsigned by_rate = 0;
+
+    for (unsigned i = 0; i < task_count; i++) {
+        if (tasks[i]->prio == TASK_PRIO_RATE) {
+            by_rate++;
+        }
+    }
+    for (unsigned i = 0; i < task_count; i++) {
+        unsigned rank = 0;
+
+        if (tasks[i]->prio != TASK_PRIO_RATE) {
+            tasks[i]->assigned = tasks[i]->prio;
+            continue;
+        }
+        for (unsigned j = 0; j < task_count; j++) {
+            if (tasks[j]->prio == TASK_PRIO_RATE &&
+                (tasks[j]->period < tasks[i]->period ||
+                 (tasks[j]->period == tasks[i]->period && j < i))) {
+                rank++;
+            }
+        }
+        tasks[i]->assigned = (tprio_t)(TASK_PRIO_LOW + by_rate - 1U - rank);
+    }
+}
+
+static THD_FUNCTION(ThreadTask, arg)
+{
+    task_t *task = (task_t *)arg;
+    systime_t prev;
+    systime_t release;
+
+    chRegSetThreadName(task->name);
+
+    /* A device hanging the init is caught like a hanging job.*/
+    wdogAdd(&task->heartbeat, task->name);
+    wdogCheckIn(&task->heartbeat, TIME_MS2I(TASK_INIT_MS));
+    if (task->init != NULL) {
+        task->init(task->arg);
+    }
+    wdogCheckIn(&task->heartbeat, TIME_MS2I(TASK_INIT_MS));
+    chSemWait(&task_start);
+    prev = task_epoch;
+    release = chTimeAddX(task_epoch, task->offset);
+    /* An init still running at the start joins at the next release.*/
+    while (chTimeDiffX(task_epoch, chVTGetSystemTimeX()) >
+           chTimeDiffX(task_epoch, release)) {
+        prev = release;
+        release = chTimeAddX(release, task->period);
+    }
+    wdogCheckIn(&task->heartbeat,
+                chTimeDiffX(chVTGetSystemTimeX(),
+                            chTimeAddX(release, task->period)));
+
+    while (true) {
+        rtcnt_t start;
+        uint32_t exec;
+        uint32_t response;
+        systime_t now;
+        systime_t next;
+
+        chThdSleepUntilWindowed(prev, release);
+        if (chThdGetPriorityX() != task->assigned) {
+            chThdSetPriority(task->assigned);
+        }
+
+        start = chSysGetRealtimeCounterX();
+        task->run(task->arg);
+        exec = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+        now = chVTGetSystemTimeX();
+        response = TIME_I2US(chTimeDiffX(release, now));
+        next = chTimeAddX(release, task->period);
+
+        chSysLock();
+        task->stats.jobs++;
+        if (task->budget_us != 0U && exec > task->budget_us) {
+            task->stats.overruns++;
+        }
+        if (exec > task->stats.exec_max_us) {
+            task->stats.exec_max_us = exec;
+        }
+        if (response > task->stats.response_max_us) {
+            task->stats.response_max_us = response;
+        }
+        if (!chTimeIsInRangeX(now, release, next)) {
+            task->stats.misses++;
+            /* Stay in phase, the late releases are dropped.*/
+            do {
+                release = next;
+                next = chTimeAddX(release, task->period);
+                task->stats.skipped++;
+            } while (!chTimeIsInRangeX(now, release, next));
+        }
+        chSysUnlock();
+
+        /* Due by the end of the next job.*/
+        wdogCheckIn(&task->heartbeat,
+                    chTimeDiffX(now, chTimeAddX(next, task->period)));
+        prev = release;
+        release = next;
+    }
+}
+
+thread_t *taskCreate(task_t *task, void *wsp, size_t size)
+{
+    osalDbgAssert(!task_started, "task created after start");
+    osalDbgAssert(task_count < TASK_MAX, "too many tasks");
+
+    memset(&task->stats, 0, sizeof(task->stats));
+    task->assigned = task->prio != TASK_PRIO_RATE ? task->prio : NORMALPRIO;
+    tasks[task_count++] = task;
+    return chThdCreateStatic(wsp, size, task->assigned, ThreadTask, task);
+}
+
+void taskStartAll(void)
+{
+    chMtxLock(&task_lock);
+    task_assign();
+    task_started = true;
+    chMtxUnlock(&task_lock);
+
+    /* Each thread raises itself to its priority at the first release,
+       one still in its init passes the semaphore later.*/
+    task_epoch = chVTGetSystemTimeX();
+    chSemReset(&task_start, (cnt_t)task_count);
+}
+
+void taskSetPeriod(task_t *task, sysinterval_t period)
+{
+    chMtxLock(&task_lock);
+    task->period = period;
+    task_assign();
+    chMtxUnlock(&task_lock);
+}
+
+unsigned taskGetCount(void) { return task_count; }
+
+bool taskGet(unsigned index, task_t *task)
+{
+    if (index >= task_count) {
+        return false;
+    }
+    chMtxLock(&task_lock);
+    chSysLock();
+    *task = *tasks[index];
+    chSysUnlock();
+    chMtxUnlock(&task_lock);
+    return true;
+}
+
+void taskResetStats(void)
+{
+    for (unsigned i = 0; i < task_count; i++) {
+        chSysLock();
+        memset(&tasks[i]->stats, 0, sizeof(tasks[i]->stats));
+        chSysUnlock();
+    }
+}
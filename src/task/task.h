@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wdog.h"
+
+/* Periodic tasks */
+#if !defined(TASK_MAX)
+#define TASK_MAX 8
+#endif
+
+/* Lowest priority handed out by rate, above the threads serving
+   requests at NORMALPRIO */
+#if !defined(TASK_PRIO_LOW)
+#define TASK_PRIO_LOW (NORMALPRIO + 1)
+#endif
+
+/* Time the init of a task and the wait for the start may take */
+#if !defined(TASK_INIT_MS)
+#define TASK_INIT_MS 5000
+#endif
+
+/* Priority of a task ordered by its period */
+#define TASK_PRIO_RATE 0
+
+typedef void (*task_fn_t)(void *arg);
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t overruns;        /* Ran longer than the budget */
+    uint32_t misses;          /* Finished after the next release */
+    uint32_t skipped;         /* Releases passed during a miss */
+    uint32_t exec_max_us;     /* From the start to the end of a job */
+    uint32_t response_max_us; /* From the release to the end of a job */
+} task_stats_t;
+
+/* Jobs are released every period, the first one offset after
+   taskStartAll(), and are due at the next release. The budget is wall
+   time and includes preemption by higher priorities and interrupts.
+   The init and each job check in with the watchdog supervisor, a task
+   whose job has not ended by the deadline of the next one counts as
+   stalled. */
+typedef struct {
+    const char *name;
+    sysinterval_t period;
+    sysinterval_t offset;
+    uint32_t budget_us;   /* 0 for none */
+    tprio_t prio;         /* TASK_PRIO_RATE or a fixed priority */
+    task_fn_t init;       /* Before the first release, may be NULL */
+    task_fn_t run;        /* One job */
+    void *arg;
+    /* Set by the framework */
+    tprio_t assigned;
+    task_stats_t stats;
+    wdog_heartbeat_t heartbeat;
+} task_t;
+
+/* The thread waits for taskStartAll(), which assigns the priorities
+   rate monotonically, shortest period first, and releases all tasks
+   from one epoch. */
+thread_t *taskCreate(task_t *task, void *wsp, size_t size);
+void taskStartAll(void);
+/* From the next release on, the priorities are assigned again */
+void taskSetPeriod(task_t *task, sysinterval_t period);
+unsigned taskGetCount(void);
+/* Copy of the task with its statistics, false past the last one */
+bool taskGet(unsigned index, task_t *task);
+void taskResetStats(void);
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "frame.h"
+
+#include <string.h>
+
+uint16_t frameCrc(const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    uint16_t crc = 0xffffU;
+
+    while (size-- > 0U) {
+        crc ^= (uint16_t)(*p++ << 8);
+        for (unsigned i = 0; i < 8U; i++) {
+            crc = (crc & 0x8000U) != 0U ? (uint16_t)((crc << 1) ^ 0x1021U)
+                                        : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/* Each zero is replaced by the distance to the next one, runs of 254
+   non zero bytes get a code byte of their own. */
+static size_t frame_cobs(uint8_t *out, const uint8_t *in, size_t size)
+{
+    size_t code_at = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < size; i++) {
+        if (in[i] == 0U) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        } else {
+            out[o++] = in[i];
+            if (++code == 0xffU) {
+                out[code_at] = code;
+                code_at = o++;
+                code = 1;
+            }
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+size_t frameEncode(uint8_t *out,
+                   uint8_t type,
+                   uint8_t seq,
+                   const void *payload,
+                   size_t size)
+{
+    uint8_t raw[FRAME_PAYLOAD_MAX + FRAME_OVERHEAD];
+    uint16_t crc;
+    size_t n;
+
+    if (size > FRAME_PAYLOAD_MAX) {
+        return 0;
+    }
+    raw[0] = type;
+    raw[1] = seq;
+    memcpy(&raw[2], payload, size);
+    crc = frameCrc(raw, size + 2U);
+    raw[size + 2U] = (uint8_t)crc;
+    raw[size + 3U] = (uint8_t)(crc >> 8);
+
+    out[0] = 0;
+    n = 1U + frame_cobs(&out[1], raw, size + FRAME_OVERHEAD);
+    out[n++] = 0;
+    return n;
+}
+
+void frameDecoderInit(frame_decoder_t *dec)
+{
+    dec->len = 0;
+    dec->code = 0;
+    dec->left = 0;
+    dec->overflow = false;
+}
+
+int frameDecoderPut(frame_decoder_t *dec, uint8_t c)
+{
+    uint8_t append;
+
+    if (c == 0U) {
+        size_t len = dec->len;
+        bool ok = !dec->overflow && len >= FRAME_OVERHEAD && dec->left == 0U;
+
+        frameDecoderInit(dec);
+        if (!ok || frameCrc(dec->buf, len - 2U) !=
+                       (uint16_t)(dec->buf[len - 2U] |
+                                  (uint16_t)dec->buf[len - 1U] << 8)) {
+            return -1;
+        }
+        return (int)(len - FRAME_OVERHEAD);
+    }
+
+    if (dec->left > 0U) {
+        append = c;
+        dec->left--;
+    } else {
+        /* A code byte, the block before ends with an implied zero unless
+           it was a full run.*/
+        bool zero = dec->code != 0U && dec->code != 0xffU;
+        dec->code = c;
+        dec->left = (uint8_t)(c - 1U);
+        if (!zero) {
+            return -1;
+        }
+        append = 0;
+    }
+
+    if (dec->len < sizeof(dec->buf)) {
+        dec->buf[dec->len++] = append;
+    } else {
+        dec->overflow = true;
+    }
+    return -1;
+}
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest payload of one frame */
+#if !defined(FRAME_PAYLOAD_MAX)
+#define FRAME_PAYLOAD_MAX 96
+#endif
+
+/* Type, sequence number and CRC around the payload */
+#define FRAME_OVERHEAD 4U
+
+/* Encoded size including both delimiters */
+#define FRAME_ENCODED_MAX(size)                                              \
+    ((size) + FRAME_OVERHEAD + ((size) + FRAME_OVERHEAD) / 254U + 3U)
+
+/* Receiving side, fed one byte at a time. The frame is in buf: type,
+   sequence number, then the payload. */
+typedef struct {
+    uint8_t buf[FRAME_PAYLOAD_MAX + FRAME_OVERHEAD];
+    size_t len;
+    uint8_t code;
+    uint8_t left;
+    bool overflow;
+} frame_decoder_t;
+
+/* Frames on a byte stream: type, sequence number, payload and the
+   CRC-16/CCITT of those in little endian. They are COBS coded and a zero
+   byte is sent before and after each frame, so a receiver finds the next
+   frame after lost or damaged bytes. */
+uint16_t frameCrc(const void *data, size_t size);
+/* Returns the number of bytes written to out, at most
+   FRAME_ENCODED_MAX(size), or 0 if the payload is too large */
+size_t frameEncode(uint8_t *out,
+                   uint8_t type,
+                   uint8_t seq,
+                   const void *payload,
+                   size_t size);
+
+void frameDecoderInit(frame_decoder_t *dec);
+/* Returns the payload size when c completes a frame with a valid CRC,
+   otherwise -1 */
+int frameDecoderPut(frame_decoder_t *dec, uint8_t c);
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ccm.h"
+#include "tbus.h"
+
+typedef struct {
+    volatile uint32_t lock; /* Odd while the sample is written */
+    tbus_sample_t sample;
+} tbus_slot_t;
+
+static const struct {
+    const char *name;
+    uint8_t channels;
+} tbus_topics[TBUS_TOPIC_COUNT] = {
+    [TBUS_CURRENT] = {"current", 3},
+    [TBUS_VOLTAGE] = {"voltage", 3},
+    [TBUS_TEMPERATURE] = {"temperature", 4},
+    [TBUS_RPM] = {"rpm", 3},
+    [TBUS_DUTY] = {"duty", 3},
+};
+
+static tbus_slot_t tbus_slots[TBUS_TOPIC_COUNT] CCM_BSS;
+static EVENTSOURCE_DECL(tbus_event);
+
+void tbusPublish(tbus_topic_t topic,
+                 const int32_t raw[],
+                 const float value[],
+                 uint16_t valid)
+{
+    tbus_slot_t *slot = &tbus_slots[topic];
+    tbus_sample_t *s = &slot->sample;
+
+    /* Readers never wait for a preempted producer.*/
+    chSysLock();
+    slot->lock++;
+    __DMB();
+    s->seq++;
+    s->time = chVTGetSystemTimeX();
+    s->valid = valid;
+    s->count = tbus_topics[topic].channels;
+    for (unsigned i = 0; i < s->count; i++) {
+        if ((valid & (1U << i)) != 0U) {
+            s->raw[i] = raw[i];
+            s->value[i] = value[i];
+        }
+    }
+    __DMB();
+    slot->lock++;
+    chSysUnlock();
+
+    chEvtBroadcastFlags(&tbus_event, TBUS_FLAG(topic));
+}
+
+bool tbusRead(tbus_topic_t topic, tbus_sample_t *sample)
+{
+    const tbus_slot_t *slot = &tbus_slots[topic];
+    uint32_t lock;
+
+    do {
+        lock = slot->lock;
+        __DMB();
+        *sample = slot->sample;
+        __DMB();
+    } while ((lock & 1U) != 0U || lock != slot->lock);
+    return sample->seq != 0U;
+}
+
+uint32_t tbusGetSeq(tbus_topic_t topic) { return tbus_slots[topic].lock; }
+
+uint8_t tbusGetChannels(tbus_topic_t topic)
+{
+    return tbus_topics[topic].channels;
+}
+
+const char *tbusGetName(tbus_topic_t topic) { return tbus_topics[topic].name; }
+
+event_source_t *tbusGetEventSource(void) { return &tbus_event; }
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Channels of the largest topic */
+#define TBUS_CHANNELS_MAX 4
+
+/* Values are in A, V, degrees Celsius, 1/min and percent, raw values in
+   device units */
+typedef enum {
+    TBUS_CURRENT,     /* INA3221 shunts 1..3 */
+    TBUS_VOLTAGE,     /* INA3221 bus voltages 1..3 */
+    TBUS_TEMPERATURE, /* TMP117 behind multiplexer channels 0..3 */
+    TBUS_RPM,         /* fans 1..3 */
+    TBUS_DUTY,        /* fans 1..3 */
+    TBUS_TOPIC_COUNT,
+} tbus_topic_t;
+
+/* Broadcast with the topic of each publish */
+#define TBUS_FLAG(topic) ((eventflags_t)1 << (topic))
+
+typedef struct {
+    uint32_t seq;   /* Publishes of the topic, 0 before the first */
+    systime_t time; /* Of the publish */
+    uint16_t valid; /* Channels read successfully, by bit */
+    uint8_t count;
+    int32_t raw[TBUS_CHANNELS_MAX];
+    float value[TBUS_CHANNELS_MAX];
+} tbus_sample_t;
+
+/* One producer per topic. The latest sample of each topic is kept in a
+   slot under a sequence lock: the producer updates it in a short
+   critical section, readers copy it without locking and retry if a
+   publish came in between, so no reader blocks a producer or another
+   reader. Channels not valid keep their last value. */
+void tbusPublish(tbus_topic_t topic,
+                 const int32_t raw[],
+                 const float value[],
+                 uint16_t valid);
+/* Threads only, returns false before the first publish */
+bool tbusRead(tbus_topic_t topic, tbus_sample_t *sample);
+/* Changes with every publish, cheaper than a read to poll for news */
+uint32_t tbusGetSeq(tbus_topic_t topic);
+uint8_t tbusGetChannels(tbus_topic_t topic);
+const char *tbusGetName(tbus_topic_t topic);
+event_source_t *tbusGetEventSource(void);
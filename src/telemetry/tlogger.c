@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "fs.h"
+#include "task.h"
+#include "tbus.h"
+#include "tlogger.h"
+#include "util.h"
+
+/* Bus topics logged as channels, raw values */
+static const struct {
+    tbus_topic_t topic;
+    uint8_t channel;
+} tlogger_feeds[] = {
+    {TBUS_CURRENT, 0},
+    {TBUS_VOLTAGE, 3},
+    {TBUS_TEMPERATURE, 6},
+};
+
+static thread_t *tlogger_fs;
+static int32_t tlogger_values[TLOG_CHANNELS];
+static bool tlogger_started;
+static uint32_t tlogger_base;
+static uint32_t tlogger_errors;
+
+/* Seconds since the start, the 64 bit time stamp does not wrap unlike
+   the system time, which does after 4.97 days at 10 kHz.*/
+static uint32_t tlogger_uptime(void)
+{
+    return (uint32_t)(chVTGetTimeStamp() / CH_CFG_ST_FREQUENCY);
+}
+
+static void tlogger_step(void *arg)
+{
+    bool any = false;
+
+    (void)arg;
+    if (!fsIsReady()) {
+        return;
+    }
+    /* Past the last record of the previous run.*/
+    if (!tlogger_started) {
+        tlogger_base = tlogGetLastTime() + 1U - tlogger_uptime();
+        tlogger_started = true;
+    }
+
+    for (unsigned i = 0; i < COUNTOF(tlogger_feeds); i++) {
+        tbus_sample_t sample;
+
+        if (!tbusRead(tlogger_feeds[i].topic, &sample)) {
+            continue;
+        }
+        for (unsigned ch = 0; ch < sample.count; ch++) {
+            if ((sample.valid & (1U << ch)) != 0U) {
+                tlogger_values[tlogger_feeds[i].channel + ch] = sample.raw[ch];
+            }
+        }
+        any = true;
+    }
+    if (any && fsTlogAppend(tlogger_fs,
+                            tlogger_base + tlogger_uptime(),
+                            tlogger_values) != 0) {
+        tlogger_errors++;
+    }
+}
+
+static task_t tlogger_task = {
+    .name = "tlogger",
+    .period = TIME_S2I(TLOGGER_PERIOD_S),
+    .offset = TIME_MS2I(7),
+    .run = tlogger_step,
+};
+
+thread_t *
+tloggerStart(void *wsp, size_t size, tprio_t prio, thread_t *threadFs)
+{
+    tlogger_fs = threadFs;
+    tlogger_task.prio = prio;
+    return taskCreate(&tlogger_task, wsp, size);
+}
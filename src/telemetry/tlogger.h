@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+/* Time between two records, every record is written to the flash */
+#if !defined(TLOGGER_PERIOD_S)
+#define TLOGGER_PERIOD_S 60
+#endif
+
+/* Records the latest current, voltage and temperature readings from the
+   telemetry bus in the time indexed log, raw values as channels 0..2,
+   3..5 and 6..9 like the stream. Without a clock the time is operating
+   seconds, continued after a reset from the last record. Runs as a
+   periodic task and skips records while the fs is not ready. */
+thread_t *
+tloggerStart(void *wsp, size_t size, tprio_t prio, thread_t *threadFs);
@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "tscodec.h"
+
+/* Bits are stored LSB first. A sample is a 6 bit width followed by the
+   zigzag coded differences of all channels in that width. The unused bits
+   of the last byte are ones, which reads as the end marker. */
+#define WIDTH_BITS 6U
+#define WIDTH_END 0x3fU
+
+/* Arithmetic is done modulo 2^32 so any sequence round trips. */
+
+static uint32_t zigzag(uint32_t v)
+{
+    return (v << 1) ^ (uint32_t)-(int32_t)(v >> 31);
+}
+
+static uint32_t unzigzag(uint32_t v) { return (v >> 1) ^ (uint32_t)-(v & 1U); }
+
+static unsigned bit_width(uint32_t v)
+{
+    return v == 0U ? 0U : 32U - (unsigned)__builtin_clz(v);
+}
+
+static void put_bits(tsenc_t *enc, uint32_t v, unsigned n)
+{
+    while (n > 0U) {
+        unsigned off = enc->bits & 7U;
+        unsigned k = 8U - off < n ? 8U - off : n;
+        uint8_t *p = &enc->buf[enc->bits >> 3];
+        uint8_t mask = (uint8_t)(((1U << k) - 1U) << off);
+
+        if (off == 0U) {
+            *p = 0xffU;
+        }
+        *p = (uint8_t)((*p & ~mask) | ((v << off) & mask));
+        v = k < 32U ? v >> k : 0U;
+        n -= k;
+        enc->bits += k;
+    }
+}
+
+static uint32_t get_bits(tsdec_t *dec, unsigned n)
+{
+    uint32_t v = 0;
+
+    for (unsigned done = 0; done < n;) {
+        unsigned off = dec->bits & 7U;
+        unsigned k = 8U - off < n - done ? 8U - off : n - done;
+        uint32_t b = (uint32_t)(dec->buf[dec->bits >> 3] >> off) &
+                     ((1U << k) - 1U);
+
+        v |= b << done;
+        done += k;
+        dec->bits += k;
+    }
+    return v;
+}
+
+void tsEncStart(tsenc_t *enc,
+                void *buf,
+                unsigned size,
+                unsigned channels,
+                uint32_t dod_mask)
+{
+    enc->channels = (uint8_t)channels;
+    enc->dod_mask = dod_mask;
+    enc->buf = buf;
+    enc->size = size;
+    enc->bits = 0;
+    enc->samples = 0;
+    for (unsigned ch = 0; ch < TSCODEC_CHANNELS_MAX; ch++) {
+        enc->prev[ch] = 0;
+        enc->delta[ch] = 0;
+    }
+}
+
+bool tsEncPut(tsenc_t *enc, const int32_t sample[])
+{
+    uint32_t z[TSCODEC_CHANNELS_MAX];
+    uint32_t any = 0;
+    unsigned width;
+
+    for (unsigned ch = 0; ch < enc->channels; ch++) {
+        uint32_t d = (uint32_t)sample[ch] - (uint32_t)enc->prev[ch];
+
+        if ((enc->dod_mask & (1U << ch)) != 0U && enc->samples > 1U) {
+            z[ch] = zigzag(d - (uint32_t)enc->delta[ch]);
+        } else {
+            z[ch] = zigzag(d);
+        }
+        any |= z[ch];
+    }
+    width = bit_width(any);
+    if (WIDTH_BITS + width * enc->channels > enc->size * 8U - enc->bits) {
+        return false;
+    }
+
+    put_bits(enc, width, WIDTH_BITS);
+    for (unsigned ch = 0; ch < enc->channels; ch++) {
+        put_bits(enc, z[ch], width);
+        enc->delta[ch] =
+            (int32_t)((uint32_t)sample[ch] - (uint32_t)enc->prev[ch]);
+        enc->prev[ch] = sample[ch];
+    }
+    enc->samples++;
+    return true;
+}
+
+void tsDecStart(tsdec_t *dec,
+                const void *buf,
+                unsigned size,
+                unsigned channels,
+                uint32_t dod_mask)
+{
+    dec->channels = (uint8_t)channels;
+    dec->dod_mask = dod_mask;
+    dec->buf = buf;
+    dec->size = size;
+    dec->bits = 0;
+    dec->samples = 0;
+    for (unsigned ch = 0; ch < TSCODEC_CHANNELS_MAX; ch++) {
+        dec->prev[ch] = 0;
+        dec->delta[ch] = 0;
+    }
+}
+
+bool tsDecGet(tsdec_t *dec, int32_t sample[])
+{
+    unsigned left = dec->size * 8U - dec->bits;
+    unsigned width;
+
+    if (left < WIDTH_BITS) {
+        return false;
+    }
+    width = get_bits(dec, WIDTH_BITS);
+    if (width > 32U || width * dec->channels > left - WIDTH_BITS) {
+        return false;
+    }
+
+    for (unsigned ch = 0; ch < dec->channels; ch++) {
+        uint32_t d = unzigzag(get_bits(dec, width));
+
+        if ((dec->dod_mask & (1U << ch)) != 0U && dec->samples > 1U) {
+            d += (uint32_t)dec->delta[ch];
+        }
+        dec->delta[ch] = (int32_t)d;
+        sample[ch] = (int32_t)((uint32_t)dec->prev[ch] + d);
+        dec->prev[ch] = sample[ch];
+    }
+    dec->samples++;
+    return true;
+}
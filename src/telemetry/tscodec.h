@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Most channels in one sample */
+#if !defined(TSCODEC_CHANNELS_MAX)
+#define TSCODEC_CHANNELS_MAX 16
+#endif
+
+/* Worst case size of one encoded sample */
+#define TSCODEC_SAMPLE_MAX(channels) ((6U + (channels) * 32U + 7U) / 8U)
+
+/* Samples of raw int32_t channels bit packed into a block of bytes. The
+   first sample of a block is stored as it is, so every block decodes on
+   its own. The following samples store the zigzag coded difference to
+   the previous sample, or the difference of those differences for the
+   channels in the delta of delta mask, which suits steadily ramping
+   values. All channels of a sample share the bit width of the largest
+   one, sensor noise of a few LSB packs into 3 or 4 bits per channel. */
+typedef struct {
+    uint8_t channels;
+    uint32_t dod_mask;
+    uint8_t *buf;
+    unsigned size;
+    unsigned bits;
+    unsigned samples;
+    int32_t prev[TSCODEC_CHANNELS_MAX];
+    int32_t delta[TSCODEC_CHANNELS_MAX];
+} tsenc_t;
+
+typedef struct {
+    uint8_t channels;
+    uint32_t dod_mask;
+    const uint8_t *buf;
+    unsigned size;
+    unsigned bits;
+    unsigned samples;
+    int32_t prev[TSCODEC_CHANNELS_MAX];
+    int32_t delta[TSCODEC_CHANNELS_MAX];
+} tsdec_t;
+
+void tsEncStart(tsenc_t *enc,
+                void *buf,
+                unsigned size,
+                unsigned channels,
+                uint32_t dod_mask);
+/* Returns false if the sample does not fit, the block is left unchanged */
+bool tsEncPut(tsenc_t *enc, const int32_t sample[]);
+static inline unsigned tsEncSize(const tsenc_t *enc)
+{
+    return (enc->bits + 7U) / 8U;
+}
+
+void tsDecStart(tsdec_t *dec,
+                const void *buf,
+                unsigned size,
+                unsigned channels,
+                uint32_t dod_mask);
+/* Returns false at the end of the block or on malformed data */
+bool tsDecGet(tsdec_t *dec, int32_t sample[]);
@@ -0,0 +1,353 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ccm.h"
+#include "frame.h"
+#include "task.h"
+#include "tbus.h"
+#include "tscodec.h"
+#include "tstream.h"
+#include "util.h"
+
+#include <string.h>
+
+typedef struct {
+    uint32_t time;
+    uint16_t code;
+    uint32_t arg;
+} tstream_event_t;
+
+static SerialUSBDriver *tstream_sdu;
+static volatile unsigned tstream_rate = TSTREAM_RATE_HZ;
+static volatile int32_t tstream_values[TSTREAM_CHANNELS] CCM_BSS;
+static tstream_event_t tstream_events[TSTREAM_EVENTS_MAX];
+static unsigned tstream_event_count;
+static tstream_stats_t tstream_stats;
+static uint8_t tstream_seq;
+static MUTEX_DECL(tstream_lock);
+
+static uint8_t tstream_frame[FRAME_ENCODED_MAX(FRAME_PAYLOAD_MAX)] CCM_BSS;
+
+/* Packed snapshots, the header is time, period and count */
+#define PACKED_HEADER 9U
+#define PACKED_BLOCK (FRAME_PAYLOAD_MAX - PACKED_HEADER)
+
+#if TSTREAM_CHANNELS > TSCODEC_CHANNELS_MAX ||                               \
+    TSCODEC_SAMPLE_MAX(TSTREAM_CHANNELS) > PACKED_BLOCK
+#error "a packed snapshot does not fit into a frame"
+#endif
+
+static volatile bool tstream_packed;
+static tsenc_t tstream_enc;
+static uint8_t tstream_block[PACKED_BLOCK];
+static uint32_t tstream_block_time;
+static uint32_t tstream_block_period;
+
+/* Bus topics carried as channels, raw values */
+static const struct {
+    tbus_topic_t topic;
+    uint8_t channel;
+} tstream_feeds[] = {
+    {TBUS_CURRENT, 0},
+    {TBUS_VOLTAGE, 3},
+    {TBUS_TEMPERATURE, 6},
+};
+
+/* Subscription to the bus, the flags tell which topics were published */
+#define TSTREAM_EVT_TBUS EVENT_MASK(0)
+#define TSTREAM_FEED_FLAGS                                                     \
+    (TBUS_FLAG(TBUS_CURRENT) | TBUS_FLAG(TBUS_VOLTAGE) |                       \
+     TBUS_FLAG(TBUS_TEMPERATURE))
+
+static event_listener_t tstream_listener;
+
+/* From the 64 bit time stamp, the system time wraps at 2^32 ticks */
+static uint32_t tstream_now(void)
+{
+    return (uint32_t)(chVTGetTimeStamp() * 1000U / CH_CFG_ST_FREQUENCY);
+}
+
+static bool tstream_ready(void)
+{
+    return tstream_sdu->state == SDU_READY &&
+           tstream_sdu->config->usbp->state == USB_ACTIVE;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+/* A frame that does not fit is cut short, the receiver drops it at the
+   next delimiter. */
+static bool tstream_write(uint8_t type,
+                          uint8_t seq,
+                          const void *payload,
+                          size_t size,
+                          sysinterval_t timeout)
+{
+    size_t n;
+    size_t written;
+
+    chMtxLock(&tstream_lock);
+    n = frameEncode(tstream_frame, type, seq, payload, size);
+    written = chnWriteTimeout(
+        (BaseChannel *)tstream_sdu, tstream_frame, n, timeout);
+    tstream_stats.bytes += (uint32_t)written;
+    if (written < n) {
+        tstream_stats.dropped++;
+    }
+    chMtxUnlock(&tstream_lock);
+    return n > 0U && written == n;
+}
+
+static void tstream_send(uint8_t type, const uint8_t *payload, size_t size)
+{
+    tstream_write(type, tstream_seq++, payload, size, TIME_IMMEDIATE);
+}
+
+static void tstream_send_events(void)
+{
+    while (true) {
+        tstream_event_t ev;
+        uint8_t payload[10];
+
+        chSysLock();
+        if (tstream_event_count == 0U) {
+            chSysUnlock();
+            return;
+        }
+        ev = tstream_events[0];
+        tstream_event_count--;
+        memmove(&tstream_events[0],
+                &tstream_events[1],
+                tstream_event_count * sizeof(tstream_events[0]));
+        chSysUnlock();
+
+        put_u32(&payload[0], ev.time);
+        put_u16(&payload[4], ev.code);
+        put_u32(&payload[6], ev.arg);
+        tstream_send(TSTREAM_FRAME_EVENT, payload, sizeof(payload));
+        tstream_stats.events++;
+    }
+}
+
+/* Only topics published since the last update are copied. The snapshots
+   go out at a fixed rate, so the task collects the flags of each period
+   instead of waking up for every publish. */
+static void tstream_update(void)
+{
+    eventflags_t flags;
+
+    chEvtGetAndClearEvents(TSTREAM_EVT_TBUS);
+    flags = chEvtGetAndClearFlags(&tstream_listener);
+    for (unsigned i = 0; i < COUNTOF(tstream_feeds); i++) {
+        tbus_topic_t topic = tstream_feeds[i].topic;
+        tbus_sample_t sample;
+
+        if ((flags & TBUS_FLAG(topic)) == 0U || !tbusRead(topic, &sample)) {
+            continue;
+        }
+        for (unsigned ch = 0; ch < sample.count; ch++) {
+            if ((sample.valid & (1U << ch)) != 0U) {
+                tstreamSet(tstream_feeds[i].channel + ch, sample.raw[ch]);
+            }
+        }
+    }
+}
+
+static void tstream_send_snapshot(void)
+{
+    uint8_t payload[4U + 4U * TSTREAM_CHANNELS];
+
+    put_u32(&payload[0], tstream_now());
+    for (unsigned i = 0; i < TSTREAM_CHANNELS; i++) {
+        put_u32(&payload[4U + 4U * i], (uint32_t)tstream_values[i]);
+    }
+    tstream_send(TSTREAM_FRAME_SNAPSHOT, payload, sizeof(payload));
+    tstream_stats.snapshots++;
+}
+
+/* Events still go out every 100 ms without snapshots */
+static sysinterval_t tstream_period(unsigned rate)
+{
+    sysinterval_t period =
+        rate != 0U ? TIME_US2I(1000000U / rate) : TIME_MS2I(100);
+
+    return period != (sysinterval_t)0 ? period : (sysinterval_t)1;
+}
+
+static void tstream_flush_packed(void)
+{
+    uint8_t payload[FRAME_PAYLOAD_MAX];
+    unsigned size = tsEncSize(&tstream_enc);
+
+    if (tstream_enc.samples == 0U) {
+        return;
+    }
+    put_u32(&payload[0], tstream_block_time);
+    put_u32(&payload[4], tstream_block_period);
+    payload[8] = (uint8_t)tstream_enc.samples;
+    memcpy(&payload[PACKED_HEADER], tstream_block, size);
+    tstream_send(TSTREAM_FRAME_PACKED, payload, PACKED_HEADER + size);
+    tstream_stats.packed++;
+    tstream_enc.samples = 0;
+}
+
+static void tstream_start_packed(uint32_t now, uint32_t period)
+{
+    tsEncStart(&tstream_enc,
+               tstream_block,
+               sizeof(tstream_block),
+               TSTREAM_CHANNELS,
+               0);
+    tstream_block_time = now;
+    tstream_block_period = period;
+}
+
+/* The receiver times the snapshots of a frame from the first one and
+   the period, a frame is closed when the period changes. */
+static void tstream_pack_snapshot(unsigned rate)
+{
+    int32_t sample[TSTREAM_CHANNELS];
+    uint32_t now = tstream_now();
+    uint32_t period = (uint32_t)TIME_I2US(tstream_period(rate));
+
+    for (unsigned i = 0; i < TSTREAM_CHANNELS; i++) {
+        sample[i] = tstream_values[i];
+    }
+    if (tstream_enc.samples != 0U && period != tstream_block_period) {
+        tstream_flush_packed();
+    }
+    if (tstream_enc.samples == 0U) {
+        tstream_start_packed(now, period);
+    }
+    if (!tsEncPut(&tstream_enc, sample)) {
+        tstream_flush_packed();
+        tstream_start_packed(now, period);
+        (void)tsEncPut(&tstream_enc, sample);
+    }
+    tstream_stats.snapshots++;
+    if (tstream_enc.samples == UINT8_MAX ||
+        now - tstream_block_time >= TSTREAM_PACKED_LATENCY_MS) {
+        tstream_flush_packed();
+    }
+}
+
+/* In the task thread before the producers start, no publish is missed */
+static void tstream_init(void *arg)
+{
+    (void)arg;
+    chEvtRegisterMaskWithFlags(tbusGetEventSource(),
+                               &tstream_listener,
+                               TSTREAM_EVT_TBUS,
+                               TSTREAM_FEED_FLAGS);
+}
+
+static void tstream_step(void *arg)
+{
+    unsigned rate = tstream_rate;
+
+    (void)arg;
+
+    /* Also for reads over rpc while no one listens.*/
+    tstream_update();
+    if (!tstream_ready()) {
+        /* Stale by the time anyone listens again.*/
+        tstream_enc.samples = 0;
+        return;
+    }
+    tstream_send_events();
+    if (rate == 0U) {
+        tstream_flush_packed();
+    } else if (tstream_packed) {
+        tstream_pack_snapshot(rate);
+    } else {
+        tstream_flush_packed();
+        tstream_send_snapshot();
+    }
+}
+
+static task_t tstream_task = {
+    .name = "tstream",
+    .offset = TIME_MS2I(1),
+    .budget_us = TSTREAM_BUDGET_US,
+    .init = tstream_init,
+    .run = tstream_step,
+};
+
+thread_t *
+tstreamStart(void *wsp, size_t size, tprio_t prio, SerialUSBDriver *sdup)
+{
+    tstream_sdu = sdup;
+    tstream_task.period = tstream_period(tstream_rate);
+    tstream_task.prio = prio;
+    return taskCreate(&tstream_task, wsp, size);
+}
+
+void tstreamSetRate(unsigned hz)
+{
+    tstream_rate = hz;
+    taskSetPeriod(&tstream_task, tstream_period(hz));
+}
+
+unsigned tstreamGetRate(void) { return tstream_rate; }
+
+void tstreamSetPacked(bool packed) { tstream_packed = packed; }
+
+bool tstreamGetPacked(void) { return tstream_packed; }
+
+void tstreamSet(unsigned channel, int32_t value)
+{
+    if (channel < TSTREAM_CHANNELS) {
+        tstream_values[channel] = value;
+    }
+}
+
+int32_t tstreamGet(unsigned channel)
+{
+    return channel < TSTREAM_CHANNELS ? tstream_values[channel] : 0;
+}
+
+void tstreamEvent(uint16_t code, uint32_t arg)
+{
+    uint32_t now = tstream_now();
+
+    chSysLock();
+    if (tstream_event_count < TSTREAM_EVENTS_MAX) {
+        tstream_event_t *ev = &tstream_events[tstream_event_count++];
+        ev->time = now;
+        ev->code = code;
+        ev->arg = arg;
+    } else {
+        tstream_stats.events_lost++;
+    }
+    chSysUnlock();
+}
+
+void tstreamGetStats(tstream_stats_t *stats)
+{
+    chSysLock();
+    *stats = tstream_stats;
+    chSysUnlock();
+}
+
+bool tstreamSendFrame(uint8_t type,
+                      uint8_t seq,
+                      const void *payload,
+                      size_t size,
+                      sysinterval_t timeout)
+{
+    return tstream_ready() && tstream_write(type, seq, payload, size, timeout);
+}
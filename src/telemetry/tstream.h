@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Values sent in every snapshot */
+#if !defined(TSTREAM_CHANNELS)
+#define TSTREAM_CHANNELS 16
+#endif
+
+/* Snapshots per second after start, 0 sends events only */
+#if !defined(TSTREAM_RATE_HZ)
+#define TSTREAM_RATE_HZ 100
+#endif
+
+/* Time of one snapshot with its events, wall time */
+#if !defined(TSTREAM_BUDGET_US)
+#define TSTREAM_BUDGET_US 1000
+#endif
+
+/* Events waiting for the next frame */
+#if !defined(TSTREAM_EVENTS_MAX)
+#define TSTREAM_EVENTS_MAX 8
+#endif
+
+/* Longest a packed snapshot waits for the frame to fill */
+#if !defined(TSTREAM_PACKED_LATENCY_MS)
+#define TSTREAM_PACKED_LATENCY_MS 100
+#endif
+
+/* Frame types, the payloads are little endian. Times are ms since the
+   start, they wrap at 2^32 ms, after 49.7 days. */
+#define TSTREAM_FRAME_SNAPSHOT 1U /* u32 time ms, i32 value[CHANNELS] */
+#define TSTREAM_FRAME_EVENT 2U    /* u32 time ms, u16 code, u32 arg */
+/* u32 time ms of the first, u32 period us, u8 count, then count
+   snapshots of CHANNELS values coded by tscodec.h without delta of delta
+   channels */
+#define TSTREAM_FRAME_PACKED 3U
+
+typedef struct {
+    uint32_t snapshots;
+    uint32_t packed; /* Frames of packed snapshots */
+    uint32_t events;
+    uint32_t events_lost; /* Queue full */
+    uint32_t dropped;     /* Frames cut short by a full USB queue */
+    uint32_t bytes;
+} tstream_stats_t;
+
+/* Binary telemetry on a USB serial port of its own, written without
+   blocking. Frames are sent only while the port is configured by the
+   host, see frame.h for the framing. Snapshots are sent by a periodic
+   task, a new rate changes its period. */
+thread_t *
+tstreamStart(void *wsp, size_t size, tprio_t prio, SerialUSBDriver *sdup);
+void tstreamSetRate(unsigned hz);
+unsigned tstreamGetRate(void);
+/* Snapshots are sent packed, several to a frame, or one frame each */
+void tstreamSetPacked(bool packed);
+bool tstreamGetPacked(void);
+/* Current, voltage and temperature come from the telemetry bus as
+   channels 0..2, 3..5 and 6..9. Any thread may set the others, the
+   value goes out with the next snapshot. */
+void tstreamSet(unsigned channel, int32_t value);
+int32_t tstreamGet(unsigned channel);
+void tstreamEvent(uint16_t code, uint32_t arg);
+void tstreamGetStats(tstream_stats_t *stats);
+/* Other frames on the same port, types with bit 7 set are free. Waits
+   up to timeout for space, returns false if the frame was cut short. */
+bool tstreamSendFrame(uint8_t type,
+                      uint8_t seq,
+                      const void *payload,
+                      size_t size,
+                      sysinterval_t timeout);
@@ -26,6 +26,7 @@
  * Virtual serial ports over USB.
  */
 SerialUSBDriver SDU1;
+SerialUSBDriver SDU2;
 
 /* STMicroelectronics Virtual COM Port
  * Same as preinstalled firmware
@@ -378,6 +379,7 @@ static const USBEndpointConfig ep4config = {
  */
 static void usb_event(USBDriver *usbp, usbevent_t event) {
   extern SerialUSBDriver SDU1;
+  extern SerialUSBDriver SDU2;
 
   switch (event) {
   case USB_EVENT_ADDRESS:
@@ -396,6 +398,7 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
 
       /* Resetting the state of the CDC subsystem.*/
       sduConfigureHookI(&SDU1);
+      sduConfigureHookI(&SDU2);
     }
     else if (usbp->state == USB_SELECTED) {
       usbDisableEndpointsI(usbp);
@@ -412,6 +415,7 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
 
     /* Disconnection event on suspend.*/
     sduSuspendHookI(&SDU1);
+    sduSuspendHookI(&SDU2);
 
     chSysUnlockFromISR();
     return;
@@ -420,6 +424,7 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
 
     /* Connection event on wakeup.*/
     sduWakeupHookI(&SDU1);
+    sduWakeupHookI(&SDU2);
 
     chSysUnlockFromISR();
     return;
@@ -452,6 +457,7 @@ static void sof_handler(USBDriver *usbp) {
 
   osalSysLockFromISR();
   sduSOFHookI(&SDU1);
+  sduSOFHookI(&SDU2);
   osalSysUnlockFromISR();
 }
 
@@ -474,3 +480,13 @@ const SerialUSBConfig serusbcfg1 = {
   USB_DATA_AVAILABLE_EP_A,
   USB_INTERRUPT_REQUEST_EP_A
 };
+
+/*
+ * Serial over USB driver configuration 2.
+ */
+const SerialUSBConfig serusbcfg2 = {
+  &USBD1,
+  USB_DATA_REQUEST_EP_B,
+  USB_DATA_AVAILABLE_EP_B,
+  USB_INTERRUPT_REQUEST_EP_B
+};
@@ -25,7 +25,9 @@
 
 extern const USBConfig usbcfg;
 extern SerialUSBConfig serusbcfg1;
+extern SerialUSBConfig serusbcfg2;
 extern SerialUSBDriver SDU1;
+extern SerialUSBDriver SDU2;
 
 #endif  /* USBCFG_H */
 
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ccm.h"
+#include "wdog.h"
+
+#include <string.h>
+
+#define WDOG_MAGIC 0x57444f47U /* "WDOG" */
+#define WDOG_LSI_HZ 40000U
+#define WDOG_PRESCALER 64U
+/* Stack words searched for return addresses */
+#define WDOG_SCAN_WORDS 128U
+
+extern uint8_t __text_base__;
+extern uint8_t __text_end__;
+
+typedef struct {
+    uint32_t magic;
+    wdog_stall_t stall;
+    uint32_t check;
+} wdog_record_t;
+
+static wdog_record_t wdog_record CCM_NOINIT;
+static wdog_stall_t wdog_last;
+static bool wdog_reset;
+static bool wdog_stalled;
+
+static wdog_heartbeat_t *wdog_heartbeats[WDOG_HEARTBEATS_MAX];
+static unsigned wdog_count;
+
+static const WDGConfig wdog_config = {
+    .pr = STM32_IWDG_PR_64,
+    .rlr = STM32_IWDG_RL(WDOG_TIMEOUT_MS * (WDOG_LSI_HZ / WDOG_PRESCALER) /
+                         1000U),
+    .winr = STM32_IWDG_WIN_DISABLED,
+};
+
+static uint32_t wdog_checksum(const wdog_stall_t *stall)
+{
+    const uint32_t *p = (const uint32_t *)stall;
+    uint32_t sum = WDOG_MAGIC;
+
+    for (size_t i = 0; i < sizeof(*stall) / sizeof(uint32_t); i++) {
+        sum = (sum << 5 | sum >> 27) ^ p[i];
+    }
+    return sum;
+}
+
+/* A thread that is not running has its registers saved at the top of
+   its stack, the saved link register points to where it was switched
+   out. Return addresses further up are odd words within the code. */
+static void wdog_trace(const thread_t *tp, wdog_stall_t *stall)
+{
+    const uint32_t *sp = (const uint32_t *)(tp->ctx.sp + 1);
+    const uint32_t *end = (const uint32_t *)tp;
+    unsigned n = 0;
+
+    stall->pc = tp->ctx.sp->lr;
+    if (end > sp + WDOG_SCAN_WORDS) {
+        end = sp + WDOG_SCAN_WORDS;
+    }
+    for (; sp < end && n < WDOG_TRACE_DEPTH; sp++) {
+        if ((*sp & 1U) != 0U && *sp >= (uint32_t)&__text_base__ &&
+            *sp < (uint32_t)&__text_end__) {
+            stall->trace[n++] = *sp & ~1U;
+        }
+    }
+}
+
+/* Returns the first heartbeat overdue, NULL while all are alive */
+static wdog_heartbeat_t *wdog_check(void)
+{
+    for (unsigned i = 0; i < wdog_count; i++) {
+        wdog_heartbeat_t *hb = wdog_heartbeats[i];
+
+        if (hb->tp != NULL &&
+            chVTTimeElapsedSinceX(hb->last) >
+                hb->within + TIME_MS2I(WDOG_GRACE_MS)) {
+            return hb;
+        }
+    }
+    return NULL;
+}
+
+static void wdog_store(const wdog_heartbeat_t *hb)
+{
+    wdog_stall_t *stall = &wdog_record.stall;
+
+    memset(stall, 0, sizeof(*stall));
+    strncpy(stall->name, hb->name, sizeof(stall->name) - 1U);
+    stall->state = hb->tp->state;
+    stall->uptime_ms = (uint32_t)TIME_I2MS(chVTGetSystemTimeX());
+    stall->late_ms =
+        (uint32_t)TIME_I2MS(chVTTimeElapsedSinceX(hb->last) - hb->within);
+    wdog_trace(hb->tp, stall);
+    wdog_record.check = wdog_checksum(stall);
+    wdog_record.magic = WDOG_MAGIC;
+}
+
+static THD_FUNCTION(ThreadWdog, arg)
+{
+    systime_t prev = chVTGetSystemTimeX();
+
+    (void)arg;
+    chRegSetThreadName("wdog");
+
+    /* Stopped while the core is halted by a debugger.*/
+    DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;
+    wdgStart(&WDGD1, &wdog_config);
+
+    while (true) {
+        prev = chThdSleepUntilWindowed(
+            prev, chTimeAddX(prev, TIME_MS2I(WDOG_PERIOD_MS)));
+
+        /* The stalled thread stays where it is while it is recorded.*/
+        chSysLock();
+        if (!wdog_stalled) {
+            wdog_heartbeat_t *hb = wdog_check();
+
+            if (hb != NULL) {
+                wdog_store(hb);
+                wdog_stalled = true;
+            }
+        }
+        chSysUnlock();
+
+        if (!wdog_stalled) {
+            wdgReset(&WDGD1);
+        }
+    }
+}
+
+void wdogInit(void)
+{
+    wdog_reset = (RCC->CSR & RCC_CSR_IWDGRSTF) != 0U;
+    RCC->CSR |= RCC_CSR_RMVF;
+
+    /* Other resets keep the RAM too, a record is only reported once.*/
+    if (wdog_reset && wdog_record.magic == WDOG_MAGIC &&
+        wdog_record.check == wdog_checksum(&wdog_record.stall)) {
+        wdog_last = wdog_record.stall;
+        wdog_last.name[WDOG_NAME_SIZE - 1] = '\0';
+    }
+    wdog_record.magic = 0;
+}
+
+thread_t *wdogStart(void *wsp, size_t size, tprio_t prio)
+{
+    return chThdCreateStatic(wsp, size, prio, ThreadWdog, NULL);
+}
+
+void wdogAdd(wdog_heartbeat_t *hb, const char *name)
+{
+    hb->name = name;
+    hb->tp = NULL;
+    chSysLock();
+    osalDbgAssert(wdog_count < WDOG_HEARTBEATS_MAX, "too many heartbeats");
+    wdog_heartbeats[wdog_count++] = hb;
+    chSysUnlock();
+}
+
+void wdogCheckIn(wdog_heartbeat_t *hb, sysinterval_t within)
+{
+    chSysLock();
+    hb->tp = chThdGetSelfX();
+    hb->last = chVTGetSystemTimeX();
+    hb->within = within;
+    chSysUnlock();
+}
+
+bool wdogWasReset(void) { return wdog_reset; }
+
+bool wdogGetStall(wdog_stall_t *stall)
+{
+    *stall = wdog_last;
+    return wdog_last.name[0] != '\0';
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-3.0-only
+   fan controller - Copyright (C) 2021 alexth4ef9
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Time between two checks of the heartbeats */
+#if !defined(WDOG_PERIOD_MS)
+#define WDOG_PERIOD_MS 100
+#endif
+
+/* Hardware watchdog timeout, from the LSI at nominal 40 kHz */
+#if !defined(WDOG_TIMEOUT_MS)
+#define WDOG_TIMEOUT_MS 1000
+#endif
+
+/* Time a heartbeat may be late before its thread counts as stalled */
+#if !defined(WDOG_GRACE_MS)
+#define WDOG_GRACE_MS 500
+#endif
+
+#if !defined(WDOG_HEARTBEATS_MAX)
+#define WDOG_HEARTBEATS_MAX 8
+#endif
+
+#define WDOG_NAME_SIZE 12
+/* Return addresses found on the stack of a stalled thread */
+#define WDOG_TRACE_DEPTH 4
+
+typedef struct {
+    const char *name;
+    thread_t *tp;
+    systime_t last;
+    sysinterval_t within;
+} wdog_heartbeat_t;
+
+/* Written before the watchdog resets the system, kept in RAM that is not
+   initialized at startup */
+typedef struct {
+    char name[WDOG_NAME_SIZE];
+    uint32_t state;      /* Thread state, see CH_STATE_NAMES */
+    uint32_t uptime_ms;
+    uint32_t late_ms;    /* Past the expected check-in */
+    uint32_t pc;         /* Where the thread was switched out */
+    uint32_t trace[WDOG_TRACE_DEPTH];
+} wdog_stall_t;
+
+/* Reads and clears the reset cause, before the watchdog is started */
+void wdogInit(void);
+/* The supervisor kicks the hardware watchdog only while every
+   heartbeat checked in on time. On a stall it records the thread and
+   lets the hardware reset the system. */
+thread_t *wdogStart(void *wsp, size_t size, tprio_t prio);
+/* Supervises the calling thread, from its first check-in on */
+void wdogAdd(wdog_heartbeat_t *hb, const char *name);
+/* The next check-in is due within the interval */
+void wdogCheckIn(wdog_heartbeat_t *hb, sysinterval_t within);
+bool wdogWasReset(void);
+/* Stall that caused the last reset, false if there was none */
+bool wdogGetStall(wdog_stall_t *stall);
@@ -41,11 +41,24 @@
 #if W25Q_USE_SUB_SECTORS == TRUE
 #define SECTOR_SIZE 0x00001000U
 #define CMD_SECTOR_ERASE W25Q_CMD_SECTOR_ERASE
+#define OP_SECTOR_ERASE W25Q_OP_ERASE_4K
 #else
 #define SECTOR_SIZE 0x00010000U
 #define CMD_SECTOR_ERASE W25Q_CMD_BLOCK_ERASE_64K
+#define OP_SECTOR_ERASE W25Q_OP_ERASE_64K
 #endif
 
+#if W25Q_SPI_FAST_READ == TRUE
+#define SPI_READ_CMD W25Q_CMD_FAST_READ
+#define SPI_READ_DUMMY_BYTES (W25Q_READ_DUMMY_CYCLES / 8U)
+#else
+#define SPI_READ_CMD W25Q_CMD_READ_DATA
+#define SPI_READ_DUMMY_BYTES 0U
+#endif
+
+/* Largest single SPI transfer, limited by the DMA counter.*/
+#define SPI_MAX_TRANSFER 0xFFFFU
+
 /*===========================================================================*/
 /* Driver exported variables.                                                */
 /*===========================================================================*/
@@ -138,6 +151,35 @@ static const wspi_command_t w25q_cmd_write_enable = {
     .dummy = 0};
 #endif /* SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_WSPI */
 
+/* Datasheet typical durations the timing model starts from.*/
+static const uint32_t w25q_typical_us[W25Q_OP_COUNT] = {
+    W25Q_TIME_PAGE_PROGRAM_US,
+    W25Q_TIME_ERASE_4K_US,
+    W25Q_TIME_ERASE_64K_US,
+    W25Q_TIME_ERASE_CHIP_US,
+};
+
+/* Operation durations.*/
+static w25q_timing_t w25q_timing[W25Q_OP_COUNT];
+
+/* Erase in progress.*/
+static bool w25q_erase_pending;
+static w25q_op_t w25q_erase_op;
+static systime_t w25q_erase_start;
+static uint32_t w25q_erase_polls;
+static bool w25q_erase_suspended;
+static systime_t w25q_suspend_start;
+static bool w25q_resumed;
+static rtcnt_t w25q_resume_time;
+
+/* Deep power-down, times in system ticks.*/
+static bool w25q_powered_down;
+static systimestamp_t w25q_powerdown_start;
+static systimestamp_t w25q_power_since;
+static uint64_t w25q_powerdown_ticks;
+static uint32_t w25q_powerdowns;
+static uint32_t w25q_wakeup_us;
+
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
@@ -154,10 +196,79 @@ static bool w25q_find_id(const uint8_t *set, size_t size, uint8_t element)
     return false;
 }
 
-static flash_error_t w25q_poll_status(SNORDriver *devp)
+static void w25q_timing_update(w25q_op_t op,
+                               uint32_t us,
+                               uint32_t polls,
+                               bool overrun)
+{
+    w25q_timing_t *tp = &w25q_timing[op];
+
+    osalSysLock();
+    if ((tp->count == 0U) || (us < tp->min_us)) {
+        tp->min_us = us;
+    }
+    if (us > tp->max_us) {
+        tp->max_us = us;
+    }
+    tp->last_us = us;
+    tp->total_us += us;
+    tp->count++;
+    tp->polls += polls;
+    if (overrun) {
+        tp->overruns++;
+    }
+#if W25Q_USE_TIMING_MODEL == TRUE
+    /* The model follows the measurements with a weight of 1/8.*/
+    tp->expected_us = tp->expected_us - (tp->expected_us / 8U) + (us / 8U);
+#endif
+    osalSysUnlock();
+}
+
+static flash_error_t w25q_poll_status(SNORDriver *devp, size_t n)
 {
     uint8_t sts;
 
+#if W25Q_USE_TIMING_MODEL == TRUE
+    rtcnt_t start = chSysGetRealtimeCounterX();
+    uint32_t expected_us =
+        (uint32_t)((w25q_timing[W25Q_OP_PAGE_PROGRAM].expected_us * n) /
+                   PAGE_SIZE);
+    uint32_t sleep_us = (expected_us * W25Q_TIMING_SLEEP_PERCENT) / 100U;
+    sysinterval_t ticks =
+        (sysinterval_t)(((uint64_t)sleep_us * OSAL_ST_FREQUENCY) / 1000000U);
+    uint32_t elapsed_us;
+    uint32_t polls = 0U;
+    bool overrun = false;
+
+    /* Sleeping for most of the expected time, rounded down to full ticks.*/
+    if (ticks > (sysinterval_t)0) {
+        osalThreadSleep(ticks);
+    }
+
+    while (true) {
+        /* Read status command.*/
+        bus_cmd_receive(devp->config->busp, W25Q_CMD_READ_STATUS1, 1, &sts);
+        polls++;
+        elapsed_us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+        if ((sts & W25Q_FLAGS_BUSY) == 0U) {
+            break;
+        }
+
+        /* Spinning only shortly past the expected time.*/
+        if (elapsed_us > expected_us + W25Q_TIMING_SPIN_US) {
+            overrun = true;
+#if W25Q_NICE_WAITING == TRUE
+            osalThreadSleepMilliseconds(1);
+#endif
+        }
+    }
+
+    if (n == PAGE_SIZE) {
+        w25q_timing_update(W25Q_OP_PAGE_PROGRAM, elapsed_us, polls, overrun);
+    }
+#else
+    (void)n;
+
     do {
 #if W25Q_NICE_WAITING == TRUE
         osalThreadSleepMilliseconds(1);
@@ -165,10 +276,53 @@ static flash_error_t w25q_poll_status(SNORDriver *devp)
         /* Read status command.*/
         bus_cmd_receive(devp->config->busp, W25Q_CMD_READ_STATUS1, 1, &sts);
     } while ((sts & W25Q_FLAGS_BUSY) != 0U);
+#endif
 
     return FLASH_NO_ERROR;
 }
 
+static void w25q_erase_begin(w25q_op_t op)
+{
+    w25q_erase_op = op;
+    w25q_erase_start = osalOsGetSystemTimeX();
+    w25q_erase_polls = 0U;
+    w25q_erase_suspended = false;
+    w25q_resumed = false;
+    w25q_erase_pending = true;
+}
+
+static void w25q_erase_end(void)
+{
+    if (w25q_erase_pending) {
+        uint32_t elapsed_us = (uint32_t)OSAL_I2US(
+            osalTimeDiffX(w25q_erase_start, osalOsGetSystemTimeX()));
+        w25q_timing_update(w25q_erase_op,
+                           elapsed_us,
+                           w25q_erase_polls,
+                           elapsed_us > w25q_timing[w25q_erase_op].expected_us +
+                                            W25Q_TIMING_SPIN_US);
+        w25q_erase_pending = false;
+    }
+}
+
+static uint32_t w25q_erase_wait_ms(void)
+{
+#if W25Q_USE_TIMING_MODEL == TRUE
+    /* Sleeping for most of the expected time, then polling every
+       millisecond.*/
+    if (w25q_erase_pending) {
+        uint32_t elapsed_us = (uint32_t)OSAL_I2US(
+            osalTimeDiffX(w25q_erase_start, osalOsGetSystemTimeX()));
+        uint32_t sleep_us = (w25q_timing[w25q_erase_op].expected_us / 100U) *
+                            W25Q_TIMING_SLEEP_PERCENT;
+        if (sleep_us > elapsed_us + 1000U) {
+            return (sleep_us - elapsed_us) / 1000U;
+        }
+    }
+#endif
+    return 1U;
+}
+
 #if SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_WSPI
 static void w25q_reset_memory(SNORDriver *devp)
 {
@@ -193,6 +347,41 @@ static void w25q_reset_memory(SNORDriver *devp)
 }
 #endif /* SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_WSPI */
 
+#if SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_SPI
+/* Selects the device and sends the read command, the data follows until the
+   device is unselected and the address wraps at the end of the array.*/
+static void w25q_spi_read_start(SNORDriver *devp, flash_offset_t offset)
+{
+    uint8_t buf[4U + SPI_READ_DUMMY_BYTES];
+
+    buf[0] = SPI_READ_CMD;
+    buf[1] = (uint8_t)(offset >> 16);
+    buf[2] = (uint8_t)(offset >> 8);
+    buf[3] = (uint8_t)(offset >> 0);
+    memset(&buf[4], 0, SPI_READ_DUMMY_BYTES);
+
+    spiSelect(devp->config->busp);
+    spiSend(devp->config->busp, sizeof buf, buf);
+}
+
+/* Streams a read of any size with a single command, across page and sector
+   boundaries.*/
+static void w25q_spi_read(SNORDriver *devp,
+                          flash_offset_t offset,
+                          size_t n,
+                          uint8_t *rp)
+{
+    w25q_spi_read_start(devp, offset);
+    while (n > 0U) {
+        size_t chunk = n > SPI_MAX_TRANSFER ? SPI_MAX_TRANSFER : n;
+        spiReceive(devp->config->busp, chunk, rp);
+        rp += chunk;
+        n -= chunk;
+    }
+    spiUnselect(devp->config->busp);
+}
+#endif /* SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_SPI */
+
 static const uint8_t w25q_manufacturer_ids[] = W25Q_SUPPORTED_MANUFACTURE_IDS;
 static const uint8_t w25q_memory_type_ids[] = W25Q_SUPPORTED_MEMORY_TYPE_IDS;
 
@@ -203,6 +392,11 @@ static const uint8_t w25q_memory_type_ids[] = W25Q_SUPPORTED_MEMORY_TYPE_IDS;
 void snor_device_init(SNORDriver *devp)
 {
 
+    /* A reset of the MCU alone leaves the device in deep power-down.*/
+    bus_cmd(devp->config->busp, W25Q_CMD_RELEASE_POWERDOWN);
+    osalSysPolledDelayX(OSAL_US2RTC(STM32_HCLK, W25Q_TIME_RES1_US));
+    w25q_powered_down = false;
+
     /* Reading device ID.*/
     bus_cmd_receive(devp->config->busp,
                     W25Q_CMD_READ_ID,
@@ -228,6 +422,10 @@ void snor_device_init(SNORDriver *devp)
     snor_descriptor.sectors_count =
         (1U << (size_t)devp->device_id[2]) / SECTOR_SIZE;
     snor_descriptor.size = (size_t)snor_descriptor.sectors_count * SECTOR_SIZE;
+
+    /* Starting the timing model from the datasheet values.*/
+    w25q_erase_pending = false;
+    w25qResetTiming();
 }
 
 flash_error_t
@@ -261,8 +459,8 @@ snor_device_read(SNORDriver *devp, flash_offset_t offset, size_t n, uint8_t *rp)
                                rp);
 #endif
 #else
-    /* Normal read command in SPI mode.*/
-    bus_cmd_addr_receive(devp->config->busp, W25Q_CMD_READ_DATA, offset, n, rp);
+    /* Streamed read command in SPI mode.*/
+    w25q_spi_read(devp, offset, n, rp);
 #endif
 
     return FLASH_NO_ERROR;
@@ -292,7 +490,7 @@ flash_error_t snor_device_program(SNORDriver *devp,
             devp->config->busp, W25Q_CMD_PAGE_PROGRAM, offset, chunk, pp);
 
         /* Wait for status and check errors.*/
-        err = w25q_poll_status(devp);
+        err = w25q_poll_status(devp, chunk);
         if (err != FLASH_NO_ERROR) {
 
             return err;
@@ -315,6 +513,7 @@ flash_error_t snor_device_start_erase_all(SNORDriver *devp)
 
     /* Bulk erase command.*/
     bus_cmd(devp->config->busp, W25Q_CMD_CHIP_ERASE);
+    w25q_erase_begin(W25Q_OP_ERASE_CHIP);
 
     return FLASH_NO_ERROR;
 }
@@ -328,7 +527,8 @@ flash_error_t snor_device_start_erase_sector(SNORDriver *devp,
     bus_cmd(devp->config->busp, W25Q_CMD_WRITE_ENABLE);
 
     /* Sector erase command.*/
-    bus_cmd_addr(devp->config->busp, W25Q_CMD_SECTOR_ERASE, offset);
+    bus_cmd_addr(devp->config->busp, CMD_SECTOR_ERASE, offset);
+    w25q_erase_begin(OP_SECTOR_ERASE);
 
     return FLASH_NO_ERROR;
 }
@@ -342,6 +542,10 @@ flash_error_t snor_device_verify_erase(SNORDriver *devp, flash_sector_t sector)
     /* Read command.*/
     offset = (flash_offset_t)(sector * SECTOR_SIZE);
     n = SECTOR_SIZE;
+#if SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_SPI
+    /* In SPI mode the whole sector is streamed by a single read command.*/
+    w25q_spi_read_start(devp, offset);
+#endif
     while (n > 0U) {
         uint8_t *p;
 
@@ -372,17 +576,15 @@ flash_error_t snor_device_verify_erase(SNORDriver *devp, flash_sector_t sector)
                                    cmpbuf);
 #endif
 #else
-        /* Normal read command in SPI mode.*/
-        bus_cmd_addr_receive(devp->config->busp,
-                             W25Q_CMD_READ_DATA,
-                             offset,
-                             sizeof cmpbuf,
-                             cmpbuf);
+        spiReceive(devp->config->busp, sizeof cmpbuf, cmpbuf);
 #endif
 
         /* Checking for erased state of current buffer.*/
         for (p = cmpbuf; p < &cmpbuf[W25Q_COMPARE_BUFFER_SIZE]; p++) {
             if (*p != 0xFFU) {
+#if SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_SPI
+                spiUnselect(devp->config->busp);
+#endif
                 /* Ready state again.*/
                 devp->state = FLASH_READY;
 
@@ -393,6 +595,9 @@ flash_error_t snor_device_verify_erase(SNORDriver *devp, flash_sector_t sector)
         offset += sizeof cmpbuf;
         n -= sizeof cmpbuf;
     }
+#if SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_SPI
+    spiUnselect(devp->config->busp);
+#endif
 
     return FLASH_NO_ERROR;
 }
@@ -406,21 +611,98 @@ flash_error_t snor_device_query_erase(SNORDriver *devp, uint32_t *msec)
 
     /* Read status 2 command.*/
     bus_cmd_receive(devp->config->busp, W25Q_CMD_READ_STATUS2, 1, &sts2);
+    w25q_erase_polls++;
 
     /* If the busy bit is set or the flash in a suspended state then
        report that the operation is still in progress.*/
     if (((sts1 & W25Q_FLAGS_BUSY) != 0U) ||
         ((sts2 & W25Q_FLAGS_SUSPEND) != 0U)) {
 
-        /* Recommended time before polling again, this is a simplified
-           implementation.*/
+        /* Recommended time before polling again, based on the timing
+           model.*/
         if (msec != NULL) {
-            *msec = 1U;
+            *msec = w25q_erase_wait_ms();
         }
 
         return FLASH_BUSY_ERASING;
     }
 
+    w25q_erase_end();
+
+    return FLASH_NO_ERROR;
+}
+
+/**
+ * @brief   Suspends a running erase operation.
+ * @details Data outside the sector being erased can be read while the erase
+ *          is suspended. Program and erase operations are not allowed.
+ *
+ * @param[in] devp      pointer to the @p SNORDriver object
+ * @return              The operation status.
+ * @retval FLASH_NO_ERROR       if the erase is suspended or has completed.
+ * @retval FLASH_BUSY_ERASING   if the erase was resumed too recently.
+ */
+flash_error_t snor_device_suspend_erase(SNORDriver *devp)
+{
+    uint8_t sts1, sts2;
+
+    if (!w25q_erase_pending || w25q_erase_suspended) {
+        return FLASH_NO_ERROR;
+    }
+
+    /* Letting the erase progress after a resume.*/
+    if (w25q_resumed &&
+        (RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - w25q_resume_time) <
+         W25Q_TIME_RESUME_MIN_US)) {
+        return FLASH_BUSY_ERASING;
+    }
+
+    /* Suspend command.*/
+    bus_cmd(devp->config->busp, W25Q_CMD_ERASE_PROGRAM_SUSPEND);
+
+    /* The busy flag is cleared within tSUS.*/
+    do {
+        bus_cmd_receive(devp->config->busp, W25Q_CMD_READ_STATUS1, 1, &sts1);
+    } while ((sts1 & W25Q_FLAGS_BUSY) != 0U);
+    bus_cmd_receive(devp->config->busp, W25Q_CMD_READ_STATUS2, 1, &sts2);
+
+    if ((sts2 & W25Q_FLAGS_SUSPEND) != 0U) {
+        w25q_suspend_start = osalOsGetSystemTimeX();
+        w25q_erase_suspended = true;
+    } else {
+        /* The erase completed before the suspend.*/
+        w25q_erase_end();
+    }
+
+    return FLASH_NO_ERROR;
+}
+
+/**
+ * @brief   Resumes an erase operation suspended by
+ *          @p snor_device_suspend_erase().
+ *
+ * @param[in] devp      pointer to the @p SNORDriver object
+ * @return              The operation status.
+ */
+flash_error_t snor_device_resume_erase(SNORDriver *devp)
+{
+    if (w25q_erase_suspended) {
+        /* Resume command.*/
+        bus_cmd(devp->config->busp, W25Q_CMD_ERASE_PROGRAM_RESUME);
+
+        /* The suspended time does not count as erase time.*/
+        w25q_erase_start = osalTimeAddX(
+            w25q_erase_start,
+            osalTimeDiffX(w25q_suspend_start, osalOsGetSystemTimeX()));
+        w25q_erase_suspended = false;
+        w25q_resume_time = chSysGetRealtimeCounterX();
+        w25q_resumed = true;
+
+        osalSysLock();
+        w25q_timing[w25q_erase_op].suspends++;
+        osalSysUnlock();
+    }
+
     return FLASH_NO_ERROR;
 }
 
@@ -438,6 +720,142 @@ flash_error_t snor_device_read_sfdp(SNORDriver *devp,
     return FLASH_NO_ERROR;
 }
 
+/**
+ * @brief   Returns the duration statistics of a flash operation.
+ *
+ * @param[in] op        the operation
+ * @param[out] tp       pointer to the statistics copy
+ */
+void w25qGetTiming(w25q_op_t op, w25q_timing_t *tp)
+{
+    osalDbgCheck((op < W25Q_OP_COUNT) && (tp != NULL));
+
+    osalSysLock();
+    *tp = w25q_timing[op];
+    osalSysUnlock();
+}
+
+/**
+ * @brief   Clears the statistics and restarts the timing model.
+ */
+void w25qResetTiming(void)
+{
+    osalSysLock();
+    for (unsigned i = 0; i < W25Q_OP_COUNT; i++) {
+        memset(&w25q_timing[i], 0, sizeof(w25q_timing[i]));
+        w25q_timing[i].expected_us = w25q_typical_us[i];
+    }
+    osalSysUnlock();
+}
+
+/**
+ * @brief   Puts the device into deep power-down.
+ * @details Only the release command is accepted afterwards, the caller
+ *          must not access the device until @p w25qPowerUp().
+ * @note    No erase or program operation may be in progress.
+ *
+ * @param[in] devp      pointer to the @p SNORDriver object
+ */
+void w25qPowerDown(SNORDriver *devp)
+{
+    osalDbgCheck(devp != NULL);
+    osalDbgAssert(!w25q_erase_pending, "erase in progress");
+
+    if (w25q_powered_down) {
+        return;
+    }
+
+    bus_acquire(devp->config->busp, devp->config->buscfg);
+    bus_cmd(devp->config->busp, W25Q_CMD_POWERDOWN);
+    bus_release(devp->config->busp);
+
+    osalSysLock();
+    w25q_powerdown_start = chVTGetTimeStampI();
+    w25q_powered_down = true;
+    w25q_powerdowns++;
+    osalSysUnlock();
+}
+
+/**
+ * @brief   Releases the device from deep power-down.
+ * @details Returns once the device accepts commands again, after tRES1.
+ *
+ * @param[in] devp      pointer to the @p SNORDriver object
+ */
+void w25qPowerUp(SNORDriver *devp)
+{
+    rtcnt_t start;
+
+    osalDbgCheck(devp != NULL);
+
+    if (!w25q_powered_down) {
+        return;
+    }
+
+    start = chSysGetRealtimeCounterX();
+    bus_acquire(devp->config->busp, devp->config->buscfg);
+    bus_cmd(devp->config->busp, W25Q_CMD_RELEASE_POWERDOWN);
+    bus_release(devp->config->busp);
+    osalSysPolledDelayX(OSAL_US2RTC(STM32_HCLK, W25Q_TIME_RES1_US));
+
+    osalSysLock();
+    w25q_powerdown_ticks += chVTGetTimeStampI() - w25q_powerdown_start;
+    w25q_powered_down = false;
+    w25q_wakeup_us = RTC2US(STM32_HCLK, chSysGetRealtimeCounterX() - start);
+    osalSysUnlock();
+}
+
+/**
+ * @brief   Returns true while the device is in deep power-down.
+ */
+bool w25qIsPoweredDown(void) { return w25q_powered_down; }
+
+static uint64_t w25q_ticks_to_us(uint64_t ticks)
+{
+    return ticks * 1000000U / OSAL_ST_FREQUENCY;
+}
+
+/**
+ * @brief   Returns the deep power-down residency statistics.
+ *
+ * @param[out] pp       pointer to the statistics copy
+ */
+void w25qGetPower(w25q_power_t *pp)
+{
+    systimestamp_t now;
+    uint64_t ticks;
+
+    osalDbgCheck(pp != NULL);
+
+    osalSysLock();
+    now = chVTGetTimeStampI();
+    ticks = w25q_powerdown_ticks;
+    if (w25q_powered_down) {
+        ticks += now - w25q_powerdown_start;
+    }
+    pp->powerdowns = w25q_powerdowns;
+    pp->wakeup_us = w25q_wakeup_us;
+    pp->total_us = w25q_ticks_to_us(now - w25q_power_since);
+    osalSysUnlock();
+    pp->powerdown_us = w25q_ticks_to_us(ticks);
+}
+
+/**
+ * @brief   Clears the deep power-down statistics.
+ */
+void w25qResetPower(void)
+{
+    osalSysLock();
+    w25q_power_since = chVTGetTimeStampI();
+    if (w25q_powered_down) {
+        w25q_powerdown_start = w25q_power_since;
+    }
+    w25q_powerdown_ticks = 0;
+    w25q_powerdowns = 0;
+    w25q_wakeup_us = 0;
+    osalSysUnlock();
+}
+
 #if (SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_WSPI) || defined(__DOXYGEN__)
 void snor_activate_xip(SNORDriver *devp) { (void)devp; }
 
@@ -66,7 +66,7 @@
 #define W25Q_CMD_READ_ID 0x9f
 #define W25Q_CMD_READ_UNIQUE_ID 0x4b
 #define W25Q_CMD_READ_DATA 0x03
-#define W25Q_CMD_FAST_READ 0xb0
+#define W25Q_CMD_FAST_READ 0x0b
 #define W25Q_CMD_PAGE_PROGRAM 0x02
 #define W25Q_CMD_SECTOR_ERASE 0x20
 #define W25Q_CMD_BLOCK_ERASE_32K 0x52
@@ -191,6 +191,80 @@
 #define W25Q_READ_DUMMY_CYCLES 8
 #endif
 
+/**
+ * @brief   Uses the fast read command in SPI bus mode.
+ * @details The fast read command adds @p W25Q_READ_DUMMY_CYCLES dummy cycles
+ *          after the address and is required above the 50MHz limit of the
+ *          normal read command, below that limit it only adds a dummy byte
+ *          to every read.
+ * @note    This option is only valid in SPI bus mode.
+ */
+#if !defined(W25Q_SPI_FAST_READ) || defined(__DOXYGEN__)
+#define W25Q_SPI_FAST_READ FALSE
+#endif
+
+/**
+ * @brief   Timing model based busy waiting.
+ * @details If enabled the flash waiting routines sleep for most of the
+ *          expected duration of the running operation and then poll the
+ *          status register without sleeping, if disabled the status is
+ *          polled according to @p W25Q_NICE_WAITING.
+ * @note    The expected durations start at the datasheet typical values
+ *          and follow the measured durations afterwards.
+ */
+#if !defined(W25Q_USE_TIMING_MODEL) || defined(__DOXYGEN__)
+#define W25Q_USE_TIMING_MODEL TRUE
+#endif
+
+/**
+ * @brief   Part of the expected duration spent sleeping, in percent.
+ */
+#if !defined(W25Q_TIMING_SLEEP_PERCENT) || defined(__DOXYGEN__)
+#define W25Q_TIMING_SLEEP_PERCENT 75
+#endif
+
+/**
+ * @brief   Time polling without sleeping past the expected duration (us).
+ * @details After this time polling falls back to @p W25Q_NICE_WAITING.
+ */
+#if !defined(W25Q_TIMING_SPIN_US) || defined(__DOXYGEN__)
+#define W25Q_TIMING_SPIN_US 200
+#endif
+
+/**
+ * @name    Typical operation durations (datasheet tPP, tSE, tBE2, tCE)
+ * @{
+ */
+#if !defined(W25Q_TIME_PAGE_PROGRAM_US) || defined(__DOXYGEN__)
+#define W25Q_TIME_PAGE_PROGRAM_US 400
+#endif
+#if !defined(W25Q_TIME_ERASE_4K_US) || defined(__DOXYGEN__)
+#define W25Q_TIME_ERASE_4K_US 45000
+#endif
+#if !defined(W25Q_TIME_ERASE_64K_US) || defined(__DOXYGEN__)
+#define W25Q_TIME_ERASE_64K_US 150000
+#endif
+#if !defined(W25Q_TIME_ERASE_CHIP_US) || defined(__DOXYGEN__)
+#define W25Q_TIME_ERASE_CHIP_US 20000000
+#endif
+/** @} */
+
+/**
+ * @brief   Time to release from deep power-down (datasheet tRES1, us).
+ */
+#if !defined(W25Q_TIME_RES1_US) || defined(__DOXYGEN__)
+#define W25Q_TIME_RES1_US 3
+#endif
+
+/**
+ * @brief   Minimum erase time between a resume and the next suspend (us).
+ * @details Guarantees that an erase makes progress while suspend requests
+ *          keep coming in.
+ */
+#if !defined(W25Q_TIME_RESUME_MIN_US) || defined(__DOXYGEN__)
+#define W25Q_TIME_RESUME_MIN_US 1000
+#endif
+
 /*===========================================================================*/
 /* Derived constants and error checks.                                       */
 /*===========================================================================*/
@@ -203,6 +277,15 @@
 #error "invalid W25Q_READ_DUMMY_CYCLES value (1..15)"
 #endif
 
+#if (SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_SPI) &&                                \
+    (W25Q_SPI_FAST_READ == TRUE) && ((W25Q_READ_DUMMY_CYCLES % 8) != 0)
+#error "W25Q_READ_DUMMY_CYCLES must be a multiple of 8 in SPI bus mode"
+#endif
+
+#if (W25Q_TIMING_SLEEP_PERCENT < 0) || (W25Q_TIMING_SLEEP_PERCENT > 100)
+#error "invalid W25Q_TIMING_SLEEP_PERCENT value (0..100)"
+#endif
+
 #if (W25Q_BUS_MODE == W25Q_BUS_MODE_WSPI4L) || defined(__DOXYGEN__)
 /**
  * @brief   WSPI settings for command only.
@@ -286,6 +369,43 @@
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Timed flash operations.
+ */
+typedef enum {
+    W25Q_OP_PAGE_PROGRAM = 0,
+    W25Q_OP_ERASE_4K = 1,
+    W25Q_OP_ERASE_64K = 2,
+    W25Q_OP_ERASE_CHIP = 3,
+    W25Q_OP_COUNT = 4,
+} w25q_op_t;
+
+/**
+ * @brief   Duration statistics of a flash operation.
+ * @note    Only full page programs are accounted.
+ */
+typedef struct {
+    uint32_t count;       /**< Completed operations.                       */
+    uint32_t expected_us; /**< Current model duration.                     */
+    uint32_t last_us;     /**< Duration of the last operation.             */
+    uint32_t min_us;      /**< Shortest operation.                         */
+    uint32_t max_us;      /**< Longest operation.                          */
+    uint64_t total_us;    /**< Sum of all durations.                       */
+    uint32_t polls;       /**< Status register reads.                      */
+    uint32_t overruns;    /**< Operations exceeding model plus spin time.  */
+    uint32_t suspends;    /**< Erase suspensions.                          */
+} w25q_timing_t;
+
+/**
+ * @brief   Deep power-down residency statistics.
+ */
+typedef struct {
+    uint32_t powerdowns;   /**< Entries into deep power-down.              */
+    uint32_t wakeup_us;    /**< Last release time including tRES1.         */
+    uint64_t powerdown_us; /**< Time spent in deep power-down.             */
+    uint64_t total_us;     /**< Time since the statistics were cleared.    */
+} w25q_power_t;
+
 /*===========================================================================*/
 /* Driver macros.                                                            */
 /*===========================================================================*/
@@ -319,10 +439,19 @@ flash_error_t snor_device_start_erase_sector(SNORDriver *devp,
                                              flash_sector_t sector);
 flash_error_t snor_device_verify_erase(SNORDriver *devp, flash_sector_t sector);
 flash_error_t snor_device_query_erase(SNORDriver *devp, uint32_t *msec);
+flash_error_t snor_device_suspend_erase(SNORDriver *devp);
+flash_error_t snor_device_resume_erase(SNORDriver *devp);
 flash_error_t snor_device_read_sfdp(SNORDriver *devp,
                                     flash_offset_t offset,
                                     size_t n,
                                     uint8_t *rp);
+void w25qGetTiming(w25q_op_t op, w25q_timing_t *tp);
+void w25qResetTiming(void);
+void w25qPowerDown(SNORDriver *devp);
+void w25qPowerUp(SNORDriver *devp);
+bool w25qIsPoweredDown(void);
+void w25qGetPower(w25q_power_t *pp);
+void w25qResetPower(void);
 #if (SNOR_BUS_DRIVER == SNOR_BUS_DRIVER_WSPI) &&                               \
     (SNOR_DEVICE_SUPPORTS_XIP == TRUE)
 void snor_activate_xip(SNORDriver *devp);